@@ -32,6 +32,10 @@
 #include "RTIMUBNO055.h"
 #include "CalLib.h"
 
+// The phases, commands and frames are in core.c, this file is the board
+#include "core.h"
+#include "hal.h"
+
 #if !defined(BNO055_28) && !defined(BNO055_29)
 #error "One of BNO055_28 or BNO055_29 must be selected in RTIMULibdefs.h"
 #endif
@@ -41,33 +45,56 @@ RTIMUSettings settings;                               // the settings object
 CALLIB_DATA calData;                                  // the calibration data
 
 const int pinButton = 3;
-const int TRIGGER_DELAY = 200;
-unsigned long triggerTime = 0;
-volatile int triggerInterrupt = 0;
 void triggerReady() {
-  // wait 200 ms between two shots
-  if (triggerInterrupt == 0) {
-    triggerInterrupt = 1;
-  }
+  coreTrigger();
 }
 
 #define BLE_JDY_RX 4
 #define BLE_JDY_TX 5
 SoftwareSerial BLE_JDY_16(BLE_JDY_TX, BLE_JDY_RX);
 
-const int INIT_SEQUENCE = 1;
-const int STAB_SEQUENCE = 2;
-const int CALIBRATION_SEQUENCE = 3;
-const int GAME_SEQUENCE = 4;
-int phase = 0;
-String buffer = "";
-const int ALIVE_DELAY = 50;
-unsigned long aliveTime = 0;
-
-void calib()
-{   
+unsigned long halMillis(void) {
+  return millis();
+}
+
+void halDelay(unsigned long ms) {
+  delay(ms);
+}
+
+int halBleAvailable(void) {
+  return BLE_JDY_16.available();
+}
+
+int halBleRead(void) {
+  return BLE_JDY_16.read();
+}
+
+void halBleWrite(const uint8_t* data, size_t length) {
+  BLE_JDY_16.write(data, length);
+  BLE_JDY_16.flush();
+}
+
+void halDebug(const char* text) {
+  Serial.println(text);
+}
+
+void halImuPose(float* yaw, float* pitch, float* roll) {
+  while (imu->IMURead());
+  const RTVector3& vec = imu->getFusionPose();
+  *yaw = vec.z() * RTMATH_RAD_TO_DEGREE;
+  *roll = vec.y() * RTMATH_RAD_TO_DEGREE;
+  *pitch = vec.x() * RTMATH_RAD_TO_DEGREE;
+}
+
+void halImuCalibrationStart(void) {
+  imu->setCalibrationMode(true);
+  Serial.print("ArduinoIMU calibrating device ");
+  Serial.println(imu->IMUName());
+}
+
+void halImuCalibrate(void) {
   RTVector3 mag;
-  if (imu->IMURead()) {                                 
+  if (imu->IMURead()) {
     // get the latest data
     mag = imu->getCompass();
     for (int i = 0; i < 3; i++) {
@@ -81,6 +108,19 @@ void calib()
   }
 }
 
+void halImuCalibrationSave(void) {
+  calData.magValid = true;
+  calLibWrite(0, &calData);
+}
+
+void halNoInterrupts(void) {
+  noInterrupts();
+}
+
+void halInterrupts(void) {
+  interrupts();
+}
+
 void setup() {
   int errcode;
 
@@ -109,109 +149,9 @@ void setup() {
   if ((errcode = imu->IMUInit()) < 0) {
       Serial.print("Failed to init IMU: "); Serial.println(errcode);
   }    
-  aliveTime = millis();
-  triggerTime = aliveTime;
-  phase = 0;
-  
-  ///
-  // phase = CALIBRATION_SEQUENCE;
+  coreSetup();
 }
 
-unsigned long aliveDelay() {
-    return millis() + 2 * ALIVE_DELAY;
-}
-
-void loop() {  
-  double yaw = 0.0;
-  double pitch = 0.0;
-  double roll = 0.0;
-  String receive = "";
-      
-  while (BLE_JDY_16.available()) {
-    receive += (char)BLE_JDY_16.read();
-  }
-  
-  if (receive != "") {
-    Serial.println("Debug " + receive + ".");
-    if (phase == 0) {
-      buffer += receive;
-      int n = buffer.length() - 12;
-      if (n > 0) buffer.remove(0, n);
-      if (buffer == "+CONNECTED\r\n") {
-        delay(2000);
-        Serial.println("Start sequence.");
-        BLE_JDY_16.print("A;");
-        BLE_JDY_16.flush();
-        aliveTime = aliveDelay();
-        phase = INIT_SEQUENCE;
-      }
-    }
-    else {
-      if (receive == "Z") {
-        triggerInterrupt = 0;
-        imu->setCalibrationMode(true);
-        Serial.print("ArduinoIMU calibrating device "); 
-        Serial.println(imu->IMUName());
-        phase = STAB_SEQUENCE;
-      }
-      else if (receive == "Y") {
-        phase = CALIBRATION_SEQUENCE;
-      }
-      else if (receive == "X") {
-        phase = GAME_SEQUENCE;
-      }
-    }
-  }
-
-  if (phase > INIT_SEQUENCE) {
-    if (phase == STAB_SEQUENCE) {
-      calib();
-      if (triggerInterrupt == 1) {
-        calData.magValid = true;
-        calLibWrite(0, &calData);
-        BLE_JDY_16.print("B;");
-        BLE_JDY_16.flush();
-        Serial.println("B;");
-        triggerInterrupt = TRIGGER_DELAY;
-        triggerTime = millis();
-        aliveTime = aliveDelay();
-      }
-    }
-    else {
-  
-      // get the latest data if ready yet
-      while (imu->IMURead());                               
-          
-      const RTVector3& vec = imu->getFusionPose();
-      yaw = vec.z() * RTMATH_RAD_TO_DEGREE;
-      roll = vec.y() * RTMATH_RAD_TO_DEGREE;
-      pitch = vec.x() * RTMATH_RAD_TO_DEGREE;
-  
-      if (triggerInterrupt == 1) {
-        if (phase == CALIBRATION_SEQUENCE) {
-          BLE_JDY_16.print("C " + String(yaw, 2) + " " + String(pitch, 2) + " " + String(roll, 2) + ";");
-          BLE_JDY_16.flush();
-          Serial.println("C " + String(yaw, 2) + " " + String(pitch, 2) + " " + String(roll, 2) + ";");
-        }
-        else {
-          BLE_JDY_16.print("D " + String(yaw, 2) + " " + String(pitch, 2) + " " + String(roll, 2) + ";");
-          BLE_JDY_16.flush();
-          Serial.println("D " + String(yaw, 2) + " " + String(pitch, 2) + " " + String(roll, 2) + ";");
-        }
-        triggerInterrupt = TRIGGER_DELAY;
-        triggerTime = millis();
-        aliveTime = aliveDelay();
-      }
-    }
-    unsigned long now = millis();
-    if ((aliveTime < now) && ((now - aliveTime) >= ALIVE_DELAY)) {
-      BLE_JDY_16.print("E " + String(yaw, 2) + " " + String(pitch, 2) + " " + String(roll, 2) + ";");
-      BLE_JDY_16.flush();
-      Serial.println("E " + String(yaw, 2) + " " + String(pitch, 2) + " " + String(roll, 2) + ";");
-      aliveTime = now;
-    }
-    if ((triggerInterrupt == TRIGGER_DELAY) && ((now - triggerTime) >= TRIGGER_DELAY)) {
-      triggerInterrupt = 0;
-    }
-  }
+void loop() {
+  coreLoop();
 }
@@ -0,0 +1,252 @@
+#include <string.h>
+#include "core.h"
+#include "hal.h"
+
+static const int TRIGGER_DELAY = 200;
+static unsigned long triggerTime = 0;
+static volatile int triggerInterrupt = 0;
+// millis() at the edge, the shot frame leaves one IMU read later
+static volatile unsigned long triggerEdge = 0;
+
+static const int INIT_SEQUENCE = 1;
+static const int STAB_SEQUENCE = 2;
+static const int CALIBRATION_SEQUENCE = 3;
+static const int GAME_SEQUENCE = 4;
+static int phase = 0;
+// Last characters received before the connection
+static const char CONNECTED[] = "+CONNECTED\r\n";
+static char buffer[sizeof(CONNECTED)];
+static int bufferLength = 0;
+static const int ALIVE_DELAY = 50;
+static unsigned long aliveTime = 0;
+
+// Wire protocol, see rpi/protocol.h. Binary, and the 'D' frames carry the
+// trigger edge time
+static const int PROTOCOL_SHOT_TIME = 3;
+#define FRAME_SOF 0xA5
+#define FRAME_SIZE 12
+// A binary aim frame is half the size of an ASCII one, send them faster
+static const int BINARY_ALIVE_DELAY = 20;
+static int binaryMode = 0;
+static uint8_t frameSeq = 0;
+static int alivePeriod = 0;
+
+// Longest ASCII frame, "E -179.99 -179.99 -179.99;"
+#define TEXT_SIZE 32
+// Bytes of the host read per loop, the rest waits for the next one
+#define RECEIVE_SIZE 32
+
+void coreTrigger(void) {
+  // wait 200 ms between two shots
+  if (triggerInterrupt == 0) {
+    triggerEdge = halMillis();
+    triggerInterrupt = 1;
+  }
+}
+
+int corePhase(void) {
+  return phase;
+}
+
+static uint8_t frameChecksum(const uint8_t* data, int length) {
+  uint8_t crc = 0;
+  for (int i = 0; i < length; i++) {
+    crc ^= data[i];
+    for (int bit = 0; bit < 8; bit++) {
+      crc = (crc & 0x80) ? ((crc << 1) ^ 0x07) : (crc << 1);
+    }
+  }
+  return crc;
+}
+
+static int centidegrees(double angle) {
+  return (int)(angle * 100.0 + (angle < 0 ? -0.5 : 0.5));
+}
+
+static void putFrame16(uint8_t* dest, unsigned int value) {
+  dest[0] = value & 0xFF;
+  dest[1] = value >> 8;
+}
+
+// " <angle>" with 2 decimals, as String(angle, 2) without the heap
+static char* putAngle(char* text, double angle) {
+  const int value = centidegrees(angle);
+  unsigned int magnitude = value < 0 ? -value : value;
+  char digits[8];
+  int count = 0;
+  *text++ = ' ';
+  if (value < 0) {
+    *text++ = '-';
+  }
+  do {
+    digits[count++] = '0' + magnitude % 10;
+    magnitude /= 10;
+  } while (magnitude > 0 || count < 3);
+  while (count > 2) {
+    *text++ = digits[--count];
+  }
+  *text++ = '.';
+  *text++ = digits[1];
+  *text++ = digits[0];
+  return text;
+}
+
+static void sendFrame(char type, unsigned long time, double yaw, double pitch, double roll) {
+  if (binaryMode) {
+    uint8_t frame[FRAME_SIZE];
+    frame[0] = FRAME_SOF;
+    frame[1] = type;
+    frame[2] = frameSeq++;
+    putFrame16(frame + 3, (unsigned int)time);
+    putFrame16(frame + 5, centidegrees(yaw));
+    putFrame16(frame + 7, centidegrees(pitch));
+    putFrame16(frame + 9, centidegrees(roll));
+    frame[11] = frameChecksum(frame + 1, FRAME_SIZE - 2);
+    halBleWrite(frame, FRAME_SIZE);
+    if (type != 'E') {
+      const char text[2] = { type, '\0' };
+      halDebug(text);
+    }
+  }
+  else {
+    char text[TEXT_SIZE];
+    char* end = text;
+    *end++ = type;
+    end = putAngle(end, yaw);
+    end = putAngle(end, pitch);
+    end = putAngle(end, roll);
+    *end++ = ';';
+    *end = '\0';
+    halBleWrite((const uint8_t*)text, end - text);
+    halDebug(text);
+  }
+}
+
+static unsigned long aliveDelay(void) {
+  return halMillis() + 2 * ALIVE_DELAY;
+}
+
+void coreSetup(void) {
+  aliveTime = halMillis();
+  triggerTime = aliveTime;
+  phase = 0;
+  bufferLength = 0;
+  triggerInterrupt = 0;
+  binaryMode = 0;
+  alivePeriod = ALIVE_DELAY;
+}
+
+// Before the connection, keep the last characters to spot "+CONNECTED\r\n"
+static void waitConnection(const char* receive, int length) {
+  const int size = sizeof(CONNECTED) - 1;
+  for (int i = 0; i < length; i++) {
+    if (bufferLength == size) {
+      memmove(buffer, buffer + 1, size - 1);
+      bufferLength--;
+    }
+    buffer[bufferLength++] = receive[i];
+  }
+  if (bufferLength == size && memcmp(buffer, CONNECTED, size) == 0) {
+    // Announce binary support, the host answers 'P' if it speaks it
+    const uint8_t announce[3] = { 'A', (uint8_t)('0' + PROTOCOL_SHOT_TIME), ';' };
+    halDelay(2000);
+    halDebug("Start sequence.");
+    halBleWrite(announce, sizeof(announce));
+    binaryMode = 0;
+    alivePeriod = ALIVE_DELAY;
+    aliveTime = aliveDelay();
+    phase = INIT_SEQUENCE;
+  }
+}
+
+static void runCommands(const char* receive, int length) {
+  // A host with a stored calibration sends "PX" at once
+  for (int i = 0; i < length; i++) {
+    char command = receive[i];
+    if (command == 'P') {
+      binaryMode = 1;
+      alivePeriod = BINARY_ALIVE_DELAY;
+      frameSeq = 0;
+    }
+    else if (command == 'Z') {
+      triggerInterrupt = 0;
+      halImuCalibrationStart();
+      phase = STAB_SEQUENCE;
+    }
+    else if (command == 'Y') {
+      phase = CALIBRATION_SEQUENCE;
+    }
+    else if (command == 'X') {
+      phase = GAME_SEQUENCE;
+    }
+  }
+}
+
+void coreLoop(void) {
+  float yaw = 0.0;
+  float pitch = 0.0;
+  float roll = 0.0;
+  char receive[RECEIVE_SIZE];
+  int length = 0;
+
+  while (length < RECEIVE_SIZE - 1 && halBleAvailable()) {
+    receive[length++] = (char)halBleRead();
+  }
+  receive[length] = '\0';
+
+  if (length > 0) {
+    char debug[RECEIVE_SIZE + 8] = "Debug ";
+    strcat(debug, receive);
+    strcat(debug, ".");
+    halDebug(debug);
+    if (phase == 0) {
+      waitConnection(receive, length);
+    }
+    else {
+      runCommands(receive, length);
+    }
+  }
+
+  if (phase > INIT_SEQUENCE) {
+    if (phase == STAB_SEQUENCE) {
+      halImuCalibrate();
+      if (triggerInterrupt == 1) {
+        static const uint8_t stable[2] = { 'B', ';' };
+        halImuCalibrationSave();
+        halBleWrite(stable, sizeof(stable));
+        halDebug("B;");
+        triggerInterrupt = TRIGGER_DELAY;
+        triggerTime = halMillis();
+        aliveTime = aliveDelay();
+      }
+    }
+    else {
+      // get the latest data if ready yet
+      halImuPose(&yaw, &pitch, &roll);
+
+      if (triggerInterrupt == 1) {
+        if (phase == CALIBRATION_SEQUENCE) {
+          sendFrame('C', halMillis(), yaw, pitch, roll);
+        }
+        else {
+          // The host looks up the aim at the edge in its recent 'E' frames
+          halNoInterrupts();
+          unsigned long edge = triggerEdge;
+          halInterrupts();
+          sendFrame('D', edge, yaw, pitch, roll);
+        }
+        triggerInterrupt = TRIGGER_DELAY;
+        triggerTime = halMillis();
+        aliveTime = aliveDelay();
+      }
+    }
+    unsigned long now = halMillis();
+    if ((aliveTime < now) && ((now - aliveTime) >= (unsigned long)alivePeriod)) {
+      sendFrame('E', now, yaw, pitch, roll);
+      aliveTime = now;
+    }
+    if ((triggerInterrupt == TRIGGER_DELAY) && ((now - triggerTime) >= (unsigned long)TRIGGER_DELAY)) {
+      triggerInterrupt = 0;
+    }
+  }
+}
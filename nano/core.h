@@ -0,0 +1,24 @@
+#ifndef CORE_H
+#define CORE_H
+
+// Firmware logic without the board : phases, commands of the host and
+// frames to it. Runs on the Nano from blue2.ino and on Linux with host/.
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+// After the board setup, the IMU is ready
+void coreSetup(void);
+void coreLoop(void);
+
+// Falling edge of the trigger, from the interrupt
+void coreTrigger(void);
+
+// 0 until connected, then INIT, STAB, CALIBRATION or GAME sequence
+int corePhase(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
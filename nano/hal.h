@@ -0,0 +1,40 @@
+#ifndef HAL_H
+#define HAL_H
+
+// What the firmware core needs from the board : blue2.ino implements it on
+// the Nano, host/hal_host.c on Linux for the benchmarks.
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+unsigned long halMillis(void);
+void halDelay(unsigned long ms);
+
+// BLE module serial, the JDY-16
+int halBleAvailable(void);
+int halBleRead(void);
+void halBleWrite(const uint8_t* data, size_t length);
+
+// USB serial, one line
+void halDebug(const char* text);
+
+// Fusion pose in degrees once the pending IMU samples are read
+void halImuPose(float* yaw, float* pitch, float* roll);
+
+// Compass calibration : start it, track one more sample, save it in EEPROM
+void halImuCalibrationStart(void);
+void halImuCalibrate(void);
+void halImuCalibrationSave(void);
+
+// Around the reads of what the trigger interrupt writes
+void halNoInterrupts(void);
+void halInterrupts(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,128 @@
+#include <math.h>
+#include <string.h>
+#include "hal.h"
+#include "hal_host.h"
+
+typedef struct ring {
+  uint8_t data[HAL_HOST_RING];
+  size_t head;
+  size_t tail;
+} ring_t;
+
+static uint64_t micros = 0;
+static ring_t toGun, toHost;
+static unsigned long bleBytes = 0;
+static unsigned long debugBytes = 0;
+static unsigned long imuReads = 0;
+static unsigned long calibrationSaves = 0;
+
+static size_t ringWrite(ring_t* ring, const uint8_t* data, size_t length) {
+  size_t i = 0;
+  for (i = 0; i < length && ring->head - ring->tail < HAL_HOST_RING; i++) {
+    ring->data[ring->head++ % HAL_HOST_RING] = data[i];
+  }
+  return i;
+}
+
+static size_t ringRead(ring_t* ring, uint8_t* data, size_t size) {
+  size_t i = 0;
+  for (i = 0; i < size && ring->tail != ring->head; i++) {
+    data[i] = ring->data[ring->tail++ % HAL_HOST_RING];
+  }
+  return i;
+}
+
+void halHostReset(void) {
+  micros = 0;
+  memset(&toGun, 0, sizeof(toGun));
+  memset(&toHost, 0, sizeof(toHost));
+  bleBytes = 0;
+  debugBytes = 0;
+  imuReads = 0;
+  calibrationSaves = 0;
+}
+
+void halHostAdvance(unsigned long us) {
+  micros += us;
+}
+
+uint64_t halHostMicros(void) {
+  return micros;
+}
+
+size_t halHostSend(const uint8_t* data, size_t length) {
+  return ringWrite(&toGun, data, length);
+}
+
+size_t halHostReceive(uint8_t* data, size_t size) {
+  return ringRead(&toHost, data, size);
+}
+
+unsigned long halHostBleBytes(void) {
+  return bleBytes;
+}
+
+unsigned long halHostDebugBytes(void) {
+  return debugBytes;
+}
+
+unsigned long halHostImuReads(void) {
+  return imuReads;
+}
+
+unsigned long halHostCalibrationSaves(void) {
+  return calibrationSaves;
+}
+
+unsigned long halMillis(void) {
+  return (unsigned long)(micros / 1000);
+}
+
+void halDelay(unsigned long ms) {
+  micros += ms * 1000ULL;
+}
+
+int halBleAvailable(void) {
+  return toGun.head != toGun.tail;
+}
+
+int halBleRead(void) {
+  uint8_t byte = 0;
+  return ringRead(&toGun, &byte, 1) == 1 ? byte : -1;
+}
+
+void halBleWrite(const uint8_t* data, size_t length) {
+  bleBytes += length;
+  ringWrite(&toHost, data, length);
+}
+
+void halDebug(const char* text) {
+  // println adds CR LF
+  debugBytes += strlen(text) + 2;
+}
+
+// Same sweep as the simulated gun of rpi/tools/gunsim.c
+void halImuPose(float* yaw, float* pitch, float* roll) {
+  const double t = micros / 1e6;
+  ++imuReads;
+  *yaw = (float)(18.0 * sin(t * 1.7));
+  *pitch = (float)(9.0 * cos(t * 1.1));
+  *roll = 0.5f;
+}
+
+void halImuCalibrationStart(void) {
+}
+
+void halImuCalibrate(void) {
+  ++imuReads;
+}
+
+void halImuCalibrationSave(void) {
+  ++calibrationSaves;
+}
+
+void halNoInterrupts(void) {
+}
+
+void halInterrupts(void) {
+}
@@ -0,0 +1,29 @@
+#ifndef HAL_HOST_H
+#define HAL_HOST_H
+
+// Board stand-in to run core.c on Linux : a virtual clock moved by the
+// caller, the BLE serial as two byte rings, a simulated IMU sweeping the
+// screen and counters in place of the EEPROM and the USB serial.
+#include <stddef.h>
+#include <stdint.h>
+
+// Bytes waiting in each direction of the BLE serial
+#define HAL_HOST_RING 4096
+
+void halHostReset(void);
+
+// Virtual time in us, delay() moves it too
+void halHostAdvance(unsigned long us);
+uint64_t halHostMicros(void);
+
+// Host to gun bytes, returns how many fitted
+size_t halHostSend(const uint8_t* data, size_t length);
+// Gun to host bytes, returns how many were copied
+size_t halHostReceive(uint8_t* data, size_t size);
+
+unsigned long halHostBleBytes(void);
+unsigned long halHostDebugBytes(void);
+unsigned long halHostImuReads(void);
+unsigned long halHostCalibrationSaves(void);
+
+#endif
@@ -0,0 +1,24 @@
+// Counts the allocations by interposing the glibc allocator
+#include <stddef.h>
+#include "alloc_count.h"
+
+extern void* __libc_malloc(size_t size);
+extern void* __libc_calloc(size_t count, size_t size);
+extern void* __libc_realloc(void* pointer, size_t size);
+
+unsigned long alloc_count = 0;
+
+void* malloc(size_t size) {
+	++alloc_count;
+	return __libc_malloc(size);
+}
+
+void* calloc(size_t count, size_t size) {
+	++alloc_count;
+	return __libc_calloc(count, size);
+}
+
+void* realloc(void* pointer, size_t size) {
+	++alloc_count;
+	return __libc_realloc(pointer, size);
+}
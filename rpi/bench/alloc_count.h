@@ -0,0 +1,8 @@
+#ifndef ALLOC_COUNT_H
+#define ALLOC_COUNT_H
+
+// malloc, calloc and realloc calls of the whole process since the start,
+// link bench/alloc_count.c to count them
+extern unsigned long alloc_count;
+
+#endif
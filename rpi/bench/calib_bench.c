@@ -0,0 +1,206 @@
+// Accuracy and cost of the calibration models.
+// Accuracy : a gun at a known position aims at a grid of screen points, the
+// angles are the exact (non linear) ones with a small roll and sensor noise,
+// the models are calibrated on the nine targets and the mapping error is
+// measured on the whole grid.
+// Cost : mappings per second on the aim frames of a recorded trace given as
+// argument, or on the synthetic samples.
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "calib.h"
+#include "framer.h"
+#include "trace.h"
+
+#define WIDTH 1920
+#define HEIGHT 1080
+#define MARGIN 30
+// Screen 1 m wide seen from 1.5 m, gun 20 cm right of and 30 cm below the center
+#define SCREEN_M 1.0
+#define DISTANCE_M 1.5
+#define GUN_X_M 0.2
+#define GUN_Y_M 0.3
+#define ROLL_DEG 6.0
+#define NOISE_DEG 0.05
+#define GRID 64
+#define MAX_SAMPLES 200000
+#define ROUNDS 20
+
+static const char* MODEL_NAMES[] = { "piecewise", "affine", "quadratic" };
+
+static double m_yaw[MAX_SAMPLES], m_pitch[MAX_SAMPLES], m_roll[MAX_SAMPLES];
+static int m_samples = 0;
+static double m_calib_yaw[CALIB_POINTS], m_calib_pitch[CALIB_POINTS], m_calib_roll[CALIB_POINTS];
+static int m_calib_points = 0;
+
+static double now_s(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static double noise(void) {
+	return NOISE_DEG * (2.0 * rand() / RAND_MAX - 1.0);
+}
+
+// Angles measured by a gun rolled by ROLL_DEG aiming at a screen pixel
+static void aim(double px, double py, double* yaw, double* pitch, double* roll) {
+	const double meter = SCREEN_M / WIDTH;
+	const double dx = (px - WIDTH / 2) * meter - GUN_X_M;
+	const double dy = (HEIGHT / 2 - py) * meter + GUN_Y_M;
+	const double y = atan2(dx, DISTANCE_M) * 180.0 / M_PI;
+	const double p = atan2(dy, sqrt(dx * dx + DISTANCE_M * DISTANCE_M)) * 180.0 / M_PI;
+	const double r = ROLL_DEG * M_PI / 180.0;
+	*yaw = y * cos(r) + p * sin(r) + noise();
+	*pitch = p * cos(r) - y * sin(r) + noise();
+	*roll = ROLL_DEG + noise();
+}
+
+static void targets(double target_x[CALIB_POINTS], double target_y[CALIB_POINTS]) {
+	const double xs[3] = { MARGIN, WIDTH / 2, WIDTH - MARGIN };
+	const double ys[3] = { MARGIN, HEIGHT / 2, HEIGHT - MARGIN };
+	// Left column top to bottom, middle bottom to top, right top to bottom
+	const int order[CALIB_POINTS][2] = { {0, 0}, {0, 1}, {0, 2}, {1, 2}, {1, 1}, {1, 0}, {2, 0}, {2, 1}, {2, 2} };
+	int i = 0;
+	for (i = 0; i < CALIB_POINTS; ++i) {
+		target_x[i] = xs[order[i][0]];
+		target_y[i] = ys[order[i][1]];
+	}
+}
+
+static void accuracy(int model) {
+	double target_x[CALIB_POINTS], target_y[CALIB_POINTS];
+	double yaw[CALIB_POINTS], pitch[CALIB_POINTS], roll[CALIB_POINTS];
+	double sum = 0.0, worst = 0.0;
+	calib_t calib;
+	int i = 0, j = 0;
+
+	srand(7);
+	targets(target_x, target_y);
+	for (i = 0; i < CALIB_POINTS; ++i) {
+		aim(target_x[i], target_y[i], &yaw[i], &pitch[i], &roll[i]);
+	}
+	if (!calib_solve(&calib, model, WIDTH, HEIGHT, yaw, pitch, roll, target_x, target_y)) {
+		printf("%-10s fit failed\n", MODEL_NAMES[model]);
+		return;
+	}
+	for (i = 0; i < GRID; ++i) {
+		for (j = 0; j < GRID; ++j) {
+			const double px = MARGIN + (WIDTH - 2 * MARGIN) * i / (GRID - 1.0);
+			const double py = MARGIN + (HEIGHT - 2 * MARGIN) * j / (GRID - 1.0);
+			double a = 0.0, b = 0.0, c = 0.0;
+			int x = 0, y = 0;
+			aim(px, py, &a, &b, &c);
+			calib_to_screen(&calib, a, b, c, &x, &y);
+			const double dx = (double)x * WIDTH / 65535 - px;
+			const double dy = (double)y * HEIGHT / 65535 - py;
+			const double error = sqrt(dx * dx + dy * dy);
+			sum += error * error;
+			if (error > worst) {
+				worst = error;
+			}
+		}
+	}
+	printf("%-10s calibration residual %6.1f px rms %6.1f px max, screen error %6.1f px rms %6.1f px max\n",
+		MODEL_NAMES[model], calib.residual, calib.residual_max, sqrt(sum / (GRID * GRID)), worst);
+}
+
+static void collect(const message_t* msg, void* user_data) {
+	if (msg->type == 'C' && m_calib_points < CALIB_POINTS) {
+		m_calib_yaw[m_calib_points] = msg->yaw / 100.0;
+		m_calib_pitch[m_calib_points] = msg->pitch / 100.0;
+		m_calib_roll[m_calib_points] = msg->roll / 100.0;
+		++m_calib_points;
+	}
+	else if ((msg->type == 'D' || msg->type == 'E') && m_samples < MAX_SAMPLES) {
+		m_yaw[m_samples] = msg->yaw / 100.0;
+		m_pitch[m_samples] = msg->pitch / 100.0;
+		m_roll[m_samples] = msg->roll / 100.0;
+		++m_samples;
+	}
+}
+
+static int load_trace(const char* path) {
+	trace_t trace;
+	framer_t framer;
+	uint8_t data[TRACE_MAX_RECORD];
+	uint64_t time_us = 0;
+	int length = 0;
+	if (!trace_open_read(&trace, path)) {
+		fprintf(stderr, "Fail to open trace %s\n", path);
+		return 0;
+	}
+	framer_init(&framer);
+	while ((length = trace_read(&trace, &time_us, data)) >= 0) {
+		framer_feed(&framer, data, length, collect, NULL);
+	}
+	trace_close(&trace);
+	return m_samples > 0 && m_calib_points == CALIB_POINTS;
+}
+
+static void synthetic(void) {
+	double target_x[CALIB_POINTS], target_y[CALIB_POINTS];
+	int i = 0;
+	srand(11);
+	targets(target_x, target_y);
+	for (i = 0; i < CALIB_POINTS; ++i) {
+		aim(target_x[i], target_y[i], &m_calib_yaw[i], &m_calib_pitch[i], &m_calib_roll[i]);
+	}
+	m_calib_points = CALIB_POINTS;
+	for (m_samples = 0; m_samples < MAX_SAMPLES; ++m_samples) {
+		aim(rand() % WIDTH, rand() % HEIGHT, &m_yaw[m_samples], &m_pitch[m_samples], &m_roll[m_samples]);
+	}
+}
+
+static void cost(int model) {
+	double target_x[CALIB_POINTS], target_y[CALIB_POINTS];
+	calib_t calib;
+	long checksum = 0;
+	int i = 0, round = 0;
+
+	targets(target_x, target_y);
+	if (!calib_solve(&calib, model, WIDTH, HEIGHT, m_calib_yaw, m_calib_pitch, m_calib_roll, target_x, target_y)) {
+		printf("%-10s fit failed\n", MODEL_NAMES[model]);
+		return;
+	}
+	const double start = now_s();
+	for (round = 0; round < ROUNDS; ++round) {
+		for (i = 0; i < m_samples; ++i) {
+			int x = 0, y = 0;
+			if (model == CALIB_PIECEWISE) {
+				calib_piecewise_map(&calib, m_yaw[i], m_pitch[i], m_roll[i], &x, &y);
+			}
+			else {
+				calib_map(&calib, m_yaw[i], m_pitch[i], m_roll[i], &x, &y);
+			}
+			checksum += x + y;
+		}
+	}
+	const double elapsed = now_s() - start;
+	printf("%-10s %6.2f ns/sample (checksum %ld)\n", MODEL_NAMES[model], elapsed * 1e9 / ((double)ROUNDS * m_samples), checksum);
+}
+
+int main(int argc, char** argv) {
+	int model = 0;
+	printf("Accuracy, %dx%d screen, gun rolled by %.0f deg, noise %.2f deg\n", WIDTH, HEIGHT, ROLL_DEG, NOISE_DEG);
+	for (model = CALIB_PIECEWISE; model <= CALIB_QUADRATIC; ++model) {
+		accuracy(model);
+	}
+
+	if (argc > 1 && load_trace(argv[1])) {
+		printf("Cost, %d aim samples of %s\n", m_samples, argv[1]);
+	}
+	else {
+		if (argc > 1) {
+			fprintf(stderr, "No calibration and aim frames in %s, synthetic samples\n", argv[1]);
+		}
+		synthetic();
+		printf("Cost, %d synthetic samples\n", m_samples);
+	}
+	for (model = CALIB_PIECEWISE; model <= CALIB_QUADRATIC; ++model) {
+		cost(model);
+	}
+	return 0;
+}
@@ -0,0 +1,164 @@
+// Jitter against lag of the aim filters on synthetic 50 Hz guns.
+// The samples reach the host SYNTHETIC_LATENCY_MS after they were taken, plus up to
+// one BLE connection interval, with sensor noise and hand tremor. The
+// output is compared with where the gun points at emit time :
+//   jitter_px      spread of the cursor while the gun is held still
+//   lag_ms         delay of the cursor behind a sweep
+//   sweep_px       error during the sweep
+//   flick_px       error during fast target changes, overshoot_px beyond the target
+// One JSON object per line on stdout.
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+#include "filter.h"
+#include "stats.h"
+#include "alloc_count.h"
+#include "synthetic.h"
+
+#define FRAME_MS 20
+#define SAMPLES 3000
+#define NOISE_DEG 0.05
+#define TREMOR_DEG 0.1
+#define MAX_LAG_MS 150
+
+enum { STILL = SYNTHETIC_STILL, SWEEP = SYNTHETIC_SWEEP, FLICK = SYNTHETIC_FLICK };
+
+typedef struct config {
+	int type;
+	double predict_ms;
+} config_t;
+
+static const char* FILTER_NAMES[] = { "none", "euro", "kalman" };
+static const config_t CONFIGS[] = {
+	{ FILTER_NONE, 0 },
+	{ FILTER_ONE_EURO, 0 },
+	{ FILTER_ONE_EURO, SYNTHETIC_LATENCY_MS },
+	{ FILTER_KALMAN, 0 },
+	{ FILTER_KALMAN, SYNTHETIC_LATENCY_MS },
+};
+
+static uint64_t m_received_ns[SAMPLES];
+static double m_yaw[SAMPLES], m_pitch[SAMPLES];
+static double m_out_yaw[SAMPLES], m_out_pitch[SAMPLES];
+static unsigned long m_allocations = 0;
+
+static void generate(int scenario) {
+	int i = 0;
+	synthetic_seed(7 + scenario);
+	for (i = 0; i < SAMPLES; ++i) {
+		const double t = i * FRAME_MS / 1000.0;
+		double yaw = 0.0, pitch = 0.0;
+		synthetic_truth(scenario, t, &yaw, &pitch);
+		m_yaw[i] = yaw + NOISE_DEG * 2.0 * synthetic_noise() + TREMOR_DEG * sin(t * 2.0 * M_PI * 9.0);
+		m_pitch[i] = pitch + NOISE_DEG * 2.0 * synthetic_noise() + TREMOR_DEG * cos(t * 2.0 * M_PI * 11.0);
+		m_received_ns[i] = synthetic_received_ns(t);
+	}
+}
+
+static double run(const config_t* config) {
+	filter_t filter;
+	int i = 0;
+	filter_init(&filter, config->type);
+	filter.predict_s = config->predict_ms / 1000.0;
+	const unsigned long allocated = alloc_count;
+	const uint64_t start = stats_now_ns();
+	for (i = 0; i < SAMPLES; ++i) {
+		filter_update(&filter, m_received_ns[i], m_yaw[i], m_pitch[i], &m_out_yaw[i], &m_out_pitch[i]);
+	}
+	const uint64_t elapsed = stats_now_ns() - start;
+	m_allocations += alloc_count - allocated;
+	return (double)elapsed / SAMPLES;
+}
+
+// RMS distance in px between the output and the gun shift_ms earlier
+static double error_px(int scenario, double shift_ms) {
+	double sum = 0.0;
+	int i = 0;
+	for (i = 0; i < SAMPLES; ++i) {
+		double yaw = 0.0, pitch = 0.0;
+		synthetic_truth(scenario, m_received_ns[i] / 1e9 - shift_ms / 1000.0, &yaw, &pitch);
+		const double dx = (m_out_yaw[i] - yaw) * SYNTHETIC_PX_PER_DEG, dy = (m_out_pitch[i] - pitch) * SYNTHETIC_PX_PER_DEG;
+		sum += dx * dx + dy * dy;
+	}
+	return sqrt(sum / SAMPLES);
+}
+
+static double jitter_px(void) {
+	double mean_yaw = 0.0, mean_pitch = 0.0, sum = 0.0;
+	int i = 0;
+	for (i = 0; i < SAMPLES; ++i) {
+		mean_yaw += m_out_yaw[i] / SAMPLES;
+		mean_pitch += m_out_pitch[i] / SAMPLES;
+	}
+	for (i = 0; i < SAMPLES; ++i) {
+		const double dx = (m_out_yaw[i] - mean_yaw) * SYNTHETIC_PX_PER_DEG, dy = (m_out_pitch[i] - mean_pitch) * SYNTHETIC_PX_PER_DEG;
+		sum += dx * dx + dy * dy;
+	}
+	return sqrt(sum / SAMPLES);
+}
+
+// Shift of the sweep giving the smallest error
+static double lag_ms(void) {
+	double best = 0.0, best_error = 1e30, shift = 0.0;
+	for (shift = -MAX_LAG_MS; shift <= MAX_LAG_MS; shift += 1.0) {
+		const double error = error_px(SWEEP, shift);
+		if (error < best_error) {
+			best_error = error;
+			best = shift;
+		}
+	}
+	return best;
+}
+
+// Largest excursion beyond the target once the move is over
+static double overshoot_px(void) {
+	double worst = 0.0;
+	int i = 0;
+	for (i = 0; i < SAMPLES; ++i) {
+		const double t = m_received_ns[i] / 1e9;
+		const int target = (int)(t / SYNTHETIC_FLICK_S);
+		if (t - target * SYNTHETIC_FLICK_S < SYNTHETIC_FLICK_MOVE_S || target == 0) {
+			continue;
+		}
+		double from_yaw = 0.0, from_pitch = 0.0, to_yaw = 0.0, to_pitch = 0.0;
+		synthetic_truth(FLICK, target * SYNTHETIC_FLICK_S - 0.01, &from_yaw, &from_pitch);
+		synthetic_truth(FLICK, t, &to_yaw, &to_pitch);
+		const double move_yaw = to_yaw - from_yaw, move_pitch = to_pitch - from_pitch;
+		const double length = sqrt(move_yaw * move_yaw + move_pitch * move_pitch);
+		if (length < 1.0) {
+			continue;
+		}
+		// Distance past the target along the move
+		const double beyond = ((m_out_yaw[i] - to_yaw) * move_yaw + (m_out_pitch[i] - to_pitch) * move_pitch) / length;
+		if (beyond * SYNTHETIC_PX_PER_DEG > worst) {
+			worst = beyond * SYNTHETIC_PX_PER_DEG;
+		}
+	}
+	return worst;
+}
+
+int main(int argc, char** argv) {
+	const int configs = sizeof(CONFIGS) / sizeof(CONFIGS[0]);
+	int i = 0;
+	for (i = 0; i < configs; ++i) {
+		const config_t* config = &CONFIGS[i];
+		double cost = 0.0;
+		m_allocations = 0;
+		generate(STILL);
+		cost += run(config);
+		const double jitter = jitter_px();
+		generate(SWEEP);
+		cost += run(config);
+		const double lag = lag_ms();
+		const double sweep = error_px(SWEEP, 0.0);
+		generate(FLICK);
+		cost += run(config);
+		const double flick = error_px(FLICK, 0.0);
+		const double overshoot = overshoot_px();
+		printf("{\"bench\":\"filter\",\"filter\":\"%s\",\"predict_ms\":%.0f,\"jitter_px\":%.2f,\"lag_ms\":%.0f,"
+			"\"sweep_px\":%.1f,\"flick_px\":%.1f,\"overshoot_px\":%.1f,\"ns_per_sample\":%.1f,\"allocations\":%lu}\n",
+			FILTER_NAMES[config->type], config->predict_ms, jitter, lag, sweep, flick, overshoot, cost / 3.0,
+			m_allocations);
+	}
+	return 0;
+}
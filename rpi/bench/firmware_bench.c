@@ -0,0 +1,206 @@
+// Firmware core of nano/core.c on the host HAL, back to back with the
+// daemon framer and session : the session answers the hello, sends Z Y X
+// and the trigger fires every TRIGGER_MS of virtual time. Checks that the
+// game is reached, that every byte decodes, that each trigger in game gives
+// one shot and, in binary, that the aim frames carry the simulated pose.
+//   ns_per_loop        cost of one firmware loop, p50 and p99
+//   ble_bytes_per_s    BLE serial load in game, against the 960 B/s of 9600 baud
+//   debug_bytes_per_s  USB serial load in game, also 9600 baud
+//   allocations        heap calls of the firmware, framer and session
+// One JSON object per line on stdout, exit status 1 when a check failed.
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include "core.h"
+#include "hal_host.h"
+#include "framer.h"
+#include "session.h"
+#include "stats.h"
+#include "alloc_count.h"
+
+#define VIRTUAL_S 120
+// Firmware loop period, the Nano spends it in the IMU read and the serial
+#define LOOP_US 250
+#define TRIGGER_MS 500
+#define INIT_MS 3000
+#define BAUD_BYTES_PER_S 960.0
+// 18 deg * 1.7 rad/s over the 1 ms of the time stamp, plus the rounding
+#define POSE_TOLERANCE 0.05
+
+enum { ASCII, BINARY, SCENARIOS };
+static const char* SCENARIO_NAMES[SCENARIOS] = { "ascii", "binary" };
+
+typedef struct host {
+	int binary;
+	session_t session;
+	int points;
+	unsigned long frames[5];
+	unsigned long shots;
+	unsigned long mismatches;
+	int64_t last_ms;
+	unsigned long violations;
+} host_t;
+
+static void command(char value) {
+	const uint8_t byte = value;
+	halHostSend(&byte, 1);
+}
+
+static void hello(session_t* session, const message_t* msg) {
+	host_t* host = session->user_data;
+	if (host->binary && msg->seq >= PROTOCOL_BINARY) {
+		command(PROTOCOL_BINARY_ACK);
+	}
+}
+
+static void init_enter(session_t* session, const message_t* msg) {
+	session_timer(session, halHostMicros() * 1000 + INIT_MS * 1000000ULL);
+}
+
+static void stab_enter(session_t* session, const message_t* msg) {
+	command('Z');
+}
+
+static void calibration_enter(session_t* session, const message_t* msg) {
+	host_t* host = session->user_data;
+	host->points = 0;
+	command('Y');
+}
+
+static void point(session_t* session, const message_t* msg) {
+	host_t* host = session->user_data;
+	if (++host->points == 9) {
+		session_post(session, EVENT_CALIBRATED);
+	}
+}
+
+static void game_enter(session_t* session, const message_t* msg) {
+	command('X');
+}
+
+static void shot(session_t* session, const message_t* msg) {
+	host_t* host = session->user_data;
+	++host->shots;
+}
+
+// The binary aim frames are stamped, the pose must be the simulated one
+static void aim(session_t* session, const message_t* msg) {
+	host_t* host = session->user_data;
+	if (!host->binary) {
+		return;
+	}
+	host->last_ms += (int16_t)(msg->time - (uint16_t)host->last_ms);
+	const double t = host->last_ms / 1000.0;
+	if (fabs(msg->yaw / 100.0 - 18.0 * sin(t * 1.7)) > POSE_TOLERANCE || fabs(msg->pitch / 100.0 - 9.0 * cos(t * 1.1)) > POSE_TOLERANCE) {
+		++host->mismatches;
+	}
+}
+
+static const session_action_t ACTIONS[ACTION_COUNT] = {
+	[ACTION_HELLO] = hello,
+	[ACTION_POINT] = point,
+	[ACTION_SHOT] = shot,
+	[ACTION_AIM] = aim,
+	[ACTION_ENTER_INIT] = init_enter,
+	[ACTION_ENTER_STAB] = stab_enter,
+	[ACTION_ENTER_CALIBRATION] = calibration_enter,
+	[ACTION_ENTER_GAME] = game_enter,
+};
+
+static void frame_cb(const message_t* msg, void* user_data) {
+	host_t* host = user_data;
+	if (msg->type >= 'A' && msg->type <= 'E') {
+		++host->frames[msg->type - 'A'];
+	}
+	session_frame(&host->session, msg, host->binary);
+}
+
+// Everything the firmware sent, through the daemon framer
+static void drain(framer_t* framer, host_t* host) {
+	uint8_t data[256];
+	size_t length = 0;
+	while ((length = halHostReceive(data, sizeof(data))) > 0) {
+		framer_feed(framer, data, length, frame_cb, host);
+	}
+	session_poll(&host->session, halHostMicros() * 1000);
+}
+
+static void check(host_t* host, int ok, const char* what) {
+	if (!ok) {
+		++host->violations;
+		fprintf(stderr, "violation : %s\n", what);
+	}
+}
+
+static uint64_t now_ns(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000U + ts.tv_nsec;
+}
+
+int main(int argc, char** argv) {
+	unsigned long violations = 0;
+	int scenario = 0;
+	for (scenario = 0; scenario < SCENARIOS; ++scenario) {
+		static const char CONNECTED[] = "+CONNECTED\r\n";
+		host_t host;
+		framer_t framer;
+		histogram_t cost;
+		unsigned long loops = 0, triggers = 0, game_ble = 0, game_debug = 0;
+		uint64_t game_us = 0, next_trigger = TRIGGER_MS * 1000ULL;
+		memset(&host, 0, sizeof(host));
+		host.binary = scenario == BINARY;
+		histogram_reset(&cost);
+		framer_init(&framer);
+		session_init(&host.session, ACTIONS, &host);
+		halHostReset();
+		coreSetup();
+		halHostSend((const uint8_t*)CONNECTED, sizeof(CONNECTED) - 1);
+
+		const unsigned long allocated = alloc_count;
+		const uint64_t start = now_ns();
+		while (halHostMicros() < VIRTUAL_S * 1000000ULL) {
+			halHostAdvance(LOOP_US);
+			if (halHostMicros() >= next_trigger) {
+				// Trigger edges land between two loops, as the interrupt
+				triggers += corePhase() == GAME_SEQUENCE;
+				coreTrigger();
+				next_trigger += TRIGGER_MS * 1000ULL;
+			}
+			const uint64_t before = now_ns();
+			coreLoop();
+			histogram_record(&cost, now_ns() - before);
+			++loops;
+			if (game_us == 0 && corePhase() == GAME_SEQUENCE) {
+				game_us = halHostMicros();
+				game_ble = halHostBleBytes();
+				game_debug = halHostDebugBytes();
+			}
+			drain(&framer, &host);
+		}
+		const uint64_t elapsed = now_ns() - start;
+		const unsigned long allocations = alloc_count - allocated;
+		const double game_s = game_us > 0 ? (halHostMicros() - game_us) / 1e6 : 0.0;
+
+		check(&host, host.session.state == GAME_SEQUENCE && corePhase() == GAME_SEQUENCE, "game not reached");
+		check(&host, framer.errors == 0 && framer.skipped == 0, "bytes the daemon could not decode");
+		check(&host, host.shots == triggers, "triggers in game without their shot");
+		check(&host, host.mismatches == 0, "aim frames with another pose");
+		check(&host, host.session.duplicates == 0, "duplicated sequence numbers");
+		violations += host.violations;
+		printf("{\"bench\":\"firmware\",\"scenario\":\"%s\",\"virtual_s\":%d,\"loops\":%lu,\"loops_per_s\":%.0f,"
+			"\"ns_per_loop_p50\":%llu,\"ns_per_loop_p99\":%llu,\"imu_reads\":%lu,\"ble_bytes_per_s\":%.0f,\"ble_budget_pct\":%.1f,"
+			"\"debug_bytes_per_s\":%.0f,\"frames\":{\"A\":%lu,\"B\":%lu,\"C\":%lu,\"D\":%lu,\"E\":%lu},\"triggers\":%lu,\"shots\":%lu,"
+			"\"framer_errors\":%lu,\"pose_mismatches\":%lu,\"calibration_saves\":%lu,\"state\":\"%s\",\"allocations\":%lu,\"violations\":%lu}\n",
+			SCENARIO_NAMES[scenario], VIRTUAL_S, loops, loops * 1e9 / elapsed,
+			(unsigned long long)histogram_percentile(&cost, 50.0), (unsigned long long)histogram_percentile(&cost, 99.0),
+			halHostImuReads(), game_s > 0 ? (halHostBleBytes() - game_ble) / game_s : 0.0,
+			game_s > 0 ? 100.0 * (halHostBleBytes() - game_ble) / game_s / BAUD_BYTES_PER_S : 0.0,
+			game_s > 0 ? (halHostDebugBytes() - game_debug) / game_s : 0.0,
+			host.frames[0], host.frames[1], host.frames[2], host.frames[3], host.frames[4], triggers, host.shots,
+			framer.errors, host.mismatches, halHostCalibrationSaves(), session_state_name(host.session.state),
+			allocations, host.violations);
+	}
+	return violations > 0;
+}
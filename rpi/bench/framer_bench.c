@@ -0,0 +1,116 @@
+// Frames per second of the notification parsing paths :
+// the previous one-frame-per-notification buffer with sscanf,
+// the incremental framer on ASCII frames and on binary frames.
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "framer.h"
+
+#define FRAMES 200000
+#define NOTIFICATION_SIZE 20U
+
+static uint8_t* m_stream = NULL;
+static size_t m_stream_length = 0;
+static size_t* m_frame_ends = NULL;
+static long m_checksum = 0;
+
+static double now_s(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void generate(int binary) {
+	size_t i = 0;
+	m_stream_length = 0;
+	srand(42);
+	for (i = 0; i < FRAMES; ++i) {
+		message_t msg;
+		memset(&msg, 0, sizeof(msg));
+		msg.type = (i % 10) ? 'E' : 'D';
+		msg.seq = (uint8_t)i;
+		msg.time = (uint16_t)(i * 20);
+		msg.yaw = (int16_t)(rand() % 36000 - 18000);
+		msg.pitch = (int16_t)(rand() % 18000 - 9000);
+		msg.roll = (int16_t)(rand() % 36000 - 18000);
+		if (binary) {
+			frame_encode(&msg, m_stream + m_stream_length);
+			m_stream_length += FRAME_SIZE;
+		}
+		else {
+			m_stream_length += sprintf((char*)m_stream + m_stream_length, "%c %.2f %.2f %.2f;",
+				msg.type, msg.yaw / 100.0, msg.pitch / 100.0, msg.roll / 100.0);
+		}
+		m_frame_ends[i] = m_stream_length;
+	}
+}
+
+static void count_frame(const message_t* msg, void* user_data) {
+	m_checksum += msg->yaw + msg->pitch + msg->roll;
+}
+
+// Previous ble_notification_cb and game_sequence parsing
+static void legacy_notification(const uint8_t* data, size_t data_length) {
+	static char buffer[30] = {0, 0, 0};
+	static char buf_length = 0;
+	if (buf_length + data_length < 30) {
+		memcpy(buffer + buf_length, data, data_length);
+		buf_length += data_length;
+		if ((buf_length > 0) && (buffer[buf_length - 1] == ';')) {
+			double yaw = 0.0, pitch = 0.0, roll = 0.0;
+			sscanf(buffer + 1, "%lf %lf %lf", &yaw, &pitch, &roll);
+			m_checksum += (long)(yaw * 100.0 + (yaw < 0 ? -0.5 : 0.5)) + (long)(pitch * 100.0 + (pitch < 0 ? -0.5 : 0.5)) + (long)(roll * 100.0 + (roll < 0 ? -0.5 : 0.5));
+			memset(buffer, 0, 30);
+			buf_length = 0;
+		}
+	}
+	else {
+		buf_length = 0;
+	}
+}
+
+static void report(const char* name, double elapsed, long checksum) {
+	printf("%-16s %10.0f frames/s %8.1f ns/frame checksum %ld\n", name, FRAMES / elapsed, elapsed * 1e9 / FRAMES, checksum);
+}
+
+int main(void) {
+	m_stream = malloc(FRAMES * FRAMER_SIZE);
+	m_frame_ends = malloc(FRAMES * sizeof(size_t));
+	size_t i = 0;
+
+	// The old path only handles one frame per notification
+	generate(0);
+	m_checksum = 0;
+	double start = now_s();
+	size_t begin = 0;
+	for (i = 0; i < FRAMES; ++i) {
+		legacy_notification(m_stream + begin, m_frame_ends[i] - begin);
+		begin = m_frame_ends[i];
+	}
+	report("sscanf", now_s() - start, m_checksum);
+
+	framer_t framer;
+	framer_init(&framer);
+	m_checksum = 0;
+	start = now_s();
+	for (i = 0; i < m_stream_length; i += NOTIFICATION_SIZE) {
+		size_t length = m_stream_length - i < NOTIFICATION_SIZE ? m_stream_length - i : NOTIFICATION_SIZE;
+		framer_feed(&framer, m_stream + i, length, count_frame, NULL);
+	}
+	report("framer ascii", now_s() - start, m_checksum);
+
+	generate(1);
+	framer_init(&framer);
+	m_checksum = 0;
+	start = now_s();
+	for (i = 0; i < m_stream_length; i += NOTIFICATION_SIZE) {
+		size_t length = m_stream_length - i < NOTIFICATION_SIZE ? m_stream_length - i : NOTIFICATION_SIZE;
+		framer_feed(&framer, m_stream + i, length, count_frame, NULL);
+	}
+	report("framer binary", now_s() - start, m_checksum);
+
+	free(m_frame_ends);
+	free(m_stream);
+	return 0;
+}
@@ -0,0 +1,59 @@
+#!/bin/sh
+# Latency of the daemon serving 1 to 4 guns : one trace is replayed into
+# each gun count and the total latency (notification to uinput report) of
+# every gun is read from the statistics dumped at the end of the replay.
+#   sh bench/guns_bench.sh build/blue build/gunsim [trace]
+# Without a trace, RECORD_S seconds of gunsim in binary are recorded first.
+# SPEED is the replay multiplier (default 20, 0 for as fast as possible),
+# ROUTER the -m mode (default thread).
+# One JSON object per gun and gun count on stdout.
+BLUE=${1:-build/blue}
+GUNSIM=${2:-build/gunsim}
+TRACE=$3
+SPEED=${SPEED:-20}
+ROUTER=${ROUTER:-thread}
+RECORD_S=${RECORD_S:-20}
+
+WORK=$(mktemp -d /tmp/guns_bench.XXXXXX) || exit 1
+trap 'rm -rf "$WORK"' EXIT
+
+if [ -z "$TRACE" ]; then
+	TRACE=$WORK/gun.trace
+	"$GUNSIM" -u "$WORK/gun.sock" >/dev/null 2>&1 &
+	SIM=$!
+	sleep 0.5
+	"$BLUE" -H -C none -T none -S "$WORK/record.txt" -a "unix:$WORK/gun.sock" -r "$TRACE" >/dev/null 2>&1 &
+	DAEMON=$!
+	sleep "$RECORD_S"
+	kill -INT $DAEMON
+	wait $DAEMON
+	kill $SIM 2>/dev/null
+	wait $SIM 2>/dev/null
+fi
+if [ ! -s "$TRACE" ]; then
+	echo "No trace to replay" >&2
+	exit 1
+fi
+
+STATUS=0
+for GUNS in 1 2 3 4; do
+	if ! "$BLUE" -p "$TRACE" -s "$SPEED" -n $GUNS -m "$ROUTER" -T none -S "$WORK/stats.txt" > "$WORK/replay.txt" 2>/dev/null; then
+		echo "Replay into $GUNS guns failed" >&2
+		STATUS=1
+		continue
+	fi
+	# Sections start with "# gun <n> replay", the stage lines are
+	# name count p50_us p99_us p999_us max_us
+	awk -v guns=$GUNS -v speed="$SPEED" -v router="$ROUTER" '
+		$1 == "#" && $2 == "gun" { gun = $3 }
+		$1 == "queue" && NF == 6 { queue_p50 = $3; queue_p99 = $4 }
+		$1 == "total" && NF == 6 {
+			printf "{\"bench\":\"guns\",\"router\":\"%s\",\"speed\":%s,\"guns\":%d,\"gun\":%d,\"reports\":%d,", router, speed, guns, gun, $2
+			printf "\"queue_p50_us\":%s,\"queue_p99_us\":%s,\"total_p50_us\":%s,\"total_p99_us\":%s}\n", queue_p50, queue_p99, $3, $4
+			if ($2 == 0) {
+				failed = 1
+			}
+		}
+		END { exit failed }' "$WORK/replay.txt" || STATUS=1
+done
+exit $STATUS
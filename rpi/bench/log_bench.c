@@ -0,0 +1,78 @@
+// Cost of one log call on the caller side : the previous fprintf + fflush
+// against the asynchronous log, paced like the command traces and in a
+// burst overflowing the ring. Give a file on the SD card as argument.
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include "log.h"
+
+#define CALLS 20000
+
+static uint64_t m_samples[CALLS];
+
+static uint64_t now_ns(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000U + ts.tv_nsec;
+}
+
+static int compare(const void* a, const void* b) {
+	const uint64_t x = *(const uint64_t*)a, y = *(const uint64_t*)b;
+	return x < y ? -1 : x > y;
+}
+
+static void report(const char* name, int count) {
+	qsort(m_samples, count, sizeof(m_samples[0]), compare);
+	printf("%-10s p50 %8.2f us p99 %8.2f us max %8.2f us\n", name,
+		m_samples[count / 2] / 1e3, m_samples[count * 99 / 100] / 1e3, m_samples[count - 1] / 1e3);
+}
+
+// One call every period_us, like the B/C/D commands of a gun
+static void paced(int async, FILE* file, int period_us) {
+	const struct timespec period = { 0, period_us * 1000L };
+	int i = 0;
+	for (i = 0; i < CALLS / 10; ++i) {
+		const uint64_t start = now_ns();
+		if (async) {
+			LOG(LOG_INFO, "Gun %d command %c %d %d %d\n", 0, 'D', i, -i, 50);
+		}
+		else {
+			fprintf(file, "Gun %d command %c %d %d %d\n", 0, 'D', i, -i, 50);
+			fflush(file);
+		}
+		m_samples[i] = now_ns() - start;
+		nanosleep(&period, NULL);
+	}
+	report(async ? "async" : "fflush", CALLS / 10);
+}
+
+int main(int argc, char** argv) {
+	const char* path = argc > 1 ? argv[1] : "/tmp/log_bench.txt";
+	int i = 0;
+	FILE* file = fopen(path, "w");
+	if (file == NULL) {
+		perror(path);
+		return 1;
+	}
+	paced(0, file, 1000);
+	fclose(file);
+
+	log_open(path);
+	paced(1, NULL, 1000);
+	// Faster than the writer : the ring fills and the surplus is dropped
+	for (i = 0; i < CALLS; ++i) {
+		const uint64_t start = now_ns();
+		LOG(LOG_INFO, "Burst %d\n", i);
+		m_samples[i] = now_ns() - start;
+	}
+	report("burst", CALLS);
+	// Compiled out
+	const uint64_t start = now_ns();
+	for (i = 0; i < CALLS; ++i) {
+		LOG(LOG_DEBUG, "Debug %d\n", i);
+	}
+	printf("debug      %.3f ns per call\n", (double)(now_ns() - start) / CALLS);
+	printf("dropped %lu of %d burst messages, ring of %d\n", log_dropped(), CALLS, LOG_SLOTS);
+	log_close();
+	return 0;
+}
@@ -0,0 +1,367 @@
+// Input pipeline on synthetic guns, deterministic from run to run :
+// notifications -> framer -> queue -> calib_to_screen -> report into
+// /dev/null. Each scenario is run on the binary and on the ASCII wire
+// format, each stage alone then the whole pipeline. The total stage routes
+// the frames through the session table, the aim filter and the shot
+// reconciliation in game as the daemon does, but neither publishes the
+// telemetry nor moves the cursor at a fixed output rate.
+// One JSON object per line on stdout, compare two commits with
+//   make -s bench > before.jsonl ... make -s bench > after.jsonl
+// The last line checks that a release uinput could not take is resent,
+// exit status 1 when it is not.
+#define _GNU_SOURCE
+#include <fcntl.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "calib.h"
+#include "filter.h"
+#include "framer.h"
+#include "queue.h"
+#include "report.h"
+#include "session.h"
+#include "shot.h"
+#include "stats.h"
+#include "alloc_count.h"
+
+#define WIDTH 1920
+#define HEIGHT 1080
+#define MARGIN 30
+// 50 Hz aim frames as the binary firmware, 20 s per scenario
+#define FRAME_MS 20
+#define FRAMES 1000
+// BLE notification payload of the JDY-16
+#define NOTIFICATION_SIZE 20U
+#define ROUNDS 50
+#define HOLD_MS 20
+
+enum { SWEEP, FLICK, JITTER, RAPID_FIRE, SCENARIOS };
+static const char* SCENARIO_NAMES[SCENARIOS] = { "sweep", "flick", "jitter", "rapid_fire" };
+
+static message_t m_messages[FRAMES];
+static uint8_t m_stream[FRAMES * FRAMER_SIZE];
+static size_t m_stream_length = 0;
+static message_t m_decoded[FRAMES];
+static size_t m_decoded_count = 0;
+static calib_t m_calib;
+static queue_t m_queue;
+static report_t m_report;
+static long m_checksum = 0;
+// Router side of the gun in game, as the gun_t of the daemon
+static session_t m_session;
+static filter_t m_filter;
+static shot_t m_shot;
+static stats_t m_stats;
+static int m_binary = 0;
+static uint64_t m_received_ns = 0;
+static uint64_t m_dequeued_ns = 0;
+static uint16_t m_release_time = 0;
+static int m_held = 0;
+
+// Same noise on every run and machine
+static uint32_t m_seed = 1;
+
+static double noise(void) {
+	m_seed = m_seed * 1664525U + 1013904223U;
+	return (m_seed >> 8) / (double)(1U << 24) - 0.5;
+}
+
+// Aim of the gun at frame i, in degrees, and whether the trigger is pulled
+static int trajectory(int scenario, int i, double* yaw, double* pitch) {
+	const double t = i * FRAME_MS / 1000.0;
+	switch (scenario) {
+	case SWEEP:
+		// Slow side to side scan of the whole screen
+		*yaw = 20.0 * sin(t * 0.9);
+		*pitch = 10.0 * sin(t * 0.4);
+		return i % 25 == 0;
+	case FLICK: {
+		// Jump to a new target within 100 ms every 600 ms, shoot on arrival
+		const int target = i / 30, step = i % 30;
+		const double progress = step < 5 ? step / 5.0 : 1.0;
+		const double from_yaw = 18.0 * sin(target * 2.3), to_yaw = 18.0 * sin((target + 1) * 2.3);
+		const double from_pitch = 9.0 * cos(target * 1.7), to_pitch = 9.0 * cos((target + 1) * 1.7);
+		*yaw = from_yaw + (to_yaw - from_yaw) * progress;
+		*pitch = from_pitch + (to_pitch - from_pitch) * progress;
+		return step == 6;
+	}
+	case JITTER:
+		// Holding still on a target, hand tremor and sensor noise
+		*yaw = 5.0 + 0.3 * noise() + 0.2 * sin(t * 60.0);
+		*pitch = -3.0 + 0.3 * noise() + 0.2 * cos(t * 55.0);
+		return i % 50 == 0;
+	default:
+		// Bursts of shots as fast as the trigger debounce allows, the
+		// TRIGGER_DELAY of the firmware is 200 ms
+		*yaw = 10.0 * sin(t * 2.0) + 0.1 * noise();
+		*pitch = 5.0 * cos(t * 1.5) + 0.1 * noise();
+		return i % 100 < 40 && i % 10 == 0;
+	}
+}
+
+static void generate(int scenario, int binary) {
+	int i = 0;
+	m_seed = 1 + scenario;
+	m_stream_length = 0;
+	for (i = 0; i < FRAMES; ++i) {
+		message_t* msg = &m_messages[i];
+		double yaw = 0.0, pitch = 0.0;
+		memset(msg, 0, sizeof(*msg));
+		msg->type = trajectory(scenario, i, &yaw, &pitch) ? 'D' : 'E';
+		msg->seq = (uint8_t)i;
+		msg->time = (uint16_t)(i * FRAME_MS);
+		msg->yaw = (int16_t)lround(yaw * 100.0);
+		msg->pitch = (int16_t)lround(pitch * 100.0);
+		msg->roll = (int16_t)lround(0.5 * 100.0);
+		if (binary) {
+			frame_encode(msg, m_stream + m_stream_length);
+			m_stream_length += FRAME_SIZE;
+		}
+		else {
+			m_stream_length += sprintf((char*)m_stream + m_stream_length, "%c %.2f %.2f %.2f;",
+				msg->type, msg->yaw / 100.0, msg->pitch / 100.0, msg->roll / 100.0);
+		}
+	}
+}
+
+static void calibrate(void) {
+	const double xs[3] = { MARGIN, WIDTH / 2, WIDTH - MARGIN };
+	const double ys[3] = { MARGIN, HEIGHT / 2, HEIGHT - MARGIN };
+	const int order[CALIB_POINTS][2] = { {0, 0}, {0, 1}, {0, 2}, {1, 2}, {1, 1}, {1, 0}, {2, 0}, {2, 1}, {2, 2} };
+	double yaw[CALIB_POINTS], pitch[CALIB_POINTS], roll[CALIB_POINTS];
+	double target_x[CALIB_POINTS], target_y[CALIB_POINTS];
+	int i = 0;
+	for (i = 0; i < CALIB_POINTS; ++i) {
+		target_x[i] = xs[order[i][0]];
+		target_y[i] = ys[order[i][1]];
+		yaw[i] = (order[i][0] - 1) * 20.0;
+		pitch[i] = (1 - order[i][1]) * 10.0;
+		roll[i] = 0.5;
+	}
+	calib_solve(&m_calib, CALIB_QUADRATIC, WIDTH, HEIGHT, yaw, pitch, roll, target_x, target_y);
+}
+
+static void collect(const message_t* msg, void* user_data) {
+	m_decoded[m_decoded_count++] = *msg;
+}
+
+static void count(const message_t* msg, void* user_data) {
+	m_checksum += msg->yaw;
+}
+
+// Stamped with the receipt of the notification, as the daemon does
+static void push(const message_t* msg, void* user_data) {
+	message_t received = *msg;
+	received.received_ns = m_received_ns;
+	queue_push(&m_queue, &received);
+}
+
+// Mapping and report of a game frame, as game_sequence() and aim_sequence()
+static void game(const message_t* msg, int shot) {
+	double yaw = 0.0, pitch = 0.0, roll = 0.0;
+	uint64_t delay_ns = 0;
+	int x = 0, y = 0;
+	filter_update(&m_filter, msg->received_ns, msg->yaw / 100.0, msg->pitch / 100.0, &yaw, &pitch);
+	calib_to_screen(&m_calib, yaw, pitch, msg->roll / 100.0, &x, &y);
+	if (shot && m_binary && shot_reconcile(&m_shot, msg, &yaw, &pitch, &roll, &delay_ns)) {
+		calib_to_screen(&m_calib, yaw, pitch, roll, &x, &y);
+		histogram_record(&m_stats.shot_delay, delay_ns);
+	}
+	const uint64_t mapped_ns = stats_now_ns();
+	if (shot && m_held) {
+		report_button(&m_report, 0);
+		report_submit(&m_report);
+	}
+	report_axis(&m_report, ABS_X, x);
+	report_axis(&m_report, ABS_Y, y);
+	if (shot) {
+		report_button(&m_report, 1);
+		m_held = 1;
+		m_release_time = msg->time + HOLD_MS;
+	}
+	report_submit(&m_report);
+	// The receipt times are synthetic, the total starts at the dequeue
+	const uint64_t emitted_ns = stats_now_ns();
+	stats_stage(&m_stats, STAGE_MAPPING, m_dequeued_ns, mapped_ns);
+	stats_stage(&m_stats, STAGE_EMIT, mapped_ns, emitted_ns);
+	stats_stage(&m_stats, STAGE_TOTAL, m_dequeued_ns, emitted_ns);
+	stats_report(&m_stats);
+	m_checksum += x + y;
+}
+
+static void shot_action(session_t* session, const message_t* msg) {
+	game(msg, 1);
+}
+
+static void aim_action(session_t* session, const message_t* msg) {
+	if (m_binary) {
+		shot_aim(&m_shot, msg);
+	}
+	game(msg, 0);
+}
+
+static const session_action_t ACTIONS[ACTION_COUNT] = {
+	[ACTION_SHOT] = shot_action,
+	[ACTION_AIM] = aim_action,
+};
+
+// The router side of a frame, as route_pending()
+static void route(const message_t* msg) {
+	// The release deadline on the MCU clock rather than the host one
+	if (m_held && (uint16_t)(msg->time - m_release_time) < 0x8000) {
+		report_button(&m_report, 0);
+		report_submit(&m_report);
+		m_held = 0;
+	}
+	m_dequeued_ns = stats_now_ns();
+	session_frame(&m_session, msg, m_binary);
+}
+
+static void stage_frame(void) {
+	framer_t framer;
+	size_t offset = 0;
+	framer_init(&framer);
+	for (offset = 0; offset < m_stream_length; offset += NOTIFICATION_SIZE) {
+		const size_t length = m_stream_length - offset < NOTIFICATION_SIZE ? m_stream_length - offset : NOTIFICATION_SIZE;
+		framer_feed(&framer, m_stream + offset, length, count, NULL);
+	}
+}
+
+static void stage_queue(void) {
+	message_t msg;
+	size_t i = 0;
+	for (i = 0; i < m_decoded_count; ++i) {
+		queue_push(&m_queue, &m_decoded[i]);
+		while (queue_pop(&m_queue, &msg)) {
+			m_checksum += msg.seq;
+		}
+	}
+}
+
+static void stage_map(void) {
+	size_t i = 0;
+	for (i = 0; i < m_decoded_count; ++i) {
+		int x = 0, y = 0;
+		calib_to_screen(&m_calib, m_decoded[i].yaw / 100.0, m_decoded[i].pitch / 100.0, m_decoded[i].roll / 100.0, &x, &y);
+		m_checksum += x + y;
+	}
+}
+
+static void stage_report(void) {
+	size_t i = 0;
+	for (i = 0; i < m_decoded_count; ++i) {
+		report_axis(&m_report, ABS_X, m_decoded[i].yaw & 0x7FFF);
+		report_axis(&m_report, ABS_Y, m_decoded[i].pitch & 0x7FFF);
+		report_button(&m_report, m_decoded[i].type == 'D');
+		report_submit(&m_report);
+	}
+}
+
+// Notifications as they arrive over the 20 s of the scenario, routed
+// after each one like the inline router, to a gun resuming a calibration
+static void stage_total(void) {
+	framer_t framer;
+	message_t msg;
+	size_t offset = 0;
+	m_release_time = 0;
+	m_held = 0;
+	session_init(&m_session, ACTIONS, NULL);
+	session_event(&m_session, EVENT_HELLO, NULL);
+	session_event(&m_session, EVENT_RESUME, NULL);
+	filter_init(&m_filter, FILTER_ONE_EURO);
+	shot_init(&m_shot);
+	framer_init(&framer);
+	for (offset = 0; offset < m_stream_length; offset += NOTIFICATION_SIZE) {
+		const size_t length = m_stream_length - offset < NOTIFICATION_SIZE ? m_stream_length - offset : NOTIFICATION_SIZE;
+		m_received_ns = (uint64_t)((double)offset / m_stream_length * FRAMES * FRAME_MS * 1e6);
+		framer_feed(&framer, m_stream + offset, length, push, NULL);
+		while (queue_pop(&m_queue, &msg)) {
+			route(&msg);
+		}
+	}
+}
+
+static void measure(const char* scenario, const char* wire, const char* stage, void (*run)(void)) {
+	uint64_t best = UINT64_MAX;
+	unsigned long allocations = 0;
+	int round = 0;
+	m_checksum = 0;
+	for (round = 0; round < ROUNDS; ++round) {
+		queue_init(&m_queue);
+		const unsigned long allocated = alloc_count;
+		const uint64_t start = stats_now_ns();
+		run();
+		const uint64_t elapsed = stats_now_ns() - start;
+		allocations += alloc_count - allocated;
+		if (elapsed < best) {
+			best = elapsed;
+		}
+	}
+	printf("{\"bench\":\"pipeline\",\"scenario\":\"%s\",\"wire\":\"%s\",\"stage\":\"%s\",\"messages\":%d,"
+		"\"ns_per_message\":%.1f,\"messages_per_s\":%.0f,\"allocations_per_run\":%.1f,\"checksum\":%ld}\n",
+		scenario, wire, stage, FRAMES, (double)best / FRAMES, FRAMES * 1e9 / best,
+		(double)allocations / ROUNDS, m_checksum / ROUNDS);
+}
+
+// Press and release into a full pipe, then an empty report once it drained
+static int check_release(void) {
+	struct input_event events[REPORT_EVENTS];
+	report_t report;
+	int fds[2];
+	char drain[4096];
+	ssize_t length = 0;
+	int resent = 0, i = 0;
+	if (pipe2(fds, O_NONBLOCK) != 0) {
+		return 0;
+	}
+	report_init(&report, fds[1]);
+	memset(drain, 0, sizeof(drain));
+	while (write(fds[1], drain, sizeof(drain)) > 0) {
+	}
+	while (write(fds[1], drain, 1) > 0) {
+	}
+	report_button(&report, 1);
+	const int pressed = report_submit(&report);
+	report_button(&report, 0);
+	const int released = report_submit(&report);
+	while (read(fds[0], drain, sizeof(drain)) > 0) {
+	}
+	report_submit(&report);
+	length = read(fds[0], events, sizeof(events));
+	for (i = 0; i < length / (ssize_t)sizeof(struct input_event); ++i) {
+		resent |= events[i].type == EV_KEY && events[i].code == BTN_LEFT && events[i].value == 0;
+	}
+	printf("{\"bench\":\"pipeline\",\"check\":\"release_retry\",\"pressed\":%d,\"released\":%d,\"again\":%lu,\"resent\":%d}\n",
+		pressed, released, atomic_load(&report.again), resent);
+	close(fds[0]);
+	close(fds[1]);
+	return !pressed && !released && resent;
+}
+
+int main(int argc, char** argv) {
+	int scenario = 0, binary = 0;
+	report_init(&m_report, open("/dev/null", O_WRONLY));
+	stats_init(&m_stats);
+	calibrate();
+	for (scenario = 0; scenario < SCENARIOS; ++scenario) {
+		for (binary = 1; binary >= 0; --binary) {
+			const char* wire = binary ? "binary" : "ascii";
+			framer_t framer;
+			m_binary = binary;
+			generate(scenario, binary);
+			framer_init(&framer);
+			m_decoded_count = 0;
+			framer_feed(&framer, m_stream, m_stream_length, collect, NULL);
+			measure(SCENARIO_NAMES[scenario], wire, "frame", stage_frame);
+			measure(SCENARIO_NAMES[scenario], wire, "queue", stage_queue);
+			measure(SCENARIO_NAMES[scenario], wire, "map", stage_map);
+			measure(SCENARIO_NAMES[scenario], wire, "report", stage_report);
+			measure(SCENARIO_NAMES[scenario], wire, "total", stage_total);
+		}
+	}
+	const int retried = check_release();
+	fflush(stdout);
+	return !retried;
+}
@@ -0,0 +1,82 @@
+// Wakeup lateness of a 1 kHz timer thread, the router deadlines of the
+// daemon, with the normal scheduler and with the real time profile, idle
+// and with a busy thread per CPU standing for the emulator.
+//   ./rt_bench [priority[:cpus]]     profile as blue -R (default 50)
+// Without the privilege the profile is reported as not applied, the run
+// then shows the normal scheduler twice. One JSON object per line on stdout.
+#include <pthread.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include "rt.h"
+
+#define PERIOD_NS 1000000ULL
+#define PERIODS 3000
+#define MAX_HOGS 64
+
+enum { NORMAL, REALTIME, PROFILES };
+static const char* PROFILE_NAMES[PROFILES] = { "normal", "rt" };
+
+static rt_t m_rt;
+static atomic_int m_stop;
+
+typedef struct probe {
+	int profile;
+	int applied;
+	histogram_t wakeup;
+} probe_t;
+
+static void* hog(void* arg) {
+	volatile unsigned long spin = 0;
+	while (!atomic_load_explicit(&m_stop, memory_order_relaxed)) {
+		++spin;
+	}
+	return NULL;
+}
+
+static void* probe(void* arg) {
+	probe_t* probe = arg;
+	if (probe->profile == REALTIME) {
+		probe->applied = rt_thread(&m_rt);
+	}
+	rt_probe(&probe->wakeup, PERIOD_NS, PERIODS);
+	return NULL;
+}
+
+int main(int argc, char** argv) {
+	const long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+	const int hogs = cpus < MAX_HOGS ? (int)cpus : MAX_HOGS;
+	int profile = 0, loaded = 0, i = 0;
+	rt_init(&m_rt);
+	if (!rt_parse(&m_rt, argc > 1 ? argv[1] : "50")) {
+		fprintf(stderr, "Usage : %s [priority[:cpus]]\n", argv[0]);
+		return 1;
+	}
+	const int locked = rt_lock() == 0;
+	for (loaded = 0; loaded < 2; ++loaded) {
+		for (profile = 0; profile < PROFILES; ++profile) {
+			pthread_t threads[MAX_HOGS], thread_probe;
+			probe_t result;
+			memset(&result, 0, sizeof(result));
+			result.profile = profile;
+			atomic_store(&m_stop, 0);
+			for (i = 0; loaded && i < hogs; ++i) {
+				pthread_create(&threads[i], NULL, hog, NULL);
+			}
+			pthread_create(&thread_probe, NULL, probe, &result);
+			pthread_join(thread_probe, NULL);
+			atomic_store(&m_stop, 1);
+			for (i = 0; loaded && i < hogs; ++i) {
+				pthread_join(threads[i], NULL);
+			}
+			printf("{\"bench\":\"rt\",\"profile\":\"%s\",\"load\":%d,\"priority\":%d,\"cpus\":\"0x%lx\",\"fifo\":%s,\"pinned\":%s,"
+				"\"locked\":%s,\"wakeups\":%d,\"p50_us\":%.1f,\"p99_us\":%.1f,\"p999_us\":%.1f,\"max_us\":%.1f}\n",
+				PROFILE_NAMES[profile], loaded ? hogs : 0, m_rt.priority, m_rt.cpus,
+				(result.applied & RT_FIFO) ? "true" : "false", (result.applied & RT_CPUS) ? "true" : "false",
+				locked ? "true" : "false", PERIODS,
+				histogram_percentile(&result.wakeup, 50.0) / 1e3, histogram_percentile(&result.wakeup, 99.0) / 1e3,
+				histogram_percentile(&result.wakeup, 99.9) / 1e3, atomic_load(&result.wakeup.max) / 1e3);
+		}
+	}
+	return 0;
+}
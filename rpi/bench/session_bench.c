@@ -0,0 +1,249 @@
+// Session transition table fed with the frames of whole sessions, then
+// duplicated, reordered and random ones at full speed, with actions that
+// stand in for the daemon and check after every frame :
+//   - the commands to the gun of one 'A' frame follow Z Y X, or X on a resume
+//   - points only in calibration, aim and shots only in game
+//   - the game starts after 9 points or a resume, a duplicated point is dropped
+//   - the timer only runs in the init state
+// One JSON object per line on stdout, exit status 1 when a check failed.
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include "session.h"
+#include "stats.h"
+#include "alloc_count.h"
+
+#define FRAMES 1000000
+// Virtual time per frame and init screen, much shorter than the daemon one
+#define FRAME_NS 1000000ULL
+#define INIT_NS (50 * FRAME_NS)
+#define CHECK_FRAMES 25
+
+enum { ORDERED, DUPLICATED, REORDERED, RANDOM, SCENARIOS };
+static const char* SCENARIO_NAMES[SCENARIOS] = { "ordered", "duplicated", "reordered", "random" };
+
+typedef struct mock {
+	uint64_t now_ns;
+	int calibrated;
+	int points;
+	int check_frames;
+	// Sequence of the previous frame, -1 after an 'A' frame
+	int previous_seq;
+	// Last command since the 'A' frame, 0 when none
+	char command;
+	unsigned long games;
+	unsigned long calibrations;
+	unsigned long violations;
+} mock_t;
+
+static message_t m_frames[FRAMES];
+static uint32_t m_seed = 1;
+
+static uint32_t random_next(void) {
+	m_seed = m_seed * 1664525U + 1013904223U;
+	return m_seed >> 8;
+}
+
+static uint64_t now_ns(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000U + ts.tv_nsec;
+}
+
+static void check(mock_t* mock, int ok, const char* what) {
+	if (!ok) {
+		if (mock->violations++ < 10) {
+			fprintf(stderr, "violation : %s\n", what);
+		}
+	}
+}
+
+// Command to the gun, in the order the firmware expects
+static void command(session_t* session, char value, int state) {
+	mock_t* mock = session->user_data;
+	static const char* ALLOWED[] = { "\0Z", "\0X", "ZY", "YX", "XZ" };
+	char pair[2] = { mock->command, value };
+	int ok = 0;
+	size_t i = 0;
+	for (i = 0; i < sizeof(ALLOWED) / sizeof(ALLOWED[0]); ++i) {
+		ok |= memcmp(pair, ALLOWED[i], 2) == 0;
+	}
+	check(mock, ok, "command out of order");
+	check(mock, session->state == state, "entry action in another state");
+	mock->command = value;
+}
+
+static void hello(session_t* session, const message_t* msg) {
+	mock_t* mock = session->user_data;
+	mock->command = 0;
+	if (mock->calibrated) {
+		session_post(session, EVENT_RESUME);
+	}
+}
+
+static void resume(session_t* session, const message_t* msg) {
+	mock_t* mock = session->user_data;
+	check(mock, session->state == INIT_SEQUENCE && mock->calibrated, "resume without calibration");
+	mock->check_frames = CHECK_FRAMES;
+}
+
+static void point(session_t* session, const message_t* msg) {
+	mock_t* mock = session->user_data;
+	check(mock, session->state == CALIBRATION_SEQUENCE && msg != NULL, "point outside calibration");
+	check(mock, msg == NULL || msg->seq != mock->previous_seq, "duplicated point");
+	if (++mock->points == 9) {
+		mock->points = 0;
+		mock->calibrated = 1;
+		++mock->calibrations;
+		session_post(session, EVENT_CALIBRATED);
+	}
+}
+
+static void shot(session_t* session, const message_t* msg) {
+	mock_t* mock = session->user_data;
+	check(mock, session->state == GAME_SEQUENCE && msg != NULL, "shot outside game");
+}
+
+// A third of the resumed calibrations do not match the aim
+static void aim(session_t* session, const message_t* msg) {
+	mock_t* mock = session->user_data;
+	check(mock, session->state == GAME_SEQUENCE && msg != NULL, "aim outside game");
+	if (mock->check_frames > 0 && --mock->check_frames == 0 && random_next() % 3 == 0) {
+		mock->calibrated = 0;
+		session_post(session, EVENT_REJECTED);
+	}
+}
+
+static void init_enter(session_t* session, const message_t* msg) {
+	mock_t* mock = session->user_data;
+	check(mock, session->state == INIT_SEQUENCE, "init entry in another state");
+	session_timer(session, mock->now_ns + INIT_NS);
+}
+
+static void stab_enter(session_t* session, const message_t* msg) {
+	command(session, 'Z', STAB_SEQUENCE);
+}
+
+static void calibration_enter(session_t* session, const message_t* msg) {
+	mock_t* mock = session->user_data;
+	mock->points = 0;
+	command(session, 'Y', CALIBRATION_SEQUENCE);
+}
+
+static void game_enter(session_t* session, const message_t* msg) {
+	mock_t* mock = session->user_data;
+	check(mock, mock->calibrated, "game without calibration");
+	++mock->games;
+	command(session, 'X', GAME_SEQUENCE);
+}
+
+static const session_action_t ACTIONS[ACTION_COUNT] = {
+	[ACTION_HELLO] = hello,
+	[ACTION_RESUME] = resume,
+	[ACTION_POINT] = point,
+	[ACTION_SHOT] = shot,
+	[ACTION_AIM] = aim,
+	[ACTION_ENTER_INIT] = init_enter,
+	[ACTION_ENTER_STAB] = stab_enter,
+	[ACTION_ENTER_CALIBRATION] = calibration_enter,
+	[ACTION_ENTER_GAME] = game_enter,
+};
+
+static void frame(size_t i, char type, uint8_t seq) {
+	memset(&m_frames[i], 0, sizeof(m_frames[i]));
+	m_frames[i].type = type;
+	m_frames[i].seq = type == 'A' ? PROTOCOL_SHOT_TIME : seq;
+}
+
+// Sessions as the firmware plays them : hello, aim frames during the init
+// screen, stabilization, 9 points then a game, sometimes a reconnection
+static void generate_ordered(void) {
+	size_t i = 0;
+	uint8_t seq = 0;
+	while (i < FRAMES) {
+		const size_t game = 200 + random_next() % 2000;
+		size_t j = 0;
+		frame(i++, 'A', 0);
+		for (j = 0; j < 60 && i < FRAMES; ++j) {
+			frame(i++, 'E', seq++);
+		}
+		if (i < FRAMES) {
+			frame(i++, 'B', seq++);
+		}
+		for (j = 0; j < 9 && i < FRAMES; ++j) {
+			frame(i++, 'C', seq++);
+		}
+		for (j = 0; j < game && i < FRAMES; ++j) {
+			frame(i++, j % 10 == 9 ? 'D' : 'E', seq++);
+		}
+	}
+}
+
+static void generate(int scenario) {
+	size_t i = 0;
+	m_seed = 1 + scenario;
+	generate_ordered();
+	if (scenario == DUPLICATED) {
+		// Up to 3 copies of a frame, the stream keeps its length
+		for (i = FRAMES - 1; i > 0; --i) {
+			if (random_next() % 4 == 0) {
+				m_frames[i] = m_frames[i - 1];
+			}
+		}
+	}
+	else if (scenario == REORDERED) {
+		for (i = 0; i + 1 < FRAMES; ++i) {
+			if (random_next() % 5 == 0) {
+				const message_t swap = m_frames[i];
+				m_frames[i] = m_frames[i + 1];
+				m_frames[i + 1] = swap;
+			}
+		}
+	}
+	else if (scenario == RANDOM) {
+		for (i = 0; i < FRAMES; ++i) {
+			const uint32_t r = random_next() % 1000;
+			frame(i, r < 5 ? 'A' : r < 100 ? 'B' : r < 400 ? 'C' : r < 500 ? 'D' : 'E', (uint8_t)random_next());
+		}
+	}
+}
+
+int main(int argc, char** argv) {
+	unsigned long violations = 0;
+	int scenario = 0;
+	for (scenario = 0; scenario < SCENARIOS; ++scenario) {
+		session_t session;
+		mock_t mock;
+		histogram_t cost;
+		size_t i = 0;
+		generate(scenario);
+		memset(&mock, 0, sizeof(mock));
+		mock.previous_seq = -1;
+		histogram_reset(&cost);
+		session_init(&session, ACTIONS, &mock);
+		const unsigned long allocated = alloc_count;
+		const uint64_t start = now_ns();
+		for (i = 0; i < FRAMES; ++i) {
+			const uint64_t before = now_ns();
+			mock.now_ns += FRAME_NS;
+			session_poll(&session, mock.now_ns);
+			session_frame(&session, &m_frames[i], 1);
+			mock.previous_seq = m_frames[i].type == 'A' ? -1 : m_frames[i].seq;
+			histogram_record(&cost, now_ns() - before);
+			check(&mock, session.state >= SESSION_IDLE && session.state < SESSION_STATES, "unknown state");
+			check(&mock, session.timer_ns == 0 || session.state == INIT_SEQUENCE, "timer outside init");
+			check(&mock, session.state != GAME_SEQUENCE || mock.calibrated, "game without calibration");
+		}
+		const uint64_t elapsed = now_ns() - start;
+		violations += mock.violations;
+		printf("{\"bench\":\"session\",\"scenario\":\"%s\",\"frames\":%d,\"handled\":%lu,\"ignored\":%lu,\"duplicates\":%lu,"
+			"\"games\":%lu,\"calibrations\":%lu,\"state\":\"%s\",\"violations\":%lu,\"frames_per_s\":%.0f,"
+			"\"p50_ns\":%llu,\"p99_ns\":%llu,\"max_ns\":%llu,\"allocations\":%lu}\n",
+			SCENARIO_NAMES[scenario], FRAMES, session.handled, session.ignored, session.duplicates,
+			mock.games, mock.calibrations, session_state_name(session.state), mock.violations, FRAMES * 1e9 / elapsed,
+			(unsigned long long)histogram_percentile(&cost, 50.0), (unsigned long long)histogram_percentile(&cost, 99.0),
+			(unsigned long long)atomic_load(&cost.max),
+			alloc_count - allocated);
+	}
+	return violations > 0;
+}
@@ -0,0 +1,83 @@
+// Hit point of shots on synthetic 50 Hz guns, taken from the pose in the
+// shot frame against the pose interpolated at the trigger edge. The shot
+// frame leaves up to MAX_SHOT_DELAY_MS after the edge, the frames reach the
+// host SYNTHETIC_LATENCY_MS later plus up to one BLE connection interval, and the MCU
+// clock runs DRIFT faster than the host one.
+//   naive_px       error of the pose in the shot frame against the pose at the edge
+//   reconciled_px  error of the reconciled pose
+//   shift_px       distance between the two, as in the shot line of the statistics
+//   delay_ms       trigger edge to receipt beyond the fastest aim frame
+// One JSON object per line on stdout.
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+#include "shot.h"
+#include "stats.h"
+#include "alloc_count.h"
+#include "synthetic.h"
+
+#define FRAME_MS 20
+#define SHOTS 2000
+#define SHOT_PERIOD_MS 230
+#define MAX_SHOT_DELAY_MS 15
+#define DRIFT 0.002
+
+enum { STILL = SYNTHETIC_STILL, SWEEP = SYNTHETIC_SWEEP, FLICK = SYNTHETIC_FLICK, SCENARIOS };
+static const char* SCENARIO_NAMES[SCENARIOS] = { "still", "sweep", "flick" };
+
+// Frame sent at t seconds, received when the host clock reads received_ns
+static void frame(int scenario, char type, double t, double stamp, message_t* msg) {
+	double yaw = 0.0, pitch = 0.0;
+	synthetic_truth(scenario, t, &yaw, &pitch);
+	memset(msg, 0, sizeof(*msg));
+	msg->type = type;
+	// MCU clock started 12 s before the host one
+	msg->time = (uint16_t)llround((stamp + 12.0) * (1.0 + DRIFT) * 1000.0);
+	msg->yaw = (int16_t)lround(yaw * 100.0);
+	msg->pitch = (int16_t)lround(pitch * 100.0);
+	msg->roll = 50;
+	msg->received_ns = synthetic_received_ns(t);
+}
+
+static double distance_px(double yaw, double pitch, double to_yaw, double to_pitch) {
+	return hypot((yaw - to_yaw) * SYNTHETIC_PX_PER_DEG, (pitch - to_pitch) * SYNTHETIC_PX_PER_DEG);
+}
+
+int main(int argc, char** argv) {
+	int scenario = 0;
+	for (scenario = 0; scenario < SCENARIOS; ++scenario) {
+		shot_t shot;
+		message_t msg;
+		double naive = 0.0, reconciled = 0.0, shift = 0.0, delay = 0.0;
+		uint64_t elapsed = 0;
+		int aim = 0, i = 0, missed = 0;
+		synthetic_seed(3 + scenario);
+		shot_init(&shot);
+		const unsigned long allocated = alloc_count;
+		for (i = 0; i < SHOTS; ++i) {
+			const double trigger = (i + 1) * SHOT_PERIOD_MS / 1000.0 + FRAME_MS / 1000.0 * (synthetic_noise() + 0.5);
+			const double sent = trigger + MAX_SHOT_DELAY_MS / 1000.0 * (synthetic_noise() + 0.5);
+			double yaw = 0.0, pitch = 0.0, roll = 0.0, true_yaw = 0.0, true_pitch = 0.0;
+			uint64_t delay_ns = 0;
+			// Aim frames up to the shot, they arrive in order before it
+			for (; aim * FRAME_MS / 1000.0 < sent; ++aim) {
+				frame(scenario, 'E', aim * FRAME_MS / 1000.0, aim * FRAME_MS / 1000.0, &msg);
+				shot_aim(&shot, &msg);
+			}
+			frame(scenario, 'D', sent, trigger, &msg);
+			const uint64_t start = stats_now_ns();
+			missed += !shot_reconcile(&shot, &msg, &yaw, &pitch, &roll, &delay_ns);
+			elapsed += stats_now_ns() - start;
+			synthetic_truth(scenario, trigger, &true_yaw, &true_pitch);
+			naive += distance_px(msg.yaw / 100.0, msg.pitch / 100.0, true_yaw, true_pitch);
+			reconciled += distance_px(yaw, pitch, true_yaw, true_pitch);
+			shift += distance_px(yaw, pitch, msg.yaw / 100.0, msg.pitch / 100.0);
+			delay += delay_ns / 1e6;
+		}
+		printf("{\"bench\":\"shot\",\"scenario\":\"%s\",\"shots\":%d,\"missed\":%d,\"naive_px\":%.2f,\"reconciled_px\":%.2f,"
+			"\"shift_px\":%.2f,\"delay_ms\":%.1f,\"ns_per_shot\":%.1f,\"allocations\":%lu}\n",
+			SCENARIO_NAMES[scenario], SHOTS, missed, naive / SHOTS, reconciled / SHOTS, shift / SHOTS, delay / SHOTS,
+			(double)elapsed / SHOTS, alloc_count - allocated);
+	}
+	return 0;
+}
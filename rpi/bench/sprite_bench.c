@@ -0,0 +1,182 @@
+// Frame time of the calibration screen with SDL's software renderer, which
+// is what draws when the GPU is busy with the emulator :
+// the clear alone, the target rasterized with lines every frame, and the
+// cached target texture copied once. The countdown and the spinner of the
+// init and stab screens are drawn from their sprite sheet through the
+// frame tables, as blue2.c does, then with the source rectangle computed
+// from the ticks on each frame, as it did before the tables.
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include "sprite.h"
+
+#define FRAMES 2000
+#define WIDTH 1920
+#define HEIGHT 1080
+// Sheet layouts of countdown.png and circles.png, see blue2.c
+#define COUNT_FRAMES 11
+#define COUNT_FIRST 5
+#define COUNT_COLUMNS 16
+#define COUNT_SIZE 96
+#define SPIN_FRAMES 16
+#define SPIN_COLUMNS 4
+#define SPIN_SIZE 400
+
+typedef struct sheet {
+	SDL_Texture* texture;
+	SDL_Rect rects[SPIN_FRAMES];
+	SDL_Rect destination;
+	int count;
+} sheet_t;
+
+static double now_s(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+static void clear(SDL_Renderer* renderer) {
+	SDL_SetRenderDrawColor(renderer, 0, 0, 0, 255);
+	SDL_RenderClear(renderer);
+}
+
+static double run_clear(SDL_Renderer* renderer) {
+	int i = 0;
+	double start = now_s();
+	for (i = 0; i < FRAMES; ++i) {
+		clear(renderer);
+		SDL_RenderPresent(renderer);
+	}
+	return (now_s() - start) / FRAMES;
+}
+
+static double run_lines(SDL_Renderer* renderer, const SDL_Rect rects[SPRITE_TARGETS]) {
+	int i = 0;
+	double start = now_s();
+	for (i = 0; i < FRAMES; ++i) {
+		const SDL_Rect* rect = &rects[i % SPRITE_TARGETS];
+		clear(renderer);
+		sprite_fill_circle(renderer, rect->x + SPRITE_TARGET_RADIUS, rect->y + SPRITE_TARGET_RADIUS,
+			SPRITE_TARGET_RADIUS, SPRITE_TARGET_CROSS, SPRITE_TARGET_BORDER, 255, 255, 255, 255);
+		SDL_RenderPresent(renderer);
+	}
+	return (now_s() - start) / FRAMES;
+}
+
+static double run_sprite(SDL_Renderer* renderer, SDL_Texture* target, const SDL_Rect rects[SPRITE_TARGETS]) {
+	int i = 0;
+	double start = now_s();
+	for (i = 0; i < FRAMES; ++i) {
+		clear(renderer);
+		SDL_RenderCopy(renderer, target, NULL, &rects[i % SPRITE_TARGETS]);
+		SDL_RenderPresent(renderer);
+	}
+	return (now_s() - start) / FRAMES;
+}
+
+// Sheet of count frames with a distinct shade each, the PNGs are not needed
+// for the timing
+static int sheet_create(SDL_Renderer* renderer, sheet_t* sheet, int count, int first, int columns, int size, int width, int height) {
+	const int rows = (first + count + columns - 1) / columns;
+	SDL_Surface* surface = SDL_CreateRGBSurfaceWithFormat(0, columns * size, rows * size, 32, SDL_PIXELFORMAT_RGBA8888);
+	int i = 0;
+	if (surface == NULL) {
+		return 0;
+	}
+	sheet->count = count;
+	sprite_sheet_rects(sheet->rects, count, first, columns, size);
+	for (i = 0; i < count; ++i) {
+		SDL_FillRect(surface, &sheet->rects[i], SDL_MapRGBA(surface->format, 255, i * 15, 255 - i * 15, 255));
+	}
+	sheet->texture = SDL_CreateTextureFromSurface(renderer, surface);
+	SDL_FreeSurface(surface);
+	sheet->destination.x = (WIDTH - width) / 2;
+	sheet->destination.y = (HEIGHT - height) / 2 + height;
+	sheet->destination.w = width;
+	sheet->destination.h = height;
+	return sheet->texture != NULL;
+}
+
+static void sheet_destroy(sheet_t* sheet) {
+	SDL_DestroyTexture(sheet->texture);
+}
+
+// Source rectangle of the countdown and the spinner at ticks ms, as
+// ihm_init_sequence() and ihm_stab_sequence() computed it
+static SDL_Rect ticks_rect(int spinner, Uint32 ticks) {
+	if (!spinner) {
+		Uint32 seconds = ((ticks / 1000) % 11) + 5;
+		SDL_Rect srcrect = { seconds * 96, 0, 96, 96 };
+		return srcrect;
+	}
+	Uint32 frames = (ticks / 100) % 16;
+	Uint32 range = frames / 4;
+	Uint32 column = frames % 4;
+	SDL_Rect srcrect = { column * 400, range * 400, 400, 400 };
+	return srcrect;
+}
+
+// Countdown then spinner, the frame advancing every frame to rule out any
+// caching of the last source rectangle
+static double run_sheet(SDL_Renderer* renderer, const sheet_t* sheets, int table) {
+	int i = 0, s = 0;
+	double start = now_s();
+	for (s = 0; s < 2; ++s) {
+		const sheet_t* sheet = &sheets[s];
+		for (i = 0; i < FRAMES / 2; ++i) {
+			const int frame = i % sheet->count;
+			clear(renderer);
+			if (table) {
+				SDL_RenderCopy(renderer, sheet->texture, &sheet->rects[frame], &sheet->destination);
+			}
+			else {
+				const SDL_Rect srcrect = ticks_rect(s, i * (s ? 100 : 1000));
+				SDL_RenderCopy(renderer, sheet->texture, &srcrect, &sheet->destination);
+			}
+			SDL_RenderPresent(renderer);
+		}
+	}
+	return (now_s() - start) / FRAMES;
+}
+
+int main(int argc, char** argv) {
+	SDL_Rect rects[SPRITE_TARGETS];
+	SDL_Surface* screen = SDL_CreateRGBSurfaceWithFormat(0, WIDTH, HEIGHT, 32, SDL_PIXELFORMAT_RGBA8888);
+	SDL_Renderer* renderer = screen ? SDL_CreateSoftwareRenderer(screen) : NULL;
+	if (renderer == NULL) {
+		fprintf(stderr, "Unable to create the software renderer: %s\n", SDL_GetError());
+		return 1;
+	}
+	SDL_Texture* target = sprite_target(renderer, SPRITE_TARGET_RADIUS, SPRITE_TARGET_CROSS, SPRITE_TARGET_BORDER, 255, 255, 255, 255);
+	if (target == NULL) {
+		fprintf(stderr, "Unable to create the target: %s\n", SDL_GetError());
+		return 1;
+	}
+	sprite_target_rects(WIDTH, HEIGHT, SPRITE_TARGET_RADIUS, rects);
+	sheet_t sheets[2];
+	memset(sheets, 0, sizeof(sheets));
+	if (!sheet_create(renderer, &sheets[0], COUNT_FRAMES, COUNT_FIRST, COUNT_COLUMNS, COUNT_SIZE, 80, 100)
+		|| !sheet_create(renderer, &sheets[1], SPIN_FRAMES, 0, SPIN_COLUMNS, SPIN_SIZE, 100, 100)) {
+		fprintf(stderr, "Unable to create the sprite sheets: %s\n", SDL_GetError());
+		return 1;
+	}
+
+	const double base = run_clear(renderer);
+	const double lines = run_lines(renderer, rects);
+	const double sprite = run_sprite(renderer, target, rects);
+	const double sheet = run_sheet(renderer, sheets, 1);
+	const double ticks = run_sheet(renderer, sheets, 0);
+	printf("%dx%d software renderer, %d frames\n", WIDTH, HEIGHT, FRAMES);
+	printf("clear only    %8.1f us/frame\n", base * 1e6);
+	printf("target lines  %8.1f us/frame (%.1f us drawing)\n", lines * 1e6, (lines - base) * 1e6);
+	printf("target sprite %8.1f us/frame (%.1f us drawing)\n", sprite * 1e6, (sprite - base) * 1e6);
+	printf("sheet table   %8.1f us/frame (%.1f us drawing)\n", sheet * 1e6, (sheet - base) * 1e6);
+	printf("sheet ticks   %8.1f us/frame (%.1f us drawing)\n", ticks * 1e6, (ticks - base) * 1e6);
+
+	sheet_destroy(&sheets[0]);
+	sheet_destroy(&sheets[1]);
+	SDL_DestroyTexture(target);
+	SDL_DestroyRenderer(renderer);
+	SDL_FreeSurface(screen);
+	return 0;
+}
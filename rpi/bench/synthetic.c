@@ -0,0 +1,38 @@
+// Synthetic gun of the filter, shot and upsample benches
+#include <math.h>
+#include "synthetic.h"
+
+static uint32_t m_seed = 1;
+
+void synthetic_seed(uint32_t seed) {
+	m_seed = seed;
+}
+
+double synthetic_noise(void) {
+	m_seed = m_seed * 1664525U + 1013904223U;
+	return (m_seed >> 8) / (double)(1U << 24) - 0.5;
+}
+
+void synthetic_truth(int motion, double t, double* yaw, double* pitch) {
+	if (motion == SYNTHETIC_STILL) {
+		*yaw = 5.0;
+		*pitch = -3.0;
+	}
+	else if (motion == SYNTHETIC_SWEEP) {
+		*yaw = 15.0 * sin(t * 1.5);
+		*pitch = 7.0 * sin(t * 0.7);
+	}
+	else {
+		const int target = (int)(t / SYNTHETIC_FLICK_S);
+		const double step = t - target * SYNTHETIC_FLICK_S;
+		const double progress = step < SYNTHETIC_FLICK_MOVE_S ? 0.5 - 0.5 * cos(M_PI * step / SYNTHETIC_FLICK_MOVE_S) : 1.0;
+		const double from_yaw = 15.0 * sin(target * 2.3), to_yaw = 15.0 * sin((target + 1) * 2.3);
+		const double from_pitch = 7.0 * cos(target * 1.7), to_pitch = 7.0 * cos((target + 1) * 1.7);
+		*yaw = from_yaw + (to_yaw - from_yaw) * progress;
+		*pitch = from_pitch + (to_pitch - from_pitch) * progress;
+	}
+}
+
+uint64_t synthetic_received_ns(double t) {
+	return (uint64_t)((t * 1000.0 + SYNTHETIC_LATENCY_MS + SYNTHETIC_INTERVAL_MS * (synthetic_noise() + 0.5)) * 1e6);
+}
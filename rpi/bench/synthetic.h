@@ -0,0 +1,31 @@
+#ifndef SYNTHETIC_H
+#define SYNTHETIC_H
+
+#include <stdint.h>
+
+// Synthetic 50 Hz gun shared by the benches : where it points, and when its
+// frames reach the host, LATENCY_MS after they were sent plus up to one BLE
+// connection interval. Link bench/synthetic.c to use it.
+#define SYNTHETIC_LATENCY_MS 30
+#define SYNTHETIC_INTERVAL_MS 7.5
+// 40 deg of yaw across 1920 px
+#define SYNTHETIC_PX_PER_DEG 48.0
+// A flick reaches a new target every FLICK_S in FLICK_MOVE_S
+#define SYNTHETIC_FLICK_S 0.8
+#define SYNTHETIC_FLICK_MOVE_S 0.12
+
+enum { SYNTHETIC_STILL, SYNTHETIC_SWEEP, SYNTHETIC_FLICK, SYNTHETIC_MOTIONS };
+
+// Restart the noise sequence, each run seeds it to stay reproducible
+void synthetic_seed(uint32_t seed);
+
+// Uniform in [-0.5, 0.5)
+double synthetic_noise(void);
+
+// Where the gun points at t seconds, in degrees
+void synthetic_truth(int motion, double t, double* yaw, double* pitch);
+
+// Host time of the receipt of a frame sent at t seconds, draws one noise
+uint64_t synthetic_received_ns(double t);
+
+#endif
@@ -0,0 +1,123 @@
+// Shared memory telemetry hammered : one writer publishes as fast as it can
+// while reader threads, each with its own read only mapping as a plugin
+// would have, read the same slot in a loop. Every published state derives
+// from one counter, a read mixing two updates or going backward is a
+// violation.
+//   writes_per_s / reads_per_s  throughput of the writer and of all readers
+//   empty_pct                   reads returning no state, the writer kept the slot odd
+//   ns_per_read                 mean cost of telemetry_read()
+// One JSON object per line on stdout, exit status 1 when a check failed.
+#include <pthread.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include "telemetry.h"
+#include "stats.h"
+
+#define DURATION_NS 1000000000ULL
+#define MAX_READERS 4
+
+static const int READERS[] = { 1, 3 };
+static atomic_int m_stop;
+
+typedef struct reader {
+	const telemetry_segment_t* segment;
+	unsigned long reads;
+	unsigned long empty;
+	unsigned long violations;
+	uint64_t elapsed_ns;
+} reader_t;
+
+static void state_of(uint32_t n, telemetry_state_t* state) {
+	memset(state, 0, sizeof(*state));
+	state->time_ns = n * 1000ULL;
+	state->yaw = (float)(n % 36000) / 100.0f;
+	state->pitch = -(float)(n % 18000) / 100.0f;
+	state->roll = (float)(n % 100);
+	state->x = (int32_t)n;
+	state->y = -(int32_t)n;
+	state->trigger = n & 1;
+	state->health = n % 4;
+	state->session = n % 5;
+}
+
+static void* read_loop(void* arg) {
+	reader_t* reader = arg;
+	telemetry_state_t state, expected;
+	int32_t previous = 0;
+	const uint64_t start = stats_now_ns();
+	while (!atomic_load_explicit(&m_stop, memory_order_relaxed)) {
+		++reader->reads;
+		if (telemetry_read(reader->segment, 0, &state) == 0) {
+			++reader->empty;
+			continue;
+		}
+		state_of((uint32_t)state.x, &expected);
+		if (memcmp(&state, &expected, sizeof(state)) != 0 || state.x < previous) {
+			if (reader->violations++ < 10) {
+				fprintf(stderr, "violation : x %d y %d time %llu after x %d\n", state.x, state.y, (unsigned long long)state.time_ns, previous);
+			}
+		}
+		previous = state.x;
+	}
+	reader->elapsed_ns = stats_now_ns() - start;
+	return NULL;
+}
+
+int main(int argc, char** argv) {
+	char name[64];
+	unsigned long violations = 0;
+	size_t run = 0;
+	int i = 0;
+	snprintf(name, sizeof(name), "/blue-telemetry-bench-%d", (int)getpid());
+	for (run = 0; run < sizeof(READERS) / sizeof(READERS[0]); ++run) {
+		telemetry_t telemetry;
+		telemetry_state_t state;
+		reader_t readers[MAX_READERS];
+		pthread_t threads[MAX_READERS];
+		unsigned long reads = 0, empty = 0, reader_violations = 0;
+		uint64_t read_ns = 0;
+		uint32_t n = 0;
+		const int error = telemetry_open(&telemetry, name, 1);
+		if (error != 0) {
+			fprintf(stderr, "No shared memory %s : %s\n", name, strerror(error));
+			return 1;
+		}
+		memset(readers, 0, sizeof(readers));
+		atomic_store(&m_stop, 0);
+		for (i = 0; i < READERS[run]; ++i) {
+			readers[i].segment = telemetry_attach(name);
+			if (readers[i].segment == NULL) {
+				fprintf(stderr, "Fail to attach %s\n", name);
+				return 1;
+			}
+			pthread_create(&threads[i], NULL, read_loop, &readers[i]);
+		}
+		const uint64_t start = stats_now_ns();
+		uint64_t now = start;
+		while (now - start < DURATION_NS) {
+			// Check the clock every 1024 updates only
+			state_of(++n, &state);
+			telemetry_publish(&telemetry, 0, &state);
+			if ((n & 1023) == 0) {
+				now = stats_now_ns();
+			}
+		}
+		atomic_store(&m_stop, 1);
+		for (i = 0; i < READERS[run]; ++i) {
+			pthread_join(threads[i], NULL);
+			telemetry_detach(readers[i].segment);
+			reads += readers[i].reads;
+			empty += readers[i].empty;
+			reader_violations += readers[i].violations;
+			read_ns += readers[i].elapsed_ns;
+		}
+		telemetry_close(&telemetry);
+		violations += reader_violations;
+		printf("{\"bench\":\"telemetry\",\"readers\":%d,\"writes_per_s\":%.0f,\"reads_per_s\":%.0f,\"empty_pct\":%.2f,"
+			"\"ns_per_read\":%.1f,\"violations\":%lu}\n",
+			READERS[run], n * 1e9 / (now - start), reads * 1e9 / (now - start),
+			reads > 0 ? 100.0 * empty / reads : 0.0, reads > 0 ? (double)read_ns / reads : 0.0, reader_violations);
+	}
+	return violations > 0;
+}
@@ -0,0 +1,159 @@
+// Cursor seen by a 60 Hz display on synthetic 50 and 20 Hz guns, moved on
+// each aim frame (frame) or by the output scheduler without delay
+// (extrapolate) or one aim period behind (interpolate). The frames reach the
+// host SYNTHETIC_LATENCY_MS later plus up to one BLE connection interval, the gap
+// scenario loses GAP_MS of frames every 2 s.
+//   lag_ms        shift of the true motion that best matches the cursor
+//   error_px      mean distance to the true aim at display time
+//   lagged_px     mean distance to the true aim lag_ms earlier
+//   judder_px     RMS of the second difference of that distance per display frame
+//   stall_pct     display frames where the cursor stands while the aim moves
+//   max_error_px  worst distance to the true aim, the gaps stop the extrapolation
+// One JSON object per line on stdout.
+#include <math.h>
+#include <stdio.h>
+#include <string.h>
+#include "shot.h"
+#include "upsample.h"
+#include "synthetic.h"
+
+#define DURATION_S 60
+#define STEP_NS 250000ULL
+#define DISPLAY_HZ 60
+#define DISPLAY_FRAMES (DURATION_S * DISPLAY_HZ)
+#define GAP_MS 300
+#define MAX_LAG_MS 150
+
+enum { SWEEP, FLICK, GAP, SCENARIOS };
+static const char* SCENARIO_NAMES[SCENARIOS] = { "sweep", "flick", "gap" };
+enum { FRAME, EXTRAPOLATE, INTERPOLATE, MODES };
+static const char* MODE_NAMES[MODES] = { "frame", "extrapolate", "interpolate" };
+static const int AIM_HZ[] = { 50, 20 };
+
+static double m_cursor_x[DISPLAY_FRAMES], m_cursor_y[DISPLAY_FRAMES];
+
+// Where the gun points at t seconds in px, the gap scenario sweeps
+static void truth(int scenario, double t, double* x, double* y) {
+	double yaw = 0.0, pitch = 0.0;
+	synthetic_truth(scenario == FLICK ? SYNTHETIC_FLICK : SYNTHETIC_SWEEP, t, &yaw, &pitch);
+	*x = yaw * SYNTHETIC_PX_PER_DEG;
+	*y = pitch * SYNTHETIC_PX_PER_DEG;
+}
+
+// The display frame i is shown at (i + skip) / DISPLAY_HZ
+static double error_px(int scenario, int frames, int skip, double lag) {
+	double error = 0.0, x = 0.0, y = 0.0;
+	int i = 0;
+	for (i = 0; i < frames; ++i) {
+		truth(scenario, (double)(i + skip) / DISPLAY_HZ - lag, &x, &y);
+		error += hypot(m_cursor_x[i] - x, m_cursor_y[i] - y);
+	}
+	return error / frames;
+}
+
+static void run(int scenario, int aim_hz, int mode) {
+	const uint64_t period_ns = 1000000000ULL / aim_hz;
+	const uint64_t display_ns = 1000000000ULL / DISPLAY_HZ;
+	const double delay_ms = mode == INTERPOLATE ? 1000.0 / aim_hz + SYNTHETIC_INTERVAL_MS : 0.0;
+	shot_t shot;
+	upsample_t upsample;
+	message_t msg;
+	double x = 0.0, y = 0.0, cursor_x = 0.0, cursor_y = 0.0;
+	uint64_t sent_ns = 0, received_ns = SYNTHETIC_LATENCY_MS * 1000000ULL, next_display = display_ns, t = 0;
+	unsigned long outputs = 0;
+	int frames = 0, i = 0;
+	synthetic_seed(5 + scenario);
+	shot_init(&shot);
+	upsample_init(&upsample, mode == FRAME ? 0.0 : DISPLAY_HZ, delay_ms);
+	memset(&msg, 0, sizeof(msg));
+	for (t = 0; frames < DISPLAY_FRAMES; t += STEP_NS) {
+		while (received_ns <= t) {
+			const double sent = sent_ns / 1e9;
+			const int lost = scenario == GAP && fmod(sent, 2.0) > 2.0 - GAP_MS / 1000.0;
+			if (!lost) {
+				truth(scenario, sent, &x, &y);
+				// MCU clock started 12 s before the host one
+				msg.time = (uint16_t)llround((sent + 12.0) * 1000.0);
+				msg.received_ns = received_ns;
+				shot_aim(&shot, &msg);
+				upsample_sample(&upsample, shot_host_ns(&shot, msg.time), x, y);
+				if (mode == FRAME) {
+					cursor_x = x;
+					cursor_y = y;
+				}
+			}
+			sent_ns += period_ns;
+			received_ns = synthetic_received_ns(sent_ns / 1e9);
+		}
+		if (upsample_due(&upsample, t) && upsample_position(&upsample, t, &cursor_x, &cursor_y)) {
+			++outputs;
+		}
+		if (t >= next_display) {
+			m_cursor_x[frames] = cursor_x;
+			m_cursor_y[frames] = cursor_y;
+			++frames;
+			next_display += display_ns;
+		}
+	}
+
+	// Skip the first second, before the first frames
+	const int skip = DISPLAY_HZ;
+	memmove(m_cursor_x, m_cursor_x + skip, (frames - skip) * sizeof(double));
+	memmove(m_cursor_y, m_cursor_y + skip, (frames - skip) * sizeof(double));
+	frames -= skip;
+	double best_lag = 0.0, best_error = INFINITY;
+	int lag_ms = 0;
+	for (lag_ms = 0; lag_ms <= MAX_LAG_MS; ++lag_ms) {
+		const double error = error_px(scenario, frames, skip, lag_ms / 1000.0);
+		if (error < best_error) {
+			best_error = error;
+			best_lag = lag_ms;
+		}
+	}
+	double judder = 0.0, previous_dx = 0.0, previous_dy = 0.0, max_error = 0.0, error = 0.0;
+	double previous_x = 0.0, previous_y = 0.0, previous_cx = 0.0, previous_cy = 0.0;
+	int stalls = 0, moving = 0;
+	for (i = 0; i < frames; ++i) {
+		const double now = (double)(i + skip) / DISPLAY_HZ;
+		double true_x = 0.0, true_y = 0.0, lagged_x = 0.0, lagged_y = 0.0;
+		truth(scenario, now, &true_x, &true_y);
+		truth(scenario, now - best_lag / 1000.0, &lagged_x, &lagged_y);
+		const double distance = hypot(m_cursor_x[i] - true_x, m_cursor_y[i] - true_y);
+		const double dx = m_cursor_x[i] - lagged_x, dy = m_cursor_y[i] - lagged_y;
+		error += distance;
+		if (distance > max_error) {
+			max_error = distance;
+		}
+		if (i >= 2) {
+			judder += (dx - previous_dx) * (dx - previous_dx) + (dy - previous_dy) * (dy - previous_dy);
+		}
+		if (i >= 1 && hypot(lagged_x - previous_x, lagged_y - previous_y) > 1.0) {
+			++moving;
+			stalls += hypot(m_cursor_x[i] - previous_cx, m_cursor_y[i] - previous_cy) < 0.5;
+		}
+		// Second difference, from the first difference of the distance
+		previous_dx = i >= 1 ? dx : 0.0;
+		previous_dy = i >= 1 ? dy : 0.0;
+		previous_x = lagged_x;
+		previous_y = lagged_y;
+		previous_cx = m_cursor_x[i];
+		previous_cy = m_cursor_y[i];
+	}
+	printf("{\"bench\":\"upsample\",\"scenario\":\"%s\",\"aim_hz\":%d,\"mode\":\"%s\",\"delay_ms\":%.1f,\"outputs\":%lu,"
+		"\"lag_ms\":%.0f,\"error_px\":%.2f,\"lagged_px\":%.2f,\"judder_px\":%.2f,\"stall_pct\":%.1f,\"max_error_px\":%.1f}\n",
+		SCENARIO_NAMES[scenario], aim_hz, MODE_NAMES[mode], delay_ms, outputs, best_lag, error / frames, best_error,
+		sqrt(judder / (frames - 2)), moving > 0 ? 100.0 * stalls / moving : 0.0, max_error);
+}
+
+int main(int argc, char** argv) {
+	int scenario = 0, mode = 0;
+	size_t rate = 0;
+	for (scenario = 0; scenario < SCENARIOS; ++scenario) {
+		for (rate = 0; rate < sizeof(AIM_HZ) / sizeof(AIM_HZ[0]); ++rate) {
+			for (mode = 0; mode < MODES; ++mode) {
+				run(scenario, AIM_HZ[rate], mode);
+			}
+		}
+	}
+	return 0;
+}
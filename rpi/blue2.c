@@ -1,42 +1,66 @@
 #include <linux/uinput.h>
 #include <fcntl.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
 #include <signal.h>
 #include <errno.h>
 #include <string.h>
 #include <glib.h>
+#include <glib-unix.h>
 #include <pthread.h>
 #include <assert.h>
 #include <SDL2/SDL.h>
 #include <SDL2/SDL_ttf.h>
 #include <SDL2/SDL_image.h>
-#include "gattlib.h"
+#include "protocol.h"
+#include "framer.h"
+#include "trace.h"
+#include "transport.h"
+#include "stats.h"
+#include "report.h"
+#include "sprite.h"
+#include "calib.h"
+#include "filter.h"
+#include "queue.h"
+#include "session.h"
+#include "shot.h"
+#include "rt.h"
+#include "telemetry.h"
+#include "gun.h"
+#include "log.h"
 #define _USE_MATH_DEFINES
 #include <math.h>
 
 sig_atomic_t EXIT_REQUESTED = 0;
-timer_t timer_id = 0;
-const int EXPIRE_S = 15;
-#define COMMAND_SIZE 30U
-const int INIT_SEQUENCE = 1;
-const int STAB_SEQUENCE = 2;
-const int CALIBRATION_SEQUENCE = 3;
-const int GAME_SEQUENCE = 4;
+// Link health check period
+const int WATCHDOG_MS = 100;
+// Where frames are processed : a router thread woken by a condvar, directly
+// in the notification callback, or from an eventfd source of the GLib loop
+const int ROUTER_THREAD = 0;
+const int ROUTER_INLINE = 1;
+const int ROUTER_EVENTFD = 2;
 const double DEG_TO_RAD = M_PI / 180.0;
-
-typedef struct node {
-    char cmd[COMMAND_SIZE];
-    struct node *next;
-} node_t;
-
-FILE* DEBUG = 0;
-#define PRINT(f_, ...) fprintf(DEBUG, (f_), ##__VA_ARGS__);fflush(DEBUG);
+// Screen used when replaying a trace without display
+const int HEADLESS_WIDTH = 1920;
+const int HEADLESS_HEIGHT = 1080;
+// Delay between connection attempts, doubled after each failure
+const int RETRY_MIN_MS = 100;
+const int RETRY_MAX_MS = 5000;
+// Scan duration, and poll of the scan results while a gun is missing
+const int SCAN_S = 2;
+const int SCAN_POLL_MS = 500;
+// Init screen duration
+const int INIT_S = 5;
+
+// Asynchronous log, the per frame traces need -DLOG_LEVEL=0
+#define PRINT(...) LOG(LOG_INFO, __VA_ARGS__)
+#define TRACE(...) LOG(LOG_DEBUG, __VA_ARGS__)
+#define WARN(...) LOG(LOG_WARN, __VA_ARGS__)
 
 static GMainLoop *m_main_loop = NULL;
 static pthread_mutex_t m_cond_mutex = PTHREAD_MUTEX_INITIALIZER;
 static pthread_cond_t m_condition = PTHREAD_COND_INITIALIZER;
 static int m_signaled = 0;
-static pthread_mutex_t m_queue_mutex = PTHREAD_MUTEX_INITIALIZER;
-static node_t* m_queue = NULL;
 static int m_screen_width, m_screen_height;
 static SDL_Rect m_text_rect;
 static SDL_Rect m_spin_rect;
@@ -50,55 +74,107 @@ static SDL_Surface* m_count_surface = NULL;
 static SDL_Texture* m_count_texture = NULL;
 static SDL_Surface* m_spin_surface = NULL;
 static SDL_Texture* m_spin_texture = NULL;
-static int m_calib_point = 0;
-static double m_yaw[9], m_pitch[9], m_roll[9]; 
-static double m_middle_x = 0.0, m_left = 0.0, m_right = 0.0;
-static double m_middle_y = 0.0, m_up = 0.0, m_down = 0.0;
-static double m_deg_to_pixel_x1 = 0.0, m_deg_to_pixel_x2 = 0.0, m_deg_to_pixel_y1 = 0.0, m_deg_to_pixel_y2 = 0.0;
-static double m_range_x = 0.0, m_elevation_y = 0.0;
-static gatt_connection_t* m_connection = NULL;
-
-void enqueue(node_t **head, const void* data, size_t data_length) {
-    node_t *new_node = malloc(sizeof(node_t));
-    if (!new_node) return;
-	memset(new_node->cmd, 0, COMMAND_SIZE);
-	memcpy(new_node->cmd, data, data_length);
-    new_node->next = *head;
-    *head = new_node;
-}
-
-void dequeue(node_t **head, char cmd[COMMAND_SIZE]) {
-    node_t *current, *prev = NULL;
-    if (*head == NULL) return;
-    current = *head;
-    while (current->next != NULL) {
-        prev = current;
-        current = current->next;
-    }
-	strncpy(cmd, current->cmd, COMMAND_SIZE);
-    free(current);
-    if (prev)
-        prev->next = NULL;
-    else
-        *head = NULL;
+static SDL_Surface* m_target_surface = NULL;
+static SDL_Texture* m_target_texture = NULL;
+static SDL_Rect m_target_rects[SPRITE_TARGETS];
+// Countdown from 5 to 15 in a row of 96 px frames, spinner 4x4 frames of 400 px
+#define COUNT_FRAMES 11
+#define SPIN_FRAMES 16
+static SDL_Rect m_count_frames[COUNT_FRAMES];
+static SDL_Rect m_spin_frames[SPIN_FRAMES];
+// Persistent IHM thread, phases are switched with m_ihm_event. The surfaces
+// are loaded once, the window only exists during the init, stab and
+// calibration phases.
+const Uint32 IHM_FRAME_MS = 16;
+static SDL_Window* m_ihm_window = NULL;
+static SDL_Renderer* m_ihm_renderer = NULL;
+static int m_ihm_video = 0;
+static pthread_t m_thread_ihm;
+static int m_ihm_started = 0;
+static Uint32 m_ihm_event = 0;
+static pthread_mutex_t m_ihm_mutex = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t m_ihm_ready = PTHREAD_COND_INITIALIZER;
+static int m_ihm_loaded = 0;
+static int m_calib_model = CALIB_QUADRATIC;
+// Aim filter, and prediction ahead of the samples in ms, plus the measured
+// notification to emit latency when auto
+static int m_filter_type = FILTER_ONE_EURO;
+static double m_predict_ms = 0.0;
+static int m_predict_auto = 0;
+// Aim frames between two readings of the measured latency
+const unsigned long PREDICT_UPDATE = 64;
+// Cursor output rate in Hz, 0 to move it on each aim frame, and the delay
+// of the shown aim in ms. The display rate is read from SDL.
+static double m_output_hz = 0.0;
+static double m_output_delay_ms = 0.0;
+static int m_output_display = 0;
+static int m_refresh_hz = 60;
+// Real time profile of the notification and router threads, see -R
+static rt_t m_rt;
+static int m_rt_enabled = 0;
+// Stored calibrations, NULL to always calibrate
+static const char* m_calib_path = "blue-calibration.txt";
+// Latest state of the guns in shared memory, NULL for none
+static const char* m_telemetry_name = TELEMETRY_NAME;
+static telemetry_t m_telemetry;
+// Guns found by the scanner thread, NULL when the addresses are given
+static const char* m_scan_filter = NULL;
+static pthread_mutex_t m_scan_mutex = PTHREAD_MUTEX_INITIALIZER;
+static char m_discovered[GUN_MAX][TRANSPORT_ADDRESS];
+static int m_discovered_count = 0;
+static atomic_int m_scan_wanted;
+// Aim frames checked against a stored calibration before trusting it
+const int CALIB_CHECK_FRAMES = 25;
+static gun_t m_guns[GUN_MAX];
+static int m_gun_count = 0;
+static int m_headless = 0;
+static const char* m_stats_path = "/tmp/blue-stats.txt";
+static int m_stats_interval = 10;
+// How long the trigger stays pressed
+static int m_hold_ms = 20;
+// Retry of a release uinput could not take
+const int RELEASE_RETRY_MS = 4;
+static int m_router = ROUTER_THREAD;
+static int m_event_fd = -1;
+static atomic_int m_event_pending;
+// What the IHM shows, see ihm_update()
+static int m_ihm_mode = 0;
+static int m_ihm_point = 0;
+
+void init_event() {
+	pthread_condattr_t attr;
+	pthread_condattr_init(&attr);
+	pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+	pthread_cond_init(&m_condition, &attr);
+	pthread_condattr_destroy(&attr);
 }
 
-double average3(double val1, double val2, double val3) {
-	double a = val1 + val2 + val3;
-	return (a / 3.);
-}
-
-void wait_for_event() {
+// Wait for a frame, or until deadline_ns on the monotonic clock when not 0
+void wait_for_event(uint64_t deadline_ns) {
+	struct timespec deadline = { deadline_ns / 1000000000U, deadline_ns % 1000000000U };
     pthread_mutex_lock(&m_cond_mutex);
     while (!m_signaled)
     {
-        pthread_cond_wait(&m_condition, &m_cond_mutex);
+		if (deadline_ns == 0) {
+			pthread_cond_wait(&m_condition, &m_cond_mutex);
+		}
+		else if (pthread_cond_timedwait(&m_condition, &m_cond_mutex, &deadline) == ETIMEDOUT) {
+			break;
+		}
     }
     m_signaled = 0;
     pthread_mutex_unlock(&m_cond_mutex);
 }
 
 void event() {
+	if (m_router == ROUTER_EVENTFD) {
+		// One wakeup for all the frames received until the router runs
+		if (!atomic_exchange(&m_event_pending, 1)) {
+			const uint64_t one = 1;
+			write(m_event_fd, &one, sizeof(one));
+		}
+		return;
+	}
     pthread_mutex_lock(&m_cond_mutex);
     m_signaled = 1;
 	pthread_cond_signal(&m_condition);
@@ -114,23 +190,20 @@ void signal_handler(int signum) {
 	event();
 }
 
-void emit(int fd, int type, int code, int val) {
-   struct input_event ie;
-
-   ie.type = type;
-   ie.code = code;
-   ie.value = val;
-   /* timestamp values below are ignored */
-   ie.time.tv_sec = 0;
-   ie.time.tv_usec = 0;
-
-   write(fd, &ie, sizeof(ie));
+// The first gun keeps the historical name
+void mouse_name(int index, char* name, size_t size) {
+	if (index == 0) {
+		snprintf(name, size, "Virtual mouse");
+	}
+	else {
+		snprintf(name, size, "Virtual mouse %d", index + 1);
+	}
 }
 
-int create_mouse() {
+int create_mouse(int index) {
 	int fd = open("/dev/uinput", O_WRONLY | O_NONBLOCK);
 	if (fd == -1) {
-		PRINT("Fail to open input interface.\n");
+		WARN("Fail to open input interface.\n");
 	}
  	else {
 		// enable synchronization
@@ -171,8 +244,8 @@ int create_mouse() {
 			memset(&usetup, 0, sizeof(usetup));
 			usetup.id.bustype = BUS_USB;
 			usetup.id.vendor = 0x1234; /* sample vendor */
-			usetup.id.product = 0x5678; /* sample product */
-			strcpy(usetup.name, "Virtual mouse");
+			usetup.id.product = 0x5678 + index; /* sample product */
+			mouse_name(index, usetup.name, UINPUT_MAX_NAME_SIZE);
             usetup.id.version = 1;
             usetup.ff_effects_max = 0;
 			ret = ioctl(fd, UI_DEV_SETUP, &usetup); 
@@ -183,8 +256,8 @@ int create_mouse() {
 			memset(&uud, 0, sizeof(uud));
 			uud.id.bustype = BUS_USB;
 			uud.id.vendor  = 0x1234;
-			uud.id.product = 0x5678;
-			snprintf(uud.name, UINPUT_MAX_NAME_SIZE, "Virtual mouse");
+			uud.id.product = 0x5678 + index;
+			mouse_name(index, uud.name, UINPUT_MAX_NAME_SIZE);
             uud.id.version = 1;
             uud.ff_effects_max = 0;
 			uud.absmin[ABS_X] = 0;
@@ -202,7 +275,7 @@ int create_mouse() {
 
 		ret = ioctl(fd, UI_DEV_CREATE);
 		if (ret == -1) {
-			PRINT("Fail to create mouse device.\n");
+			WARN("Fail to create mouse device.\n");
 		}
 	}
 	return fd;
@@ -213,93 +286,82 @@ void release_device(int fd) {
 	close(fd);
 }
 
-void timer_handler( int sig, siginfo_t *si, void *uc ) {
-    timer_t *tidp;
-    tidp = si->si_value.sival_ptr;
-
-    if ( *tidp == timer_id )
- 	{
-		PRINT("No signal\n");
-		if (m_main_loop != NULL) {
-			g_main_loop_quit(m_main_loop);
-		}
-	}
+int ihm_drawn(int mode) {
+	return mode == INIT_SEQUENCE || mode == STAB_SEQUENCE || mode == CALIBRATION_SEQUENCE;
 }
 
-void arm_timer() {
-    struct itimerspec       its;
-
-	its.it_interval.tv_sec = 0;
-	its.it_interval.tv_nsec = 0;
-	its.it_value.tv_sec = EXPIRE_S;
-	its.it_value.tv_nsec = 0;
-	if (timer_settime(timer_id, 0, &its, NULL) != 0) {
-		PRINT("Failed to set timer : %s.\n", strerror(errno));	
+// Window, renderer and textures of the screens, on the Pi SDL_HideWindow
+// leaves the dispmanx layer or the DRM master over the emulator
+int ihm_open() {
+	if (SDL_InitSubSystem(SDL_INIT_VIDEO) != 0) {
+		WARN("Unable to initialize SDL video: %s\n", SDL_GetError());
+		return 0;
+	}
+	m_ihm_video = 1;
+	m_ihm_window = SDL_CreateWindow("Window", 0, 0, 0, 0, SDL_WINDOW_FULLSCREEN_DESKTOP);
+	if (m_ihm_window != NULL) {
+		m_ihm_renderer = SDL_CreateRenderer(m_ihm_window, -1, SDL_RENDERER_ACCELERATED | SDL_RENDERER_PRESENTVSYNC);
 	}
+	if (m_ihm_renderer == NULL) {
+		WARN("Unable to create the IHM window: %s\n", SDL_GetError());
+		return 0;
+	}
+	m_init_message = SDL_CreateTextureFromSurface(m_ihm_renderer, m_init_surface);
+	m_stab_message = SDL_CreateTextureFromSurface(m_ihm_renderer, m_stab_surface);
+	m_count_texture = SDL_CreateTextureFromSurface(m_ihm_renderer, m_count_surface);
+	m_spin_texture = SDL_CreateTextureFromSurface(m_ihm_renderer, m_spin_surface);
+	m_target_texture = sprite_upload(m_ihm_renderer, m_target_surface);
+	return 1;
 }
 
-void make_timer() {
-    struct sigevent         te;
-    struct sigaction        sa;
-    int                     sig_no = SIGRTMIN;
-
-    /* Set up signal handler. */
-    sa.sa_flags = SA_SIGINFO;
-    sa.sa_sigaction = timer_handler;
-    sigemptyset(&sa.sa_mask);
-    if (sigaction(sig_no, &sa, NULL) == 0)
-	{
-		/* Set and enable alarm */
-		te.sigev_notify = SIGEV_SIGNAL;
-		te.sigev_signo = sig_no;
-		te.sigev_value.sival_ptr = &timer_id;
-		if (timer_create(CLOCK_REALTIME, &te, &timer_id) == 0) {
-			arm_timer();
-		}
-		else {
-			PRINT("Failed to create timer.\n");	
-		}
+void ihm_destroy_texture(SDL_Texture** texture) {
+	if (*texture) {
+		SDL_DestroyTexture(*texture);
+		*texture = NULL;
 	}
-	else {
-        PRINT("Failed to setup timer.\n");
-    }
 }
 
-void ihm_fill_circle(SDL_Renderer *surface, int cx, int cy, int radius, int lc, int border, Uint8 r, Uint8 g, Uint8 b, Uint8 a) {
-    double dyo = 1;
-	for (dyo = 1; dyo <= radius; dyo += 1.0)
-	{
-		double dxo = floor(sqrt((2.0 * radius * dyo) - (dyo * dyo)));
-		SDL_SetRenderDrawColor(surface, r, g, b, a);
-		if (dyo > border)
-		{
-			SDL_RenderDrawLine(surface, cx - dxo, cy + dyo - radius, cx - dxo + border, cy + dyo - radius);
-			SDL_RenderDrawLine(surface, cx + dxo - border, cy + dyo - radius, cx + dxo, cy + dyo - radius);
-			SDL_RenderDrawLine(surface, cx - dxo, cy - dyo + radius, cx - dxo + border, cy - dyo + radius);
-			SDL_RenderDrawLine(surface, cx + dxo - border, cy - dyo + radius, cx + dxo, cy - dyo + radius);
-		}
-		else
-		{
-			SDL_RenderDrawLine(surface, cx - dxo, cy + dyo - radius, cx + dxo, cy + dyo - radius);
-			SDL_RenderDrawLine(surface, cx - dxo, cy - dyo + radius, cx + dxo, cy - dyo + radius);
-		}
+// Back to the emulator screen, as SDL_Quit() did before the game
+void ihm_close() {
+	ihm_destroy_texture(&m_target_texture);
+	ihm_destroy_texture(&m_spin_texture);
+	ihm_destroy_texture(&m_count_texture);
+	ihm_destroy_texture(&m_stab_message);
+	ihm_destroy_texture(&m_init_message);
+	if (m_ihm_renderer) {
+		SDL_DestroyRenderer(m_ihm_renderer);
+		m_ihm_renderer = NULL;
 	}
-	double dc = 0;
-	for (dc = 0; dc < border/2; dc += 1.0)
-	{
-		SDL_RenderDrawLine(surface, cx - dc, cy - lc, cx - dc, cy + lc);
-		SDL_RenderDrawLine(surface, cx + dc, cy - lc, cx + dc, cy + lc);
-		SDL_RenderDrawLine(surface, cx - lc, cy - dc, cx + lc, cy - dc);
-		SDL_RenderDrawLine(surface, cx - lc, cy + dc, cx + lc, cy + dc);
+	if (m_ihm_window) {
+		SDL_DestroyWindow(m_ihm_window);
+		m_ihm_window = NULL;
+	}
+	if (m_ihm_video) {
+		SDL_QuitSubSystem(SDL_INIT_VIDEO);
+		m_ihm_video = 0;
 	}
 }
 
-void ihm_get_event(int* running, char* point) {
+void ihm_get_event(int* running, int* mode, char* point, Uint32* switch_ticks) {
 	SDL_Event event;
 	while (SDL_PollEvent(&event)) {
 		if (event.type == SDL_QUIT) {
 			*running = 0;
 		}
+		else if (event.type == m_ihm_event) {
+			*mode = event.user.code;
+			*switch_ticks = (Uint32)(uintptr_t)event.user.data1;
+			*point = SDLK_0;
+			// The game runs on the emulator screen
+			if (ihm_drawn(*mode) && !m_ihm_video) {
+				if (!ihm_open()) {
+					ihm_close();
+				}
+			}
+			else if (!ihm_drawn(*mode)) {
+				ihm_close();
+			}
+		}
 		else if (event.type == SDL_KEYDOWN) {
 			if ((event.key.keysym.sym >= SDLK_0) && 
 				(event.key.keysym.sym <= SDLK_8))
@@ -310,7 +372,7 @@ void ihm_get_event(int* running, char* point) {
 	}
 }
 
-void ihm_text_messages(SDL_Renderer* renderer, int mode) {
+void ihm_text_messages() {
 	const SDL_Color white = {255, 255, 255}; 
 	const int message_width = 800;
 	const int message_height = 100;
@@ -320,18 +382,11 @@ void ihm_text_messages(SDL_Renderer* renderer, int mode) {
 	m_text_rect.w = message_width;
 	m_text_rect.h = message_height;
 
-	if (mode == INIT_SEQUENCE) {
-		m_init_surface = TTF_RenderText_Solid(m_font, "Poser le pistolet pour l'initialisation", white);
-		m_init_message = SDL_CreateTextureFromSurface(renderer, m_init_surface);
-	}
-
-	if (mode == STAB_SEQUENCE) {
-		m_stab_surface = TTF_RenderText_Solid(m_font, "Orienter le pistolet en X, Y et Z", white);
-		m_stab_message = SDL_CreateTextureFromSurface(renderer, m_stab_surface);
-	}
+	m_init_surface = TTF_RenderText_Solid(m_font, "Poser le pistolet pour l'initialisation", white);
+	m_stab_surface = TTF_RenderText_Solid(m_font, "Orienter le pistolet en X, Y et Z", white);
 }
 
-void ihm_count(SDL_Renderer* renderer, int mode) {
+void ihm_count() {
 	const int message_width = 80;
  	const int message_height = 100;
 	m_count_rect.x = (m_screen_width - message_width) / 2;
@@ -339,13 +394,11 @@ void ihm_count(SDL_Renderer* renderer, int mode) {
 	m_count_rect.w = message_width;
 	m_count_rect.h = message_height;
 
-	if (mode == INIT_SEQUENCE) {
-    	m_count_surface = IMG_Load("countdown.png");
-    	m_count_texture = SDL_CreateTextureFromSurface(renderer, m_count_surface);
-	}
+	m_count_surface = IMG_Load("countdown.png");
+	sprite_sheet_rects(m_count_frames, COUNT_FRAMES, 5, 16, 96);
 }
 
-void ihm_spin(SDL_Renderer* renderer, int mode) {
+void ihm_spin() {
 	const int message_width = 100;
  	const int message_height = 100;
 	m_spin_rect.x = (m_screen_width - message_width) / 2;
@@ -353,45 +406,29 @@ void ihm_spin(SDL_Renderer* renderer, int mode) {
 	m_spin_rect.w = message_width;
 	m_spin_rect.h = message_height;
 
-	if (mode == STAB_SEQUENCE) {
-    	m_spin_surface = IMG_Load("circles.png");
-    	m_spin_texture = SDL_CreateTextureFromSurface(renderer, m_spin_surface);
+	m_spin_surface = IMG_Load("circles.png");
+	sprite_sheet_rects(m_spin_frames, SPIN_FRAMES, 0, 4, 400);
+}
+
+void ihm_targets() {
+	m_target_surface = sprite_target_surface(SPRITE_TARGET_RADIUS, SPRITE_TARGET_CROSS, SPRITE_TARGET_BORDER, 255, 255, 255, 255);
+	sprite_target_rects(m_screen_width, m_screen_height, SPRITE_TARGET_RADIUS, m_target_rects);
+}
+
+void ihm_free_surface(SDL_Surface** surface) {
+	if (*surface) {
+		SDL_FreeSurface(*surface);
+		*surface = NULL;
 	}
 }
 
 void ihm_clean() {
-	if (m_spin_texture) {
-		SDL_DestroyTexture(m_spin_texture);
-		m_spin_texture = NULL;
-	}
-	if (m_spin_surface) {
-		SDL_FreeSurface(m_spin_surface);
-		m_spin_surface = NULL;
-	}
-	if (m_count_texture) {
-		SDL_DestroyTexture(m_count_texture);
-		m_count_texture = NULL;
-	}
-	if (m_count_surface) {
-		SDL_FreeSurface(m_count_surface);
-		m_count_surface = NULL;
-	}
-	if (m_stab_message) {
-		SDL_DestroyTexture(m_stab_message);
-		m_stab_message = NULL;
-	}
-	if (m_stab_surface) {
-		SDL_FreeSurface(m_stab_surface);
-		m_stab_surface = NULL;
-	}
-	if (m_init_message) { 
-		SDL_DestroyTexture(m_init_message);
-		m_init_message = NULL;
-	}
-	if (m_init_surface) {
-		SDL_FreeSurface(m_init_surface);
-		m_init_surface = NULL;
-	}
+	ihm_close();
+	ihm_free_surface(&m_target_surface);
+	ihm_free_surface(&m_spin_surface);
+	ihm_free_surface(&m_count_surface);
+	ihm_free_surface(&m_stab_surface);
+	ihm_free_surface(&m_init_surface);
 	if (m_font) {
 		TTF_CloseFont(m_font);
 		m_font = NULL;
@@ -399,82 +436,76 @@ void ihm_clean() {
 }
 
 void ihm_init_sequence(SDL_Renderer* renderer, Uint32 ticks) {
-	Uint32 seconds = ((ticks / 1000) % 11) + 5;
-	SDL_Rect srcrect = { seconds * 96, 0, 96, 96 };
-	SDL_RenderCopy(renderer, m_count_texture, &srcrect, &m_count_rect);
+	SDL_RenderCopy(renderer, m_count_texture, &m_count_frames[(ticks / 1000) % COUNT_FRAMES], &m_count_rect);
 	SDL_RenderCopy(renderer, m_init_message, NULL, &m_text_rect);
 }
 
 void ihm_stab_sequence(SDL_Renderer* renderer, Uint32 ticks) {
-	Uint32 frames = (ticks / 100) % 16;
-	Uint32 range = frames / 4;
-	Uint32 column = frames % 4;
-	SDL_Rect srcrect = { column * 400, range * 400, 400, 400 };
-	SDL_RenderCopy(renderer, m_spin_texture, &srcrect, &m_spin_rect);
+	SDL_RenderCopy(renderer, m_spin_texture, &m_spin_frames[(ticks / 100) % SPIN_FRAMES], &m_spin_rect);
 	SDL_RenderCopy(renderer, m_stab_message, NULL, &m_text_rect);		
 }
 
 void ihm_calibration_sequence(SDL_Renderer* renderer, char point) {
-	if (point == SDLK_0) {
-		ihm_fill_circle(renderer, 30, 30, 25, 10, 2, 255, 255, 255, 255);
-	}
-	else if (point == SDLK_1) {
-		ihm_fill_circle(renderer, 30, m_screen_height/2, 25, 10, 2, 255, 255, 255, 255);
-	}
-	else if (point == SDLK_2) {
-		ihm_fill_circle(renderer, 30, m_screen_height - 30, 25, 10, 2, 255, 255, 255, 255);
-	}
-	else if (point == SDLK_3) {
-		ihm_fill_circle(renderer, m_screen_width/2, m_screen_height - 30, 25, 10, 2, 255, 255, 255, 255);
-	}
-	else if (point == SDLK_4) {
-		ihm_fill_circle(renderer, m_screen_width/2, m_screen_height/2, 25, 10, 2, 255, 255, 255, 255);
-	}
-	else if (point == SDLK_5) {
-		ihm_fill_circle(renderer, m_screen_width/2, 30, 25, 10, 2, 255, 255, 255, 255);
-	}
-	else if (point == SDLK_6) {
-		ihm_fill_circle(renderer, m_screen_width - 30, 30, 25, 10, 2, 255, 255, 255, 255);
-	}
-	else if (point == SDLK_7) {
-		ihm_fill_circle(renderer, m_screen_width - 30, m_screen_height/2, 25, 10, 2, 255, 255, 255, 255);
-	}
-	else {
-		ihm_fill_circle(renderer, m_screen_width - 30, m_screen_height - 30, 25, 10, 2, 255, 255, 255, 255);
+	int index = point - SDLK_0;
+	if (index < 0 || index >= SPRITE_TARGETS) {
+		index = SPRITE_TARGETS - 1;
 	}
+	SDL_RenderCopy(renderer, m_target_texture, NULL, &m_target_rects[index]);
 }
 
 void* ihm_loop(void* arg) {
-	const int mode = *((int*)arg);
-	PRINT("MODE %d\n", mode);
-
 	// Catch CTRL-C
 	signal(SIGINT, signal_handler);
 
-	const uint32_t WindowFlags = SDL_WINDOW_FULLSCREEN_DESKTOP;
-    if (SDL_Init(SDL_INIT_VIDEO) != 0) {
-        PRINT("Unable to initialize SDL: %s", SDL_GetError());
-    }
-    if (TTF_Init() != 0) {
-        PRINT("Unable to initialize TTF: %s", TTF_GetError());
-    }
-	SDL_Window *window = SDL_CreateWindow("Window", 0, 0, 0, 0, WindowFlags);
-	SDL_Renderer* renderer = SDL_CreateRenderer(window, -1, SDL_RENDERER_ACCELERATED);
-	SDL_GetRendererOutputSize(renderer, &m_screen_width, &m_screen_height);
+	// Events for the whole run, the video only while a screen is shown
+	if (SDL_Init(SDL_INIT_EVENTS) != 0) {
+		WARN("Unable to initialize SDL: %s", SDL_GetError());
+	}
+	if (TTF_Init() != 0) {
+		WARN("Unable to initialize TTF: %s", TTF_GetError());
+	}
+	SDL_DisplayMode display;
+	if (SDL_InitSubSystem(SDL_INIT_VIDEO) == 0) {
+		if (SDL_GetDesktopDisplayMode(0, &display) == 0) {
+			m_screen_width = display.w;
+			m_screen_height = display.h;
+			if (display.refresh_rate > 0) {
+				m_refresh_hz = display.refresh_rate;
+			}
+		}
+		SDL_QuitSubSystem(SDL_INIT_VIDEO);
+	}
+	else {
+		WARN("Unable to initialize SDL video: %s", SDL_GetError());
+	}
+	m_ihm_event = SDL_RegisterEvents(1);
+
+	ihm_text_messages();
+	ihm_count();
+	ihm_spin();
+	ihm_targets();
 
-	ihm_text_messages(renderer, mode);
-	ihm_count(renderer, mode);
-	ihm_spin(renderer, mode);
+	pthread_mutex_lock(&m_ihm_mutex);
+	m_ihm_loaded = 1;
+	pthread_cond_signal(&m_ihm_ready);
+	pthread_mutex_unlock(&m_ihm_mutex);
 
 	int running = 1;
+	int mode = 0;
 	char point = SDLK_0;
+	Uint32 switch_ticks = 0;
 	while (running) {
-		ihm_get_event(&running, &point);
+		if (m_ihm_renderer == NULL) {
+			// Nothing to draw, sleep until the next phase
+			SDL_WaitEvent(NULL);
+		}
+		ihm_get_event(&running, &mode, &point, &switch_ticks);
 
-		if (running) {
+		if (running && m_ihm_renderer != NULL) {
+			SDL_Renderer* renderer = m_ihm_renderer;
+			Uint32 ticks = SDL_GetTicks();
 			SDL_SetRenderDrawColor(renderer, 0, 0, 0, 255);
 			SDL_RenderClear(renderer);
-			Uint32 ticks = SDL_GetTicks();
 
 			if (mode == INIT_SEQUENCE) {
 				ihm_init_sequence(renderer, ticks);
@@ -487,12 +518,20 @@ void* ihm_loop(void* arg) {
 			}
 			//Update screen
 			SDL_RenderPresent(renderer);
+			if (switch_ticks != 0) {
+				PRINT("IHM mode %d shown in %u ms\n", mode, SDL_GetTicks() - switch_ticks);
+				switch_ticks = 0;
+			}
+
+			// Present blocks on vsync, otherwise do not draw faster than the display
+			Uint32 elapsed = SDL_GetTicks() - ticks;
+			if (elapsed < IHM_FRAME_MS) {
+				SDL_Delay(IHM_FRAME_MS - elapsed);
+			}
 		}
 	}
 
 	ihm_clean();
-	SDL_DestroyRenderer(renderer);
-	SDL_DestroyWindow(window);
 
 	TTF_Quit();
 	SDL_Quit();
@@ -506,305 +545,1286 @@ void ihm_quit() {
 	SDL_PushEvent(&event);
 }
 
-void ble_write(char value_data) {
-	const uuid_t write_uuid = CREATE_UUID16(0xFFE1);
-	gattlib_write_char_by_uuid(m_connection, &write_uuid, &value_data, sizeof(value_data));
+// Create the IHM thread once, returns when the assets are loaded and the
+// screen size known
+void ihm_start() {
+	if (!m_headless) {
+		pthread_create(&m_thread_ihm, NULL, ihm_loop, NULL);
+		pthread_mutex_lock(&m_ihm_mutex);
+		while (!m_ihm_loaded) {
+			pthread_cond_wait(&m_ihm_ready, &m_ihm_mutex);
+		}
+		pthread_mutex_unlock(&m_ihm_mutex);
+		m_ihm_started = 1;
+	}
 }
 
-void init_sequence(pthread_t* thread_ihm, int* mode) {
-	// Create IHM thread
-	pthread_create(thread_ihm, NULL, ihm_loop, mode);
-	sleep(5);
-	ihm_quit();
-	pthread_join(*thread_ihm, NULL);
+void ihm_stop() {
+	if (m_ihm_started) {
+		ihm_quit();
+		pthread_join(m_thread_ihm, NULL);
+		m_ihm_started = 0;
+	}
+}
 
-	ble_write('Z');
+// Switch the IHM to a sequence, any other mode closes the window
+void ihm_show(int mode) {
+	if (m_ihm_started) {
+		SDL_Event sdlevent;
+		memset(&sdlevent, 0, sizeof(sdlevent));
+		sdlevent.type = m_ihm_event;
+		sdlevent.user.code = mode;
+		sdlevent.user.data1 = (void*)(uintptr_t)(SDL_GetTicks() | 1);
+		SDL_PushEvent(&sdlevent);
+	}
+}
 
-	PRINT("Wait for gyrometer stabilization\n");
-	*mode = STAB_SEQUENCE;
-	pthread_create(thread_ihm, NULL, ihm_loop, mode);
+void ihm_point(int point) {
+	if (m_ihm_started) {
+		SDL_Event sdlevent;
+		sdlevent.type = SDL_KEYDOWN;
+		sdlevent.key.keysym.sym = SDLK_0 + point;
+		SDL_PushEvent(&sdlevent);
+	}
 }
 
-void stab_sequence(char cmd[COMMAND_SIZE], pthread_t* thread_ihm, int* mode) {
-	ble_write('Y');
+gboolean ble_write_idle(gpointer user_data) {
+	const guint command = GPOINTER_TO_UINT(user_data);
+	const char value_data = (char)(command & 0xFF);
+	transport_write(&m_guns[command >> 8].transport, &value_data, sizeof(value_data));
+	return G_SOURCE_REMOVE;
+}
 
-	PRINT("Stabilization OK\n");
-	ihm_quit();
-	pthread_join(*thread_ihm, NULL);
+// The GLib loop writes the command : a gattlib write is a D-Bus round trip
+// the router must not wait for
+void ble_write(gun_t* gun, char value_data) {
+	g_idle_add_full(G_PRIORITY_DEFAULT, ble_write_idle, GUINT_TO_POINTER(gun->index << 8 | (unsigned char)value_data), NULL);
+}
 
-	PRINT("Calibration\n");
-	*mode = CALIBRATION_SEQUENCE;
-	m_calib_point = 0;
-	pthread_create(thread_ihm, NULL, ihm_loop, mode);
-}
-
-void calibration_sequence(char cmd[COMMAND_SIZE], pthread_t* thread_ihm, int* mode) {
-	if (m_calib_point < 9) {	
-		double yaw = 0.0, pitch = 0.0, roll = 0.0;
-		sscanf(cmd + 1, "%lf %lf %lf", &yaw, &pitch, &roll);
-		m_yaw[m_calib_point] = yaw;
-		m_pitch[m_calib_point] = pitch;
-		m_roll[m_calib_point] = roll;
-
-		if (m_calib_point == 8) {
-			ble_write('X');
-
-			m_middle_x = average3(m_yaw[3], m_yaw[4], m_yaw[5]);
-			m_left = average3(m_yaw[0], m_yaw[1], m_yaw[2]);
-			m_right = average3(m_yaw[6], m_yaw[7], m_yaw[8]);
-			m_up = average3(m_pitch[0], m_pitch[5], m_pitch[6]);
-			m_middle_y = average3(m_pitch[1], m_pitch[4], m_pitch[7]);
-			m_down = average3(m_pitch[2], m_pitch[3], m_pitch[8]);
-
-			m_deg_to_pixel_x1 = (m_screen_width/2 - 30) / (m_middle_x - m_left);
-			m_deg_to_pixel_x2 = (m_screen_width/2 - 30) / (m_right - m_middle_x);
-			m_deg_to_pixel_y1 = (m_screen_height/2 - 30) / (m_middle_y - m_down);
-			m_deg_to_pixel_y2 = (m_screen_height/2 - 30) / (m_up - m_middle_y);
-
-			PRINT("Parameters\n");
-			PRINT("m_screen_width : %d\n", m_screen_width);
-			PRINT("m_screen_height : %d\n", m_screen_height);
-			PRINT("m_middle_x : %lf\n", m_middle_x);
-			PRINT("m_middle_y : %lf\n", m_middle_y);
-			PRINT("m_left : %lf\n", m_left);
-			PRINT("m_right : %lf\n", m_right);
-			PRINT("m_up : %lf\n", m_up);
-			PRINT("m_down : %lf\n", m_down);
-			PRINT("m_deg_to_pixel_x1 : %lf\n", m_deg_to_pixel_x1);
-			PRINT("m_deg_to_pixel_x2 : %lf\n", m_deg_to_pixel_x2);
-			PRINT("m_deg_to_pixel_y1 : %lf\n", m_deg_to_pixel_y1);
-			PRINT("m_deg_to_pixel_y2 : %lf\n", m_deg_to_pixel_y2);
-
-			m_calib_point = 0;
-			PRINT("Calibration OK\n");
-			ihm_quit();
-			pthread_join(*thread_ihm, NULL);
-
-			PRINT("Game\n");
-			*mode = GAME_SEQUENCE;
-		}
-		else {
-			++m_calib_point;
-			SDL_Event sdlevent;
-			sdlevent.type = SDL_KEYDOWN;
-			sdlevent.key.keysym.sym = SDLK_0 + m_calib_point;
-			SDL_PushEvent(&sdlevent);
+// The display is shared : it shows the first gun that is not playing, and
+// hides when every gun plays
+void ihm_update() {
+	int mode = GAME_SEQUENCE;
+	int point = 0;
+	int i = 0;
+	for (i = 0; i < m_gun_count; ++i) {
+		const gun_t* gun = &m_guns[i];
+		const int state = gun->session.state;
+		if (state == INIT_SEQUENCE || state == STAB_SEQUENCE || state == CALIBRATION_SEQUENCE) {
+			mode = state;
+			point = gun->calib_point;
+			break;
 		}
 	}
-	else {
-		m_calib_point = 0;
+	if (mode != m_ihm_mode) {
+		ihm_show(mode);
+		m_ihm_mode = mode;
+		m_ihm_point = 0;
+	}
+	if (mode == CALIBRATION_SEQUENCE && point != m_ihm_point) {
+		ihm_point(point);
+		m_ihm_point = point;
 	}
 }
 
-void angle_to_screen(double yaw, double pitch, double roll, int* x, int* y) {
-	double pixel_x = 0.0;
-	double pixel_y = 0.0;
-	if (yaw < m_middle_x) {
-		pixel_x = m_screen_width/2 - (m_middle_x - yaw) * m_deg_to_pixel_x1;
+// Session actions, the transitions are in session.c
+
+void init_enter(session_t* session, const message_t* msg) {
+	gun_t* gun = session->user_data;
+	PRINT("Gun %d start initialization sequence\n", gun->index);
+	// The init screen stays up without blocking the other guns
+	session_timer(session, stats_now_ns() + (m_headless ? 0 : INIT_S * 1000000000ULL));
+}
+
+void stab_enter(session_t* session, const message_t* msg) {
+	gun_t* gun = session->user_data;
+	ble_write(gun, 'Z');
+	PRINT("Gun %d wait for gyrometer stabilization\n", gun->index);
+}
+
+void calibration_enter(session_t* session, const message_t* msg) {
+	gun_t* gun = session->user_data;
+	ble_write(gun, 'Y');
+	PRINT("Gun %d stabilization OK\n", gun->index);
+	PRINT("Calibration\n");
+	gun->calib_point = 0;
+}
+
+void game_enter(session_t* session, const message_t* msg) {
+	gun_t* gun = session->user_data;
+	ble_write(gun, 'X');
+	PRINT("Game\n");
+	filter_reset(&gun->filter);
+	shot_init(&gun->shot);
+	upsample_init(&gun->upsample, m_output_hz, m_output_delay_ms);
+	gun->upsample_received_ns = 0;
+}
+
+// Calibration handed to the GLib loop, owned by the idle source
+typedef struct calib_save {
+	calib_t calib;
+	char address[TRANSPORT_ADDRESS];
+} calib_save_t;
+
+gboolean calib_save_idle(gpointer user_data) {
+	const calib_save_t* save = user_data;
+	if (!calib_save(&save->calib, m_calib_path, save->address)) {
+		WARN("Fail to save calibration in %s\n", m_calib_path);
 	}
-	else {
-		pixel_x = m_screen_width/2 + (yaw - m_middle_x) * m_deg_to_pixel_x2;
+	return G_SOURCE_REMOVE;
+}
+
+void calibration_point(session_t* session, const message_t* msg) {
+	gun_t* gun = session->user_data;
+	calib_t* calib = &gun->calib;
+	gun->yaw[gun->calib_point] = msg->yaw / 100.0;
+	gun->pitch[gun->calib_point] = msg->pitch / 100.0;
+	gun->roll[gun->calib_point] = msg->roll / 100.0;
+	if (++gun->calib_point < CALIB_POINTS) {
+		return;
+	}
+
+	// The targets drawn by the IHM
+	SDL_Rect rects[CALIB_POINTS];
+	double target_x[CALIB_POINTS], target_y[CALIB_POINTS];
+	int i = 0;
+	sprite_target_rects(m_screen_width, m_screen_height, SPRITE_TARGET_RADIUS, rects);
+	for (i = 0; i < CALIB_POINTS; ++i) {
+		target_x[i] = rects[i].x + SPRITE_TARGET_RADIUS;
+		target_y[i] = rects[i].y + SPRITE_TARGET_RADIUS;
+	}
+	if (!calib_solve(calib, m_calib_model, m_screen_width, m_screen_height, gun->yaw, gun->pitch, gun->roll, target_x, target_y)) {
+		PRINT("Calibration fit failed, piecewise model\n");
+		calib_solve(calib, CALIB_PIECEWISE, m_screen_width, m_screen_height, gun->yaw, gun->pitch, gun->roll, target_x, target_y);
+	}
+
+	PRINT("Gun %d parameters\n", gun->index);
+	PRINT("m_screen_width : %d\n", m_screen_width);
+	PRINT("m_screen_height : %d\n", m_screen_height);
+	PRINT("model : %d\n", calib->model);
+	PRINT("x : %lf %lf %lf %lf %lf %lf %lf\n", calib->x[0], calib->x[1], calib->x[2], calib->x[3], calib->x[4], calib->x[5], calib->x[6]);
+	PRINT("y : %lf %lf %lf %lf %lf %lf %lf\n", calib->y[0], calib->y[1], calib->y[2], calib->y[3], calib->y[4], calib->y[5], calib->y[6]);
+	PRINT("residual : %.1f px rms, %.1f px max\n", calib->residual, calib->residual_max);
+	if (m_calib_path != NULL) {
+		// Written by the GLib loop, the SD card may stall. The router may
+		// calibrate again before, so the loop gets its own copy.
+		calib_save_t* save = g_new(calib_save_t, 1);
+		save->calib = *calib;
+		memcpy(save->address, gun->address, sizeof(save->address));
+		g_idle_add_full(G_PRIORITY_DEFAULT_IDLE, calib_save_idle, save, g_free);
+	}
+
+	gun->calib_point = 0;
+	gun->calibrated = 1;
+	PRINT("Calibration OK\n");
+	session_post(session, EVENT_CALIBRATED);
+}
+
+void angle_to_screen(const gun_t* gun, double yaw, double pitch, double roll, int* x, int* y) {
+	calib_to_screen(&gun->calib, yaw, pitch, roll, x, y);
+}
+
+// Smoothed and predicted angles of a game frame
+void aim_filter(gun_t* gun, const message_t* msg, double* yaw, double* pitch) {
+	if (m_predict_auto && gun->filter_samples++ % PREDICT_UPDATE == 0) {
+		const uint64_t latency = histogram_percentile(&gun->stats.stages[STAGE_TOTAL], 50.0);
+		gun->filter.predict_s = m_predict_ms / 1000.0 + latency / 1e9;
 	}
-	if (pitch < m_middle_y) {
-		pixel_y = m_screen_height/2 + (m_middle_y - pitch) * m_deg_to_pixel_y1;
+	filter_update(&gun->filter, msg->received_ns, msg->yaw / 100.0, msg->pitch / 100.0, yaw, pitch);
+}
+
+
+// Negotiate the wire format, old firmware only speaks ASCII. Skip the
+// calibration when this gun was calibrated on this screen, during this run
+// or a previous one.
+void hello_action(session_t* session, const message_t* msg) {
+	gun_t* gun = session->user_data;
+	if (msg->seq >= PROTOCOL_BINARY) {
+		ble_write(gun, PROTOCOL_BINARY_ACK);
+		gun->protocol = msg->seq >= PROTOCOL_SHOT_TIME ? PROTOCOL_SHOT_TIME : PROTOCOL_BINARY;
 	}
 	else {
-		pixel_y = m_screen_height/2 - (pitch - m_middle_y) * m_deg_to_pixel_y2;
+		gun->protocol = PROTOCOL_ASCII;
+	}
+	PRINT("Gun %d protocol %d\n", gun->index, gun->protocol);
+	if (gun->calibrated) {
+		PRINT("Gun %d calibration kept across reconnection\n", gun->index);
+		session_post(session, EVENT_RESUME);
+	}
+	else if (m_calib_path != NULL && calib_load(&gun->calib, m_calib_path, gun->address, m_screen_width, m_screen_height)) {
+		PRINT("Gun %d stored calibration, model %d, residual %.1f px rms\n", gun->index, gun->calib.model, gun->calib.residual);
+		gun->calibrated = 1;
+		session_post(session, EVENT_RESUME);
 	}
+}
+
+void resume_action(session_t* session, const message_t* msg) {
+	gun_t* gun = session->user_data;
+	gun->check_frames = CALIB_CHECK_FRAMES;
+	gun->check_plausible = 0;
+}
 
-    *x = (pixel_x / m_screen_width) * UINT16_MAX;
-	if (*x < 0) *x = 0;
-	if (*x > UINT16_MAX) *x = UINT16_MAX;
+// The first aim frames after a resume must fall in the calibrated range,
+// otherwise calibrate again
+void check_sequence(gun_t* gun, const message_t* msg) {
+	gun->check_plausible += calib_plausible(&gun->calib, msg->yaw / 100.0, msg->pitch / 100.0);
+	if (--gun->check_frames == 0) {
+		if (gun->check_plausible < CALIB_CHECK_FRAMES / 2) {
+			PRINT("Gun %d stored calibration rejected, %d/%d plausible frames\n", gun->index, gun->check_plausible, CALIB_CHECK_FRAMES);
+			gun->calibrated = 0;
+			session_post(&gun->session, EVENT_REJECTED);
+		}
+		else {
+			PRINT("Gun %d stored calibration checked\n", gun->index);
+		}
+	}
+}
 
-    *y = (pixel_y / m_screen_height) * UINT16_MAX;
-	if (*y < 0) *y = 0;
-	if (*y > UINT16_MAX) *y = UINT16_MAX;
+// Latency of the mapping and the uinput report of a game frame
+void report_stages(gun_t* gun, const message_t* msg, uint64_t dequeued_ns, uint64_t mapped_ns) {
+	const uint64_t emitted_ns = stats_now_ns();
+	if (gun->connected_ns != 0) {
+		PRINT("Gun %d first report %.1f ms after connection\n", gun->index, (emitted_ns - gun->connected_ns) / 1e6);
+		gun->connected_ns = 0;
+	}
+	stats_stage(&gun->stats, STAGE_MAPPING, dequeued_ns, mapped_ns);
+	stats_stage(&gun->stats, STAGE_EMIT, mapped_ns, emitted_ns);
+	stats_stage(&gun->stats, STAGE_TOTAL, msg->received_ns, emitted_ns);
+	stats_report(&gun->stats);
 }
 
-void game_sequence(char cmd[COMMAND_SIZE], int fd) {
-	double yaw = 0.0, pitch = 0.0, roll = 0.0;
-	sscanf(cmd + 1, "%lf %lf %lf", &yaw, &pitch, &roll);
+// Latest state for the overlays and emulator plugins, only the thread
+// routing the gun writes it
+void gun_publish(gun_t* gun) {
+	gun->telemetry.health = atomic_load(&gun->health.state);
+	gun->telemetry.session = gun->session.state;
+	telemetry_publish(&m_telemetry, gun->index, &gun->telemetry);
+}
 
-	int x = 0, y = 0;
-	angle_to_screen(yaw, pitch, roll, &x, &y);
+void gun_pose(gun_t* gun, const message_t* msg) {
+	gun->telemetry.time_ns = msg->received_ns;
+	gun->telemetry.yaw = msg->yaw / 100.0f;
+	gun->telemetry.pitch = msg->pitch / 100.0f;
+	gun->telemetry.roll = msg->roll / 100.0f;
+}
+
+void release_trigger(gun_t* gun) {
+	report_button(&gun->report, 0);
+	// Kept due until uinput takes it, the next aim frame also resends it
+	if (!report_submit(&gun->report)) {
+		gun->release_ns = stats_now_ns() + RELEASE_RETRY_MS * 1000000ULL;
+		return;
+	}
+	gun->release_ns = 0;
+	gun->telemetry.trigger = 0;
+	gun_publish(gun);
+}
 
-	emit(fd, EV_KEY, BTN_LEFT, 1);
-	emit(fd, EV_ABS, ABS_X, x);
-	emit(fd, EV_ABS, ABS_Y, y);
-	emit(fd, EV_SYN, SYN_REPORT, 0);
-	usleep(20000);
-	emit(fd, EV_KEY, BTN_LEFT, 0);
-	emit(fd, EV_ABS, ABS_X, x);
-	emit(fd, EV_ABS, ABS_Y, y);
-	emit(fd, EV_SYN, SYN_REPORT, 0);
+// Release the trigger once its hold time is over
+void release_pending(gun_t* gun) {
+	if (gun->release_ns != 0 && stats_now_ns() >= gun->release_ns) {
+		release_trigger(gun);
+	}
 }
 
-void aim_sequence(char cmd[COMMAND_SIZE], int fd) {
+// Move a shot from the aim at processing time to the aim at the trigger edge
+void reconcile_shot(gun_t* gun, const message_t* msg, int* x, int* y) {
 	double yaw = 0.0, pitch = 0.0, roll = 0.0;
-	sscanf(cmd + 1, "%lf %lf %lf", &yaw, &pitch, &roll);
+	uint64_t delay_ns = 0;
+	int shot_x = 0, shot_y = 0;
+	if (!shot_reconcile(&gun->shot, msg, &yaw, &pitch, &roll, &delay_ns)) {
+		return;
+	}
+	angle_to_screen(gun, yaw, pitch, roll, &shot_x, &shot_y);
+	// Absolute axis units to screen pixels
+	const double shift = hypot((double)(shot_x - *x) * gun->calib.width / UINT16_MAX,
+		(double)(shot_y - *y) * gun->calib.height / UINT16_MAX);
+	histogram_record(&gun->stats.shot_shift, (uint64_t)lround(shift));
+	histogram_record(&gun->stats.shot_delay, delay_ns);
+	TRACE("Gun %d shot %d %d moved %.1f px, trigger %.1f ms ago\n", gun->index, shot_x, shot_y, shift, delay_ns / 1e6);
+	*x = shot_x;
+	*y = shot_y;
+}
+
+void game_sequence(gun_t* gun, const message_t* msg, uint64_t dequeued_ns) {
+	report_t* report = &gun->report;
+	double yaw = 0.0, pitch = 0.0;
+	int x = 0, y = 0;
+	aim_filter(gun, msg, &yaw, &pitch);
+	angle_to_screen(gun, yaw, pitch, msg->roll / 100.0, &x, &y);
+	if (gun->protocol >= PROTOCOL_SHOT_TIME) {
+		reconcile_shot(gun, msg, &x, &y);
+	}
+	const uint64_t mapped_ns = stats_now_ns();
+
+	// A new shot while the previous one is still held, release it first
+	// so that the game sees two clicks
+	if (gun->release_ns != 0) {
+		release_trigger(gun);
+	}
+	report_axis(report, ABS_X, x);
+	report_axis(report, ABS_Y, y);
+	report_button(report, 1);
+	report_submit(report);
+	report_stages(gun, msg, dequeued_ns, mapped_ns);
+	gun_pose(gun, msg);
+	gun->telemetry.x = x;
+	gun->telemetry.y = y;
+	gun->telemetry.trigger = 1;
+	gun_publish(gun);
+	// The router keeps processing aim frames until the release is due
+	gun->release_ns = stats_now_ns() + m_hold_ms * 1000000ULL;
+}
 
+void aim_sequence(gun_t* gun, const message_t* msg, uint64_t dequeued_ns) {
+	report_t* report = &gun->report;
+	double yaw = 0.0, pitch = 0.0;
 	int x = 0, y = 0;
-	angle_to_screen(yaw, pitch, roll, &x, &y);
+	aim_filter(gun, msg, &yaw, &pitch);
+	angle_to_screen(gun, yaw, pitch, msg->roll / 100.0, &x, &y);
+	const uint64_t mapped_ns = stats_now_ns();
+
+	if (m_output_hz > 0.0) {
+		// Shown by the next outputs, at the MCU time of the frame when known
+		const uint64_t time_ns = gun->protocol >= PROTOCOL_BINARY ? shot_host_ns(&gun->shot, msg->time) : msg->received_ns;
+		upsample_sample(&gun->upsample, time_ns, x, y);
+		stats_stage(&gun->stats, STAGE_MAPPING, dequeued_ns, mapped_ns);
+		gun->upsample_received_ns = msg->received_ns;
+		gun_pose(gun, msg);
+		gun_publish(gun);
+		return;
+	}
+	report_axis(report, ABS_X, x);
+	report_axis(report, ABS_Y, y);
+	report_submit(report);
+	report_stages(gun, msg, dequeued_ns, mapped_ns);
+	gun_pose(gun, msg);
+	gun->telemetry.x = x;
+	gun->telemetry.y = y;
+	gun_publish(gun);
+}
+
+void shot_action(session_t* session, const message_t* msg) {
+	gun_t* gun = session->user_data;
+	game_sequence(gun, msg, gun->dequeued_ns);
+}
+
+void aim_action(session_t* session, const message_t* msg) {
+	gun_t* gun = session->user_data;
+	if (gun->protocol >= PROTOCOL_BINARY) {
+		shot_aim(&gun->shot, msg);
+	}
+	aim_sequence(gun, msg, gun->dequeued_ns);
+	if (gun->check_frames > 0) {
+		check_sequence(gun, msg);
+	}
+}
+
+static const session_action_t SESSION_ACTIONS[ACTION_COUNT] = {
+	[ACTION_HELLO] = hello_action,
+	[ACTION_RESUME] = resume_action,
+	[ACTION_POINT] = calibration_point,
+	[ACTION_SHOT] = shot_action,
+	[ACTION_AIM] = aim_action,
+	[ACTION_ENTER_INIT] = init_enter,
+	[ACTION_ENTER_STAB] = stab_enter,
+	[ACTION_ENTER_CALIBRATION] = calibration_enter,
+	[ACTION_ENTER_GAME] = game_enter,
+};
+
+// Move the cursor when an output is due, between the aim frames
+void upsample_pending(gun_t* gun) {
+	const uint64_t now = stats_now_ns();
+	double x = 0.0, y = 0.0;
+	if (gun->session.state != GAME_SEQUENCE || !upsample_due(&gun->upsample, now)
+		|| !upsample_position(&gun->upsample, now, &x, &y)) {
+		return;
+	}
+	// The extrapolation may leave the screen
+	gun->telemetry.x = (int)lround(fmin(fmax(x, 0.0), UINT16_MAX));
+	gun->telemetry.y = (int)lround(fmin(fmax(y, 0.0), UINT16_MAX));
+	report_axis(&gun->report, ABS_X, gun->telemetry.x);
+	report_axis(&gun->report, ABS_Y, gun->telemetry.y);
+	report_submit(&gun->report);
+	gun_publish(gun);
+	if (gun->upsample_received_ns != 0) {
+		const uint64_t emitted_ns = stats_now_ns();
+		if (gun->connected_ns != 0) {
+			PRINT("Gun %d first report %.1f ms after connection\n", gun->index, (emitted_ns - gun->connected_ns) / 1e6);
+			gun->connected_ns = 0;
+		}
+		stats_stage(&gun->stats, STAGE_EMIT, now, emitted_ns);
+		stats_stage(&gun->stats, STAGE_TOTAL, gun->upsample_received_ns, emitted_ns);
+		stats_report(&gun->stats);
+		gun->upsample_received_ns = 0;
+	}
+}
+
+// Next session timer, trigger release or output of a gun, 0 when none
+uint64_t gun_deadline(const gun_t* gun) {
+	const uint64_t deadlines[] = { gun->session.timer_ns, gun->release_ns, upsample_deadline(&gun->upsample) };
+	uint64_t deadline = 0;
+	size_t i = 0;
+	for (i = 0; i < sizeof(deadlines) / sizeof(deadlines[0]); ++i) {
+		if (deadlines[i] != 0 && (deadline == 0 || deadlines[i] < deadline)) {
+			deadline = deadlines[i];
+		}
+	}
+	return deadline;
+}
+
+uint64_t next_deadline() {
+	uint64_t deadline = 0;
+	int i = 0;
+	for (i = 0; i < m_gun_count; ++i) {
+		uint64_t next = gun_deadline(&m_guns[i]);
+		if (next != 0 && (deadline == 0 || next < deadline)) {
+			deadline = next;
+		}
+	}
+	return deadline;
+}
+
+void route_start() {
+	PRINT("Start route message\n");
+}
+
+// Process every frame waiting in the queue of a gun and its due deadlines.
+// Nothing here waits : the commands to the gun, the calibration file and
+// the IHM are handed over to the GLib loop and the IHM thread.
+void route_pending(gun_t* gun) {
+	message_t msg;
+	release_pending(gun);
+	session_poll(&gun->session, stats_now_ns());
+	while (queue_pop(&gun->queue, &msg)) {
+		gun->dequeued_ns = stats_now_ns();
+		stats_stage(&gun->stats, STAGE_QUEUE, msg.queued_ns, gun->dequeued_ns);
+		if (msg.type != 'E') {
+			TRACE("Gun %d command %c %d %d %d\n", gun->index, msg.type, msg.yaw, msg.pitch, msg.roll);
+		}
+		if (!session_frame(&gun->session, &msg, gun->protocol >= PROTOCOL_BINARY)) {
+			TRACE("Gun %d %c dropped in %s\n", gun->index, msg.type, session_state_name(gun->session.state));
+		}
+		// A timer of the new state may be due already
+		session_poll(&gun->session, gun->dequeued_ns);
+	}
+	upsample_pending(gun);
+}
+
+void route_all() {
+	int i = 0;
+	for (i = 0; i < m_gun_count; ++i) {
+		route_pending(&m_guns[i]);
+	}
+	ihm_update();
+}
+
+void route_stop() {
+	int i = 0;
+	for (i = 0; i < m_gun_count; ++i) {
+		gun_t* gun = &m_guns[i];
+		if (gun->release_ns != 0) {
+			release_trigger(gun);
+		}
+		PRINT("Gun %d dropped %lu, coalesced %lu\n", i, queue_dropped(&gun->queue), queue_coalesced(&gun->queue));
+		PRINT("Gun %d session %s, events %lu, ignored %lu, duplicates %lu\n", i, session_state_name(gun->session.state), gun->session.handled, gun->session.ignored, gun->session.duplicates);
+		PRINT("Gun %d reports %lu, short writes %lu, again %lu, errors %lu\n", i, atomic_load(&gun->report.writes), atomic_load(&gun->report.short_writes), atomic_load(&gun->report.again), atomic_load(&gun->report.errors));
+	}
+	PRINT("End route\n");
+}
 
-	emit(fd, EV_ABS, ABS_X, x);
-	emit(fd, EV_ABS, ABS_Y, y);
-	emit(fd, EV_SYN, SYN_REPORT, 0);
+// Real time profile for a thread of the input path, it runs on without
+void rt_apply(const char* name) {
+	if (!m_rt_enabled) {
+		return;
+	}
+	const int wanted = (m_rt.priority > 0 ? RT_FIFO : 0) | (m_rt.cpus != 0 ? RT_CPUS : 0);
+	const int applied = rt_thread(&m_rt);
+	if (applied != wanted) {
+		WARN("%s thread keeps %s%s: %s\n", name, (wanted & ~applied & RT_FIFO) ? "the normal scheduler " : "",
+			(wanted & ~applied & RT_CPUS) ? "every CPU " : "", strerror(errno));
+	}
+	else {
+		PRINT("%s thread SCHED_FIFO %d, cpus 0x%lx\n", name, m_rt.priority, m_rt.cpus);
+	}
 }
 
+// One router thread serves every gun
 void* route_message(void* arg) {
-	const int fd = *((int*)arg);
-	char cmd[COMMAND_SIZE];
-	int mode = 0;
-	pthread_t thread_ihm;
+	rt_apply("Router");
+	route_start();
 
 	// Catch CTRL-C
 	signal(SIGINT, signal_handler);
 
-	PRINT("Start route message\n");
 	while(!EXIT_REQUESTED) {
-		cmd[0] = '\0';
-		wait_for_event();
-		while (m_queue != NULL) {
-			pthread_mutex_lock(&m_queue_mutex);
-			dequeue(&m_queue, cmd);
-			pthread_mutex_unlock(&m_queue_mutex);
-
-			//PRINT("Message %s\n", cmd);
-
-			char id = cmd[0];
-			if (id == 'A') {
-				if ((mode != 0) && (mode != GAME_SEQUENCE)) {
-					ihm_quit();
-					PRINT("Wait IHM\n");
-					pthread_join(thread_ihm, NULL);
-				}
-				// Start initialization sequence 
-				PRINT("Start initialization sequence\n");
-				mode = INIT_SEQUENCE;
-				init_sequence(&thread_ihm, &mode);			
-			}
-			else if (id == 'B' && mode == STAB_SEQUENCE) {
-				PRINT("Command %s\n", cmd);
-				// Wait for gyrometer stabilization
-				stab_sequence(cmd, &thread_ihm, &mode);	
-			}
-			else if (id == 'C' && mode == CALIBRATION_SEQUENCE) {
-				PRINT("Command %s\n", cmd);
-				// Calibration
-				calibration_sequence(cmd, &thread_ihm, &mode);	
-			}
-			else if (id == 'D' && mode == GAME_SEQUENCE) {
-				PRINT("Command %s\n", cmd);
-				game_sequence(cmd, fd);
+		const uint64_t deadline = next_deadline();
+		wait_for_event(deadline);
+		rt_wakeup(&m_rt, deadline, stats_now_ns());
+		route_all();
+	}
+	route_stop();
+	pthread_exit(NULL);
+}
+
+gboolean wakeup_timeout(gpointer user_data);
+
+// Without router thread the deadlines of a gun are a GLib timeout
+void schedule_wakeup(gun_t* gun) {
+	const uint64_t deadline = gun_deadline(gun);
+	if (gun->wakeup_source != 0 && (deadline == 0 || deadline < gun->wakeup_ns)) {
+		g_source_remove(gun->wakeup_source);
+		gun->wakeup_source = 0;
+	}
+	if (deadline != 0 && gun->wakeup_source == 0) {
+		uint64_t now = stats_now_ns();
+		guint delay_ms = deadline > now ? (deadline - now + 999999) / 1000000 : 0;
+		gun->wakeup_ns = deadline;
+		gun->wakeup_source = g_timeout_add(delay_ms, wakeup_timeout, gun);
+	}
+}
+
+gboolean wakeup_timeout(gpointer user_data) {
+	gun_t* gun = user_data;
+	gun->wakeup_source = 0;
+	rt_wakeup(&m_rt, gun->wakeup_ns, stats_now_ns());
+	route_pending(gun);
+	ihm_update();
+	schedule_wakeup(gun);
+	return G_SOURCE_REMOVE;
+}
+
+gboolean router_event_cb(gint fd, GIOCondition condition, gpointer user_data) {
+	uint64_t count = 0;
+	int i = 0;
+	read(fd, &count, sizeof(count));
+	atomic_store(&m_event_pending, 0);
+	route_all();
+	for (i = 0; i < m_gun_count; ++i) {
+		schedule_wakeup(&m_guns[i]);
+	}
+	return G_SOURCE_CONTINUE;
+}
+
+void route_frame(const message_t* frame, void* user_data) {
+	gun_t* gun = user_data;
+	message_t msg = *frame;
+	msg.received_ns = gun->received_ns;
+	msg.queued_ns = stats_now_ns();
+	stats_stage(&gun->stats, STAGE_FRAME, msg.received_ns, msg.queued_ns);
+	stats_frame(&gun->stats, msg.type);
+	histogram_record(&gun->stats.depth, queue_depth(&gun->queue));
+
+	queue_push(&gun->queue, &msg);
+	stats_stage(&gun->stats, STAGE_ENQUEUE, msg.queued_ns, stats_now_ns());
+	health_frame(&gun->health, &msg, msg.received_ns);
+}
+
+void ble_notification_cb(const uint8_t* data, size_t data_length, void* user_data) {
+	gun_t* gun = user_data;
+	if (data != NULL && data_length > 0) {
+		gun->received_ns = stats_now_ns();
+		if (gun->capture.file != NULL) {
+			trace_write(&gun->capture, gun->received_ns / 1000, data, data_length);
+		}
+		if (framer_feed(&gun->framer, data, data_length, route_frame, gun) > 0) {
+			if (m_router == ROUTER_INLINE) {
+				route_pending(gun);
+				ihm_update();
+				schedule_wakeup(gun);
 			}
-			else if (id == 'E' && mode == GAME_SEQUENCE) {
-				aim_sequence(cmd, fd);
+			else {
+				event();
 			}
 		}
 	}
+}
 
-	if ((mode != 0) && (mode != GAME_SEQUENCE)) {
-		ihm_quit();
-		PRINT("Wait IHM\n");
-		pthread_join(thread_ihm, NULL);
+void gun_connect(gun_t* gun);
+void link_lost_cb(void* user_data);
+
+gboolean retry_cb(gpointer user_data) {
+	gun_t* gun = user_data;
+	gun->retry_source = 0;
+	gun_connect(gun);
+	return G_SOURCE_REMOVE;
+}
+
+void schedule_retry(gun_t* gun, int delay_ms) {
+	if (gun->retry_source != 0) {
+		g_source_remove(gun->retry_source);
 	}
-	PRINT("End route\n");
-	pthread_exit(NULL);
+	gun->retry_source = g_timeout_add(delay_ms, retry_cb, gun);
 }
 
-void ble_notification_cb(uint16_t handle, const uint8_t* data, size_t data_length, void* user_data) {
-	static char buffer[COMMAND_SIZE] = {0, 0, 0};
-	static char buf_length = 0;
-	if (data != NULL && data_length > 0) {		
-		if (buf_length + data_length < COMMAND_SIZE) {
-			memcpy(buffer + buf_length, data, data_length);
-			buf_length += data_length;
-			if ((buf_length > 0) && (buffer[buf_length - 1] == ';')) {
-				// Route message
-				pthread_mutex_lock(&m_queue_mutex);
-				enqueue(&m_queue, buffer, buf_length);
-				pthread_mutex_unlock(&m_queue_mutex);
-				event();
-				//PRINT("Notification %s\n", buffer);
-				memset(buffer, 0, COMMAND_SIZE);
-				buf_length = 0;
-				arm_timer();
-			}
+// Take a scanned gun no other gun is using
+int gun_discover(gun_t* gun) {
+	int found = 0, i = 0, j = 0;
+	pthread_mutex_lock(&m_scan_mutex);
+	for (i = 0; i < m_discovered_count && !found; ++i) {
+		int used = 0;
+		for (j = 0; j < m_gun_count; ++j) {
+			used |= strcmp(m_guns[j].address, m_discovered[i]) == 0;
 		}
-		else {
-			buf_length = 0;
+		if (!used) {
+			memcpy(gun->address, m_discovered[i], TRANSPORT_ADDRESS);
+			found = 1;
 		}
 	}
+	pthread_mutex_unlock(&m_scan_mutex);
+	if (found) {
+		PRINT("Gun %d found %s\n", gun->index, gun->address);
+		transport_init(&gun->transport, gun->address, ble_notification_cb, link_lost_cb, gun);
+	}
+	return found;
 }
 
+// Scanning only runs while a gun has no address
+void scan_update() {
+	int i = 0, wanted = 0;
+	for (i = 0; i < m_gun_count; ++i) {
+		wanted |= m_guns[i].address[0] == '\0';
+	}
+	atomic_store(&m_scan_wanted, wanted);
+}
 
-int main(void) {
-	DEBUG = fopen("/recalbox/share/scripts/log.txt","w");
+// Link opened by a worker, handed back to the GLib loop
+typedef struct connect_job {
+	gun_t* gun;
+	char address[TRANSPORT_ADDRESS];
+	transport_link_t link;
+	int opened;
+} connect_job_t;
+
+gboolean connect_done_idle(gpointer user_data) {
+	connect_job_t* job = user_data;
+	gun_t* gun = job->gun;
+	gun->connecting = 0;
+	if (job->opened && EXIT_REQUESTED) {
+		transport_close(&gun->transport, &job->link);
+		return G_SOURCE_REMOVE;
+	}
+	framer_init(&gun->framer);
+	if (!job->opened || !transport_start(&gun->transport, job->address, &job->link)) {
+		WARN("Fail to connect to %s with %s, retry in %d ms.\n", job->address, gun->transport.ops->name, gun->retry_ms);
+		schedule_retry(gun, gun->retry_ms);
+		gun->retry_ms = gun->retry_ms * 2 < RETRY_MAX_MS ? gun->retry_ms * 2 : RETRY_MAX_MS;
+		return G_SOURCE_REMOVE;
+	}
+	gun->connected = 1;
+	gun->connected_ns = stats_now_ns();
+	if (gun->lost_ns != 0) {
+		PRINT("Gun %d connected to %s, %.0f ms after link loss\n", gun->index, gun->address, (gun->connected_ns - gun->lost_ns) / 1e6);
+		gun->lost_ns = 0;
+	}
+	else {
+		PRINT("Gun %d connected to %s\n", gun->index, gun->address);
+	}
+	gun->retry_ms = RETRY_MIN_MS;
+	health_init(&gun->health, gun->connected_ns);
+	return G_SOURCE_REMOVE;
+}
 
-	// Create virtual mouse
-	int fd = create_mouse();
+// gattlib connects synchronously up to the BlueZ timeout, away from the
+// loop that serves the other guns
+void* connect_loop(void* arg) {
+	connect_job_t* job = arg;
+	if (m_rt_enabled) {
+		rt_normal();
+	}
+	job->opened = transport_open(&job->gun->transport, job->address, &job->link);
+	g_idle_add_full(G_PRIORITY_DEFAULT, connect_done_idle, job, g_free);
+	return NULL;
+}
 
-	// Catch CTRL-C
-	signal(SIGINT, signal_handler);
+void gun_connect(gun_t* gun) {
+	if (gun->connected || gun->connecting || EXIT_REQUESTED) {
+		return;
+	}
+	if (gun->address[0] == '\0' && !gun_discover(gun)) {
+		schedule_retry(gun, SCAN_POLL_MS);
+		return;
+	}
+	scan_update();
+	connect_job_t* job = g_new(connect_job_t, 1);
+	pthread_t thread;
+	memset(job, 0, sizeof(*job));
+	job->gun = gun;
+	memcpy(job->address, gun->address, sizeof(job->address));
+	gun->connecting = 1;
+	if (pthread_create(&thread, NULL, connect_loop, job) != 0) {
+		WARN("Fail to start the connection of gun %d, retry in %d ms.\n", gun->index, gun->retry_ms);
+		gun->connecting = 0;
+		g_free(job);
+		schedule_retry(gun, gun->retry_ms);
+		return;
+	}
+	pthread_detach(thread);
+}
 
-	// Create router thread
-	pthread_t thread_router;
-	pthread_create(&thread_router, NULL, route_message, &fd);
+void gun_disconnect(gun_t* gun) {
+	if (gun->retry_source != 0) {
+		g_source_remove(gun->retry_source);
+		gun->retry_source = 0;
+	}
+	if (!gun->connected) {
+		return;
+	}
+	PRINT("Gun %d disconnection.\n", gun->index);
+	PRINT("Frames %lu, errors %lu, skipped %lu\n", gun->framer.frames, gun->framer.errors, gun->framer.skipped);
+	transport_disconnect(&gun->transport);
+	gun->connected = 0;
+}
+
+// Reconnect right away, the backoff only grows on failed attempts
+void gun_lost(gun_t* gun) {
+	if (!gun->connected) {
+		return;
+	}
+	gun->lost_ns = stats_now_ns();
+	gun_disconnect(gun);
+	schedule_retry(gun, gun->retry_ms);
+}
+
+gboolean link_lost_idle(gpointer user_data) {
+	gun_lost(user_data);
+	return G_SOURCE_REMOVE;
+}
+
+void link_lost_cb(void* user_data) {
+	gun_t* gun = user_data;
+	PRINT("Gun %d link lost\n", gun->index);
+	// Not from within the transport callback
+	g_idle_add(link_lost_idle, gun);
+}
+
+// Link health of every gun against the time of its last frame, a silent
+// gun is dropped and reconnected
+gboolean watchdog(gpointer user_data) {
+	const uint64_t now = stats_now_ns();
+	int i = 0;
+	for (i = 0; i < m_gun_count && !EXIT_REQUESTED; ++i) {
+		gun_t* gun = &m_guns[i];
+		if (!gun->connected) {
+			continue;
+		}
+		const int previous = atomic_load(&gun->health.state);
+		const int state = health_check(&gun->health, now);
+		if (state != previous) {
+			PRINT("Gun %d link %s\n", i, health_name(state));
+		}
+		if (state == HEALTH_SILENT) {
+			gun_lost(gun);
+		}
+	}
+	return G_SOURCE_CONTINUE;
+}
+
+// Scans never block the GLib loop, gun_connect() picks the results
+void* scan_loop(void* arg) {
+	char found[GUN_MAX][TRANSPORT_ADDRESS];
+	while (!EXIT_REQUESTED) {
+		if (!atomic_load(&m_scan_wanted)) {
+			usleep(SCAN_POLL_MS * 1000);
+			continue;
+		}
+		const int count = transport_scan(m_scan_filter, found, GUN_MAX, SCAN_S);
+		pthread_mutex_lock(&m_scan_mutex);
+		memcpy(m_discovered, found, sizeof(found));
+		m_discovered_count = count;
+		pthread_mutex_unlock(&m_scan_mutex);
+		if (count == 0) {
+			usleep(SCAN_POLL_MS * 1000);
+		}
+	}
+	return NULL;
+}
+
+void dump_stats(FILE* file) {
+	int i = 0;
+	for (i = 0; i < m_gun_count; ++i) {
+		gun_t* gun = &m_guns[i];
+		fprintf(file, "# gun %d %s\n", i, gun->address);
+		stats_dump(&gun->stats, file, queue_dropped(&gun->queue), queue_coalesced(&gun->queue));
+		fprintf(file, "uinput writes %lu short %lu again %lu errors %lu skipped_axes %lu\n",
+			atomic_load(&gun->report.writes), atomic_load(&gun->report.short_writes), atomic_load(&gun->report.again),
+			atomic_load(&gun->report.errors), atomic_load(&gun->report.skipped));
+		health_dump(&gun->health, file);
+	}
+	rt_dump(&m_rt, file);
+}
+
+// Dump the statistics every m_stats_interval seconds and on SIGUSR1,
+// written aside then renamed so readers never see a partial file
+void* stats_loop(void* arg) {
+	char tmp_path[256];
+	sigset_t set;
+	sigemptyset(&set);
+	sigaddset(&set, SIGUSR1);
+	snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", m_stats_path);
 
 	while (!EXIT_REQUESTED) {
-		// Connect to the bluetooth liaison
-		m_connection = gattlib_connect(NULL, "3C:A5:08:0A:62:A9", GATTLIB_CONNECTION_OPTIONS_LEGACY_DEFAULT);
-		if (m_connection == NULL) {
-			PRINT("Fail to connect to the bluetooth device.\n");
+		struct timespec timeout = { m_stats_interval, 0 };
+		sigtimedwait(&set, NULL, &timeout);
+		if (EXIT_REQUESTED) {
+			break;
+		}
+		FILE* file = fopen(tmp_path, "w");
+		if (file != NULL) {
+			dump_stats(file);
+			fclose(file);
+			rename(tmp_path, m_stats_path);
+		}
+	}
+	pthread_exit(NULL);
+}
+
+void* sink_loop(void* arg) {
+	gun_t* gun = arg;
+	char buffer[64 * sizeof(struct input_event)];
+	ssize_t length = 0;
+	while ((length = read(gun->sink[0], buffer, sizeof(buffer))) > 0) {
+		gun->sink_bytes += length;
+	}
+	pthread_exit(NULL);
+}
+
+// Stand-in for the virtual mouse of a gun, counts what is written
+int create_sink(gun_t* gun) {
+	if (pipe(gun->sink) != 0) {
+		WARN("Fail to create sink.\n");
+		return -1;
+	}
+	pthread_create(&gun->thread_sink, NULL, sink_loop, gun);
+	return gun->sink[1];
+}
+
+void release_sink(gun_t* gun) {
+	close(gun->sink[1]);
+	pthread_join(gun->thread_sink, NULL);
+	close(gun->sink[0]);
+}
+
+// A NULL address waits for the scanner
+void gun_init(gun_t* gun, int index, const char* address) {
+	memset(gun, 0, sizeof(*gun));
+	gun->index = index;
+	if (address != NULL) {
+		snprintf(gun->address, sizeof(gun->address), "%s", address);
+	}
+	gun->retry_ms = RETRY_MIN_MS;
+	gun->fd = -1;
+	gun->sink[0] = -1;
+	gun->sink[1] = -1;
+	gun->protocol = PROTOCOL_ASCII;
+	session_init(&gun->session, SESSION_ACTIONS, gun);
+	queue_init(&gun->queue);
+	framer_init(&gun->framer);
+	filter_init(&gun->filter, m_filter_type);
+	gun->filter.predict_s = m_predict_ms / 1000.0;
+	stats_init(&gun->stats);
+	transport_init(&gun->transport, gun->address, ble_notification_cb, link_lost_cb, gun);
+	health_init(&gun->health, stats_now_ns());
+}
+
+// Virtual mouse of a gun, or the fake one when headless
+void gun_open(gun_t* gun, const char* capture_path) {
+	char path[256];
+	if (m_headless) {
+		gun->fd = create_sink(gun);
+	}
+	else {
+		gun->fd = create_mouse(gun->index);
+	}
+	// The router is the only writer of the virtual mouse
+	report_init(&gun->report, gun->fd);
+	if (capture_path != NULL) {
+		// One trace per gun, the first one keeps the given name
+		if (gun->index == 0) {
+			snprintf(path, sizeof(path), "%s", capture_path);
 		}
 		else {
-			const uuid_t ble_input_uuid = CREATE_UUID16(0xFFE1);
-			const uint16_t enable_notification = 0x0001;
-			// Enable Status Notification
-			int ret = gattlib_write_char_by_uuid(m_connection, &ble_input_uuid, &enable_notification, sizeof(enable_notification));
-			if (ret == GATTLIB_SUCCESS) {
+			snprintf(path, sizeof(path), "%s.%d", capture_path, gun->index + 1);
+		}
+		if (!trace_open_write(&gun->capture, path)) {
+			WARN("Fail to open capture %s.\n", path);
+		}
+	}
+}
+
+void gun_close(gun_t* gun) {
+	gun_disconnect(gun);
+	if (gun->fd != -1) {
+		if (m_headless) {
+			release_sink(gun);
+			printf("Gun %d sink received %lu events\n", gun->index, gun->sink_bytes / sizeof(struct input_event));
+		}
+		else {
+			release_device(gun->fd);
+		}
+	}
+	trace_close(&gun->capture);
+}
 
-				gattlib_register_notification(m_connection, ble_notification_cb, NULL);
+typedef struct replay {
+	trace_t trace;
+	double speed;
+	uint64_t start_us;
+	uint64_t time_us;
+	uint8_t data[TRACE_MAX_RECORD];
+	int length;
+} replay_t;
+
+// Wait for the router to catch up before reporting
+gboolean replay_drain(gpointer user_data) {
+	replay_t* replay = user_data;
+	unsigned long frames = 0, errors = 0, skipped = 0;
+	int i = 0;
+	for (i = 0; i < m_gun_count; ++i) {
+		if (!EXIT_REQUESTED && !queue_idle(&m_guns[i].queue)) {
+			return G_SOURCE_CONTINUE;
+		}
+		frames += m_guns[i].framer.frames;
+		errors += m_guns[i].framer.errors;
+		skipped += m_guns[i].framer.skipped;
+	}
+	const double elapsed = (trace_now_us() - replay->start_us) / 1e6;
+	printf("Replayed %lu notifications into %d guns, %lu frames in %.3f s (%.0f frames/s)\n",
+		replay->trace.records, m_gun_count, frames, elapsed, elapsed > 0 ? frames / elapsed : 0.0);
+	printf("Framing errors %lu, skipped bytes %lu\n", errors, skipped);
+	g_main_loop_quit(m_main_loop);
+	return G_SOURCE_REMOVE;
+}
 
-				ret = gattlib_notification_start(m_connection, &ble_input_uuid);
-				if (ret == GATTLIB_SUCCESS) {
+// Hand the notifications that are due to the pipeline of every gun, one
+// per call when going as fast as possible so that the other sources run
+// in between
+gboolean replay_step(gpointer user_data) {
+	replay_t* replay = user_data;
+	int i = 0;
+	while (!EXIT_REQUESTED && replay->length >= 0) {
+		if (replay->speed > 0) {
+			uint64_t due = replay->start_us + (uint64_t)(replay->time_us / replay->speed);
+			uint64_t now = trace_now_us();
+			if (due > now) {
+				g_timeout_add((due - now + 999) / 1000, replay_step, replay);
+				return G_SOURCE_REMOVE;
+			}
+		}
+		for (i = 0; i < m_gun_count; ++i) {
+			ble_notification_cb(replay->data, replay->length, &m_guns[i]);
+		}
+		replay->length = trace_read(&replay->trace, &replay->time_us, replay->data);
+		if (replay->speed <= 0 && replay->length >= 0) {
+			return G_SOURCE_CONTINUE;
+		}
+	}
+	g_timeout_add(1, replay_drain, replay);
+	return G_SOURCE_REMOVE;
+}
 
-					// Start keep alive
-					make_timer();
+// Feed a recorded notification stream to the pipeline from the GLib loop.
+// speed is a multiplier of the recorded pace, 0 for as fast as possible.
+void replay_trace(const char* path, double speed) {
+	static replay_t replay;
 
-					m_main_loop = g_main_loop_new(NULL, 0);
-					g_main_loop_run(m_main_loop);
+	if (!trace_open_read(&replay.trace, path)) {
+		WARN("Fail to open trace %s.\n", path);
+		return;
+	}
+	replay.speed = speed;
+	replay.start_us = trace_now_us();
+	replay.length = trace_read(&replay.trace, &replay.time_us, replay.data);
+	g_idle_add(replay_step, &replay);
+
+	m_main_loop = g_main_loop_new(NULL, 0);
+	g_main_loop_run(m_main_loop);
+	g_main_loop_unref(m_main_loop);
+	m_main_loop = NULL;
+	trace_close(&replay.trace);
+}
 
-					PRINT("Disconnection.\n");
+void usage(const char* name) {
+	fprintf(stderr, "Usage : %s [-a address | -a scan[:filter]]... [-c model] [-C calibration_file] [-f filter] [-P predict_ms] [-H] [-S stats_file [-i seconds]] [-m router] [-t hold_ms] [-o rate[:delay_ms]] [-R priority[:cpus]] [-T telemetry] [-r capture_file] [-p replay_file [-s speed] [-n guns]]\n", name);
+	fprintf(stderr, "  -a  gun MAC address, unix:<socket> or /dev/pts/<n> for a simulated gun, up to %d guns\n", GUN_MAX);
+	fprintf(stderr, "      scan (default) finds the guns advertising the gun service, scan:unix:<prefix> the simulated ones\n");
+	fprintf(stderr, "  -c  calibration model : quadratic (default), affine or piecewise\n");
+	fprintf(stderr, "  -C  stored calibrations (default %s), none to calibrate at each connection\n", m_calib_path);
+	fprintf(stderr, "  -f  aim filter : euro (default), kalman or none\n");
+	fprintf(stderr, "  -P  aim prediction in ms, auto for the measured notification to emit latency, auto+<ms> to add the radio latency\n");
+	fprintf(stderr, "  -H  headless, no display and a fake mouse\n");
+	fprintf(stderr, "  -S  latency statistics file (default %s), also dumped on SIGUSR1\n", m_stats_path);
+	fprintf(stderr, "  -i  statistics period in seconds (default %d)\n", m_stats_interval);
+	fprintf(stderr, "  -m  frame processing : thread (default), inline in the notification callback or eventfd in the GLib loop\n");
+	fprintf(stderr, "  -t  trigger hold time in ms (default %d)\n", m_hold_ms);
+	fprintf(stderr, "  -o  move the cursor at rate Hz, display for the display refresh rate, instead of on each aim frame\n");
+	fprintf(stderr, "      the cursor shows the aim delay_ms ago (default 0), one aim period interpolates without overshoot\n");
+	fprintf(stderr, "  -R  real time notification and router threads : SCHED_FIFO priority (0 to only pin them),\n");
+	fprintf(stderr, "      on the comma separated cpus, with the memory locked. Needs root or CAP_SYS_NICE and CAP_IPC_LOCK\n");
+	fprintf(stderr, "  -T  shared memory segment with the latest state of each gun (default %s), none for no segment\n", m_telemetry_name);
+	fprintf(stderr, "  -r  record every notification into capture_file, capture_file.<n> for the gun n > 1\n");
+	fprintf(stderr, "  -p  replay replay_file without bluetooth, display and uinput\n");
+	fprintf(stderr, "  -s  replay speed multiplier, 0 for as fast as possible (default 1)\n");
+	fprintf(stderr, "  -n  number of guns fed with the replayed trace, or to find when scanning (default 1)\n");
+}
 
-					// In case we quit the main loop, clean the connection
-					gattlib_notification_stop(m_connection, &ble_input_uuid);
-					g_main_loop_unref(m_main_loop);
-				}
-				else {
-					PRINT("Fail to start notification\n.");
-				}
+int main(int argc, char** argv) {
+	const char* addresses[GUN_MAX];
+	int address_count = 0;
+	const char* capture_path = NULL;
+	const char* replay_path = NULL;
+	double speed = 1.0;
+	int gun_count = 1;
+	int opt = 0;
+	int i = 0;
+	rt_init(&m_rt);
+	while ((opt = getopt(argc, argv, "a:c:C:f:P:HS:i:m:t:o:R:T:r:p:s:n:")) != -1) {
+		if (opt == 'a') {
+			if (address_count == GUN_MAX) {
+				fprintf(stderr, "At most %d guns\n", GUN_MAX);
+				return 1;
+			}
+			if (strncmp(optarg, "scan", 4) == 0) {
+				m_scan_filter = optarg[4] == ':' ? optarg + 5 : "";
+			}
+			else {
+				addresses[address_count++] = optarg;
+			}
+		}
+		else if (opt == 'H') {
+			m_headless = 1;
+		}
+		else if (opt == 'S') {
+			m_stats_path = optarg;
+		}
+		else if (opt == 'i') {
+			m_stats_interval = atoi(optarg) > 0 ? atoi(optarg) : 1;
+		}
+		else if (opt == 'c') {
+			if (strcmp(optarg, "piecewise") == 0) {
+				m_calib_model = CALIB_PIECEWISE;
+			}
+			else if (strcmp(optarg, "affine") == 0) {
+				m_calib_model = CALIB_AFFINE;
+			}
+			else {
+				m_calib_model = CALIB_QUADRATIC;
+			}
+		}
+		else if (opt == 'C') {
+			// "none" always calibrates
+			m_calib_path = strcmp(optarg, "none") == 0 ? NULL : optarg;
+		}
+		else if (opt == 'f') {
+			m_filter_type = filter_type(optarg);
+			if (m_filter_type < 0) {
+				usage(argv[0]);
+				return 1;
+			}
+		}
+		else if (opt == 'P') {
+			// "auto", "auto+<ms>" or "<ms>"
+			m_predict_auto = strncmp(optarg, "auto", 4) == 0;
+			m_predict_ms = atof(m_predict_auto ? (optarg[4] == '+' ? optarg + 5 : "0") : optarg);
+		}
+		else if (opt == 'm') {
+			if (strcmp(optarg, "inline") == 0) {
+				m_router = ROUTER_INLINE;
+			}
+			else if (strcmp(optarg, "eventfd") == 0) {
+				m_router = ROUTER_EVENTFD;
 			}
 			else {
-				PRINT("Fail to enable notification\n.");
+				m_router = ROUTER_THREAD;
+			}
+		}
+		else if (opt == 't') {
+			m_hold_ms = atoi(optarg);
+		}
+		else if (opt == 'o') {
+			// "<rate>[:<delay_ms>]" or "display[:<delay_ms>]"
+			const char* delay = strchr(optarg, ':');
+			m_output_display = strncmp(optarg, "display", 7) == 0;
+			m_output_hz = m_output_display ? m_refresh_hz : atof(optarg);
+			m_output_delay_ms = delay != NULL ? atof(delay + 1) : 0.0;
+		}
+		else if (opt == 'R') {
+			m_rt_enabled = rt_parse(&m_rt, optarg);
+			if (!m_rt_enabled) {
+				usage(argv[0]);
+				return 1;
+			}
+		}
+		else if (opt == 'T') {
+			m_telemetry_name = strcmp(optarg, "none") == 0 ? NULL : optarg;
+		}
+		else if (opt == 'r') {
+			capture_path = optarg;
+		}
+		else if (opt == 'p') {
+			replay_path = optarg;
+		}
+		else if (opt == 's') {
+			speed = atof(optarg);
+		}
+		else if (opt == 'n') {
+			gun_count = atoi(optarg);
+			if (gun_count < 1 || gun_count > GUN_MAX) {
+				gun_count = 1;
 			}
+		}
+		else {
+			usage(argv[0]);
+			return 1;
+		}
+	}
+
+	// SIGUSR1 is only taken by the statistics thread, blocked before any
+	// other thread is started so that they all inherit the mask
+	sigset_t stats_signal;
+	sigemptyset(&stats_signal);
+	sigaddset(&stats_signal, SIGUSR1);
+	pthread_sigmask(SIG_BLOCK, &stats_signal, NULL);
+
+	// stderr when the recalbox share is missing
+	log_open("/recalbox/share/scripts/log.txt");
+
+	init_event();
+	atomic_init(&m_scan_wanted, 0);
+	if (replay_path != NULL) {
+		// The trace holds its own calibration sequence
+		m_headless = 1;
+		m_calib_path = NULL;
+		for (m_gun_count = 0; m_gun_count < gun_count; ++m_gun_count) {
+			gun_init(&m_guns[m_gun_count], m_gun_count, "replay");
+		}
+	}
+	else {
+		if (address_count == 0 && m_scan_filter == NULL) {
+			m_scan_filter = "";
+		}
+		// Given addresses first, the scanner fills the others
+		if (m_scan_filter == NULL || gun_count < address_count) {
+			gun_count = address_count;
+		}
+		for (m_gun_count = 0; m_gun_count < gun_count; ++m_gun_count) {
+			gun_init(&m_guns[m_gun_count], m_gun_count, m_gun_count < address_count ? addresses[m_gun_count] : NULL);
+		}
+	}
+
+	pthread_t thread_stats;
+	pthread_create(&thread_stats, NULL, stats_loop, NULL);
+
+	// Create the virtual mice, or the fake ones when headless
+	if (m_headless) {
+		m_screen_width = HEADLESS_WIDTH;
+		m_screen_height = HEADLESS_HEIGHT;
+	}
+	for (i = 0; i < m_gun_count; ++i) {
+		gun_open(&m_guns[i], capture_path);
+	}
+	if (!m_headless) {
+		// Load the IHM assets now, phases only switch what is drawn
+		ihm_start();
+	}
+	if (m_output_display) {
+		m_output_hz = m_refresh_hz;
+	}
+	if (m_output_hz > 0.0) {
+		PRINT("Cursor output at %.0f Hz, %.1f ms behind the aim\n", m_output_hz, m_output_delay_ms);
+	}
+	if (m_rt_enabled) {
+		// Every thread and asset exists, the hot path no longer faults
+		const int error = rt_lock();
+		if (error != 0) {
+			WARN("Memory not locked, page faults stay possible : %s\n", strerror(error));
+		}
+		else {
+			PRINT("Memory locked\n");
+		}
+	}
 
-			gattlib_disconnect(m_connection);
-			m_connection = NULL;
+	if (m_telemetry_name != NULL) {
+		const int error = telemetry_open(&m_telemetry, m_telemetry_name, m_gun_count);
+		if (error != 0) {
+			WARN("No telemetry in shared memory %s : %s\n", m_telemetry_name, strerror(error));
 		}
+		else {
+			PRINT("Telemetry in shared memory %s\n", m_telemetry_name);
+		}
+	}
+
+	// Catch CTRL-C
+	signal(SIGINT, signal_handler);
+
+	// Create router thread, or route from the GLib loop
+	pthread_t thread_router;
+	if (m_router == ROUTER_THREAD) {
+		pthread_create(&thread_router, NULL, route_message, NULL);
+	}
+	else {
+		route_start();
+		if (m_router == ROUTER_EVENTFD) {
+			atomic_init(&m_event_pending, 0);
+			m_event_fd = eventfd(0, EFD_NONBLOCK);
+			g_unix_fd_add(m_event_fd, G_IO_IN, router_event_cb, NULL);
+		}
+	}
+	PRINT("Router %d, %d guns\n", m_router, m_gun_count);
+
+	if (replay_path != NULL) {
+		rt_apply("Replay");
+		replay_trace(replay_path, speed);
+	}
+	else {
+		// Every gun connects, reconnects and is routed from this loop
+		pthread_t thread_scan;
+		scan_update();
+		if (m_scan_filter != NULL) {
+			pthread_create(&thread_scan, NULL, scan_loop, NULL);
+		}
+		for (i = 0; i < m_gun_count; ++i) {
+			gun_connect(&m_guns[i]);
+		}
+		g_timeout_add(WATCHDOG_MS, watchdog, NULL);
+		m_main_loop = g_main_loop_new(NULL, 0);
+		// After the scanner thread, it keeps the normal scheduler
+		rt_apply("Notification");
 		if (!EXIT_REQUESTED) {
-			// retry 5 seconds later
-			sleep(5);
+			g_main_loop_run(m_main_loop);
+		}
+		g_main_loop_unref(m_main_loop);
+		m_main_loop = NULL;
+		EXIT_REQUESTED = 1;
+		if (m_scan_filter != NULL) {
+			pthread_join(thread_scan, NULL);
 		}
 	}
+	EXIT_REQUESTED = 1;
+	event();
 
-	PRINT("Wait router\n");
-	pthread_join(thread_router, NULL);
+	if (m_router == ROUTER_THREAD) {
+		PRINT("Wait router\n");
+		pthread_join(thread_router, NULL);
+	}
+	else {
+		route_stop();
+		if (m_event_fd != -1) {
+			close(m_event_fd);
+		}
+	}
+	ihm_stop();
+	pthread_kill(thread_stats, SIGUSR1);
+	pthread_join(thread_stats, NULL);
+	if (replay_path != NULL) {
+		dump_stats(stdout);
+	}
 
-	if (fd != -1) {
-		release_device(fd);
+	for (i = 0; i < m_gun_count; ++i) {
+		gun_close(&m_guns[i]);
 	}
+	telemetry_close(&m_telemetry);
 	PRINT("Bye\n");
-	fclose(DEBUG);
+	log_close();
 	return 0;
 }
@@ -0,0 +1,354 @@
+#include <math.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "calib.h"
+
+// Below this spread in degrees an angle does not constrain the fit
+#define CALIB_MIN_SPREAD 0.5
+// Relative pivot under which the normal equations are considered singular
+#define CALIB_MIN_PIVOT 1e-9
+// Normalized angles beyond this are not plausible, the targets are at 1.2
+#define CALIB_MAX_RANGE 3.0
+// A stored calibration worse than this on its own targets is not reused
+#define CALIB_MAX_RESIDUAL 100.0
+#define CALIB_LINE 2048
+#define CALIB_MAX_LINES 64
+// Doubles stored after the model : offset, scale, x, y, piecewise, residuals
+#define CALIB_VALUES (3 + 3 + 2 * CALIB_TERMS + 10 + 2)
+
+static double average3(double val1, double val2, double val3) {
+	double a = val1 + val2 + val3;
+	return (a / 3.);
+}
+
+void calib_piecewise_map(const calib_t* calib, double yaw, double pitch, double roll, int* x, int* y) {
+	double pixel_x = 0.0;
+	double pixel_y = 0.0;
+	if (yaw < calib->middle_x) {
+		pixel_x = calib->width/2 - (calib->middle_x - yaw) * calib->deg_to_pixel_x1;
+	}
+	else {
+		pixel_x = calib->width/2 + (yaw - calib->middle_x) * calib->deg_to_pixel_x2;
+	}
+	if (pitch < calib->middle_y) {
+		pixel_y = calib->height/2 + (calib->middle_y - pitch) * calib->deg_to_pixel_y1;
+	}
+	else {
+		pixel_y = calib->height/2 - (pitch - calib->middle_y) * calib->deg_to_pixel_y2;
+	}
+
+    *x = (pixel_x / calib->width) * UINT16_MAX;
+	if (*x < 0) *x = 0;
+	if (*x > UINT16_MAX) *x = UINT16_MAX;
+
+    *y = (pixel_y / calib->height) * UINT16_MAX;
+	if (*y < 0) *y = 0;
+	if (*y > UINT16_MAX) *y = UINT16_MAX;
+}
+
+void calib_to_screen(const calib_t* calib, double yaw, double pitch, double roll, int* x, int* y) {
+	if (calib->model == CALIB_PIECEWISE) {
+		calib_piecewise_map(calib, yaw, pitch, roll, x, y);
+	}
+	else {
+		calib_map(calib, yaw, pitch, roll, x, y);
+	}
+}
+
+static void calib_piecewise(calib_t* calib, const double yaw[CALIB_POINTS], const double pitch[CALIB_POINTS], double margin_x, double margin_y) {
+	calib->middle_x = average3(yaw[3], yaw[4], yaw[5]);
+	calib->left = average3(yaw[0], yaw[1], yaw[2]);
+	calib->right = average3(yaw[6], yaw[7], yaw[8]);
+	calib->up = average3(pitch[0], pitch[5], pitch[6]);
+	calib->middle_y = average3(pitch[1], pitch[4], pitch[7]);
+	calib->down = average3(pitch[2], pitch[3], pitch[8]);
+
+	calib->deg_to_pixel_x1 = (calib->width/2 - margin_x) / (calib->middle_x - calib->left);
+	calib->deg_to_pixel_x2 = (calib->width/2 - margin_x) / (calib->right - calib->middle_x);
+	calib->deg_to_pixel_y1 = (calib->height/2 - margin_y) / (calib->middle_y - calib->down);
+	calib->deg_to_pixel_y2 = (calib->height/2 - margin_y) / (calib->up - calib->middle_y);
+}
+
+static void calib_terms(const calib_t* calib, double yaw, double pitch, double roll, double terms[CALIB_TERMS]) {
+	const double a = (yaw - calib->offset[0]) * calib->scale[0];
+	const double b = (pitch - calib->offset[1]) * calib->scale[1];
+	const double c = (roll - calib->offset[2]) * calib->scale[2];
+	terms[0] = 1.0;
+	terms[1] = a;
+	terms[2] = b;
+	terms[3] = c;
+	terms[4] = a * b;
+	terms[5] = a * a;
+	terms[6] = b * b;
+}
+
+// Center the angles and scale them to a unit spread so that the normal
+// equations stay well conditioned. Returns 0 when the angle does not vary.
+static int calib_normalize(const double* values, double* offset, double* scale) {
+	double mean = 0.0, spread = 0.0;
+	int i = 0;
+	for (i = 0; i < CALIB_POINTS; ++i) {
+		mean += values[i];
+	}
+	mean /= CALIB_POINTS;
+	for (i = 0; i < CALIB_POINTS; ++i) {
+		spread += (values[i] - mean) * (values[i] - mean);
+	}
+	spread = sqrt(spread / CALIB_POINTS);
+	*offset = mean;
+	*scale = spread < CALIB_MIN_SPREAD ? 0.0 : 1.0 / spread;
+	return spread >= CALIB_MIN_SPREAD;
+}
+
+// Solve the normal equations of the used terms by Gaussian elimination with
+// partial pivoting, the other coefficients are 0
+static int calib_least_squares(double terms[CALIB_POINTS][CALIB_TERMS], const double* target, const int used[CALIB_TERMS], double coefficients[CALIB_TERMS]) {
+	double m[CALIB_TERMS][CALIB_TERMS + 1];
+	int index[CALIB_TERMS];
+	int n = 0, i = 0, j = 0, k = 0, p = 0;
+	double largest = 0.0;
+
+	for (i = 0; i < CALIB_TERMS; ++i) {
+		coefficients[i] = 0.0;
+		if (used[i]) {
+			index[n++] = i;
+		}
+	}
+	for (i = 0; i < n; ++i) {
+		for (j = 0; j < n; ++j) {
+			m[i][j] = 0.0;
+			for (k = 0; k < CALIB_POINTS; ++k) {
+				m[i][j] += terms[k][index[i]] * terms[k][index[j]];
+			}
+		}
+		m[i][n] = 0.0;
+		for (k = 0; k < CALIB_POINTS; ++k) {
+			m[i][n] += terms[k][index[i]] * target[k];
+		}
+		if (m[i][i] > largest) {
+			largest = m[i][i];
+		}
+	}
+
+	for (i = 0; i < n; ++i) {
+		p = i;
+		for (j = i + 1; j < n; ++j) {
+			if (fabs(m[j][i]) > fabs(m[p][i])) {
+				p = j;
+			}
+		}
+		if (fabs(m[p][i]) <= CALIB_MIN_PIVOT * largest) {
+			return 0;
+		}
+		if (p != i) {
+			for (k = i; k <= n; ++k) {
+				double swap = m[i][k];
+				m[i][k] = m[p][k];
+				m[p][k] = swap;
+			}
+		}
+		for (j = i + 1; j < n; ++j) {
+			double factor = m[j][i] / m[i][i];
+			for (k = i; k <= n; ++k) {
+				m[j][k] -= factor * m[i][k];
+			}
+		}
+	}
+	for (i = n - 1; i >= 0; --i) {
+		double sum = m[i][n];
+		for (j = i + 1; j < n; ++j) {
+			sum -= m[i][j] * coefficients[index[j]];
+		}
+		coefficients[index[i]] = sum / m[i][i];
+	}
+	return 1;
+}
+
+int calib_solve(calib_t* calib, int model, int width, int height,
+	const double yaw[CALIB_POINTS], const double pitch[CALIB_POINTS], const double roll[CALIB_POINTS],
+	const double target_x[CALIB_POINTS], const double target_y[CALIB_POINTS]) {
+	double terms[CALIB_POINTS][CALIB_TERMS];
+	double units_x[CALIB_POINTS], units_y[CALIB_POINTS];
+	int used[CALIB_TERMS] = {1, 1, 1, 1, 1, 1, 1};
+	int i = 0;
+
+	memset(calib, 0, sizeof(*calib));
+	calib->model = model;
+	calib->width = width;
+	calib->height = height;
+
+	const int spread = calib_normalize(yaw, &calib->offset[0], &calib->scale[0]) &
+		calib_normalize(pitch, &calib->offset[1], &calib->scale[1]);
+	used[3] = calib_normalize(roll, &calib->offset[2], &calib->scale[2]);
+	if (model == CALIB_PIECEWISE) {
+		calib_piecewise(calib, yaw, pitch, target_x[0], target_y[0]);
+	}
+	else {
+		// Without yaw and pitch spread nothing can be fitted
+		if (!spread) {
+			return 0;
+		}
+		if (model == CALIB_AFFINE) {
+			used[4] = used[5] = used[6] = 0;
+		}
+		for (i = 0; i < CALIB_POINTS; ++i) {
+			calib_terms(calib, yaw[i], pitch[i], roll[i], terms[i]);
+			units_x[i] = target_x[i] / width * UINT16_MAX;
+			units_y[i] = target_y[i] / height * UINT16_MAX;
+		}
+		if (!calib_least_squares(terms, units_x, used, calib->x) ||
+			!calib_least_squares(terms, units_y, used, calib->y)) {
+			if (model == CALIB_AFFINE) {
+				return 0;
+			}
+			return calib_solve(calib, CALIB_AFFINE, width, height, yaw, pitch, roll, target_x, target_y);
+		}
+	}
+
+	for (i = 0; i < CALIB_POINTS; ++i) {
+		int x = 0, y = 0;
+		calib_to_screen(calib, yaw[i], pitch[i], roll[i], &x, &y);
+		double dx = (double)x * width / UINT16_MAX - target_x[i];
+		double dy = (double)y * height / UINT16_MAX - target_y[i];
+		double error = sqrt(dx * dx + dy * dy);
+		calib->residual += error * error;
+		if (error > calib->residual_max) {
+			calib->residual_max = error;
+		}
+	}
+	calib->residual = sqrt(calib->residual / CALIB_POINTS);
+	return 1;
+}
+
+int calib_plausible(const calib_t* calib, double yaw, double pitch) {
+	const double a = (yaw - calib->offset[0]) * calib->scale[0];
+	const double b = (pitch - calib->offset[1]) * calib->scale[1];
+	return fabs(a) <= CALIB_MAX_RANGE && fabs(b) <= CALIB_MAX_RANGE;
+}
+
+// Every stored double in file order
+static void calib_values(calib_t* calib, double* values[CALIB_VALUES]) {
+	double* fields[10] = {
+		&calib->middle_x, &calib->left, &calib->right, &calib->middle_y, &calib->up, &calib->down,
+		&calib->deg_to_pixel_x1, &calib->deg_to_pixel_x2, &calib->deg_to_pixel_y1, &calib->deg_to_pixel_y2
+	};
+	int n = 0, i = 0;
+	for (i = 0; i < 3; ++i) {
+		values[n++] = &calib->offset[i];
+	}
+	for (i = 0; i < 3; ++i) {
+		values[n++] = &calib->scale[i];
+	}
+	for (i = 0; i < CALIB_TERMS; ++i) {
+		values[n++] = &calib->x[i];
+	}
+	for (i = 0; i < CALIB_TERMS; ++i) {
+		values[n++] = &calib->y[i];
+	}
+	for (i = 0; i < 10; ++i) {
+		values[n++] = fields[i];
+	}
+	values[n++] = &calib->residual;
+	values[n++] = &calib->residual_max;
+}
+
+// Parse "<key> <width> <height>" and return the rest of the line, NULL if
+// the line is not for this key and resolution
+static char* calib_match(char* line, const char* key, int width, int height) {
+	const size_t length = strlen(key);
+	char* end = NULL;
+	if (strncmp(line, key, length) != 0 || line[length] != ' ') {
+		return NULL;
+	}
+	line += length;
+	if (strtol(line, &end, 10) != width || end == line) {
+		return NULL;
+	}
+	line = end;
+	if (strtol(line, &end, 10) != height || end == line) {
+		return NULL;
+	}
+	return end;
+}
+
+int calib_load(calib_t* calib, const char* path, const char* key, int width, int height) {
+	char line[CALIB_LINE];
+	double* values[CALIB_VALUES];
+	int version = 0, found = 0, i = 0;
+	FILE* file = fopen(path, "r");
+	if (file == NULL) {
+		return 0;
+	}
+	if (fgets(line, sizeof(line), file) == NULL ||
+		sscanf(line, "blue-calibration %d", &version) != 1 || version != CALIB_FILE_VERSION) {
+		fclose(file);
+		return 0;
+	}
+	while (!found && fgets(line, sizeof(line), file) != NULL) {
+		char* cursor = calib_match(line, key, width, height);
+		char* end = NULL;
+		if (cursor == NULL) {
+			continue;
+		}
+		memset(calib, 0, sizeof(*calib));
+		calib->width = width;
+		calib->height = height;
+		calib->model = (int)strtol(cursor, &end, 10);
+		found = (end != cursor);
+		calib_values(calib, values);
+		for (i = 0; found && i < CALIB_VALUES; ++i) {
+			cursor = end;
+			*values[i] = strtod(cursor, &end);
+			found = (end != cursor) && isfinite(*values[i]);
+		}
+	}
+	fclose(file);
+	return found && calib->model >= CALIB_PIECEWISE && calib->model <= CALIB_QUADRATIC &&
+		calib->residual_max <= CALIB_MAX_RESIDUAL;
+}
+
+int calib_save(const calib_t* calib, const char* path, const char* key) {
+	char lines[CALIB_MAX_LINES][CALIB_LINE];
+	char temporary[CALIB_LINE];
+	double* values[CALIB_VALUES];
+	calib_t copy = *calib;
+	int count = 0, version = 0, i = 0;
+
+	// Keep the other guns and resolutions
+	FILE* file = fopen(path, "r");
+	if (file != NULL) {
+		if (fgets(lines[0], CALIB_LINE, file) != NULL &&
+			sscanf(lines[0], "blue-calibration %d", &version) == 1 && version == CALIB_FILE_VERSION) {
+			while (count < CALIB_MAX_LINES - 1 && fgets(lines[count], CALIB_LINE, file) != NULL) {
+				if (calib_match(lines[count], key, calib->width, calib->height) == NULL) {
+					++count;
+				}
+			}
+		}
+		fclose(file);
+	}
+
+	// Write a new file and rename it so that a crash never leaves half of it
+	snprintf(temporary, sizeof(temporary), "%s.tmp", path);
+	file = fopen(temporary, "w");
+	if (file == NULL) {
+		return 0;
+	}
+	fprintf(file, "blue-calibration %d\n", CALIB_FILE_VERSION);
+	for (i = 0; i < count; ++i) {
+		fputs(lines[i], file);
+	}
+	fprintf(file, "%s %d %d %d", key, calib->width, calib->height, calib->model);
+	calib_values(&copy, values);
+	for (i = 0; i < CALIB_VALUES; ++i) {
+		fprintf(file, " %.17g", *values[i]);
+	}
+	fprintf(file, "\n");
+	if (fclose(file) != 0) {
+		remove(temporary);
+		return 0;
+	}
+	return rename(temporary, path) == 0;
+}
@@ -0,0 +1,82 @@
+#ifndef CALIB_H
+#define CALIB_H
+
+#define CALIB_POINTS 9
+
+// Mapping models from gun angles to the screen :
+// the original per-axis piecewise linear one, and least-squares fits of
+// an affine or quadratic polynomial of yaw, pitch and roll
+#define CALIB_PIECEWISE 0
+#define CALIB_AFFINE 1
+#define CALIB_QUADRATIC 2
+
+// Terms of the fitted models, on centered and scaled angles a, b, c :
+// 1, a, b, c, a*b, a*a, b*b. The affine model uses the first four.
+#define CALIB_TERMS 7
+
+typedef struct calib {
+	int model;
+	int width;
+	int height;
+	// Angle normalization, yaw pitch roll
+	double offset[3];
+	double scale[3];
+	// Screen position in uinput units, sum of coefficients times terms
+	double x[CALIB_TERMS];
+	double y[CALIB_TERMS];
+	// Piecewise model
+	double middle_x, left, right;
+	double middle_y, up, down;
+	double deg_to_pixel_x1, deg_to_pixel_x2, deg_to_pixel_y1, deg_to_pixel_y2;
+	// Error on the calibration points in pixels
+	double residual;
+	double residual_max;
+} calib_t;
+
+// Fit the model to the angles measured while aiming at the targets (in
+// pixels), given in the calibration order of the targets : left column top
+// to bottom, middle column bottom to top, right column top to bottom.
+// The quadratic model falls back to affine when the samples do not
+// constrain it and roll is left out when it does not vary.
+// Returns 0 when no model could be fitted.
+int calib_solve(calib_t* calib, int model, int width, int height,
+	const double yaw[CALIB_POINTS], const double pitch[CALIB_POINTS], const double roll[CALIB_POINTS],
+	const double target_x[CALIB_POINTS], const double target_y[CALIB_POINTS]);
+
+// Screen position in uinput units (0 to UINT16_MAX) of the fitted models
+static inline void calib_map(const calib_t* calib, double yaw, double pitch, double roll, int* x, int* y) {
+	const double a = (yaw - calib->offset[0]) * calib->scale[0];
+	const double b = (pitch - calib->offset[1]) * calib->scale[1];
+	const double c = (roll - calib->offset[2]) * calib->scale[2];
+	const double ab = a * b, aa = a * a, bb = b * b;
+	double px = calib->x[0] + calib->x[1] * a + calib->x[2] * b + calib->x[3] * c + calib->x[4] * ab + calib->x[5] * aa + calib->x[6] * bb;
+	double py = calib->y[0] + calib->y[1] * a + calib->y[2] * b + calib->y[3] * c + calib->y[4] * ab + calib->y[5] * aa + calib->y[6] * bb;
+	px = px < 0.0 ? 0.0 : (px > 65535.0 ? 65535.0 : px);
+	py = py < 0.0 ? 0.0 : (py > 65535.0 ? 65535.0 : py);
+	*x = (int)px;
+	*y = (int)py;
+}
+
+// Angles far outside the calibrated range, e.g. a yaw reference that moved
+// since the calibration. Returns 0 for such angles.
+int calib_plausible(const calib_t* calib, double yaw, double pitch);
+
+// Calibration file : a "blue-calibration <version>" header then one line
+// per gun and screen resolution, "<key> <width> <height> <model> <values>"
+#define CALIB_FILE_VERSION 1
+
+// Load the calibration stored for key at this resolution. Returns 0 when
+// there is none, the file version differs or the stored model is unusable.
+int calib_load(calib_t* calib, const char* path, const char* key, int width, int height);
+
+// Store the calibration for key, replacing the previous one for the same
+// key and resolution. Returns 0 on failure.
+int calib_save(const calib_t* calib, const char* path, const char* key);
+
+// Screen position of the piecewise model
+void calib_piecewise_map(const calib_t* calib, double yaw, double pitch, double roll, int* x, int* y);
+
+// Any model
+void calib_to_screen(const calib_t* calib, double yaw, double pitch, double roll, int* x, int* y);
+
+#endif
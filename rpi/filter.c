@@ -0,0 +1,106 @@
+#include <math.h>
+#include <string.h>
+#include "filter.h"
+
+static const char* FILTER_NAMES[] = { "none", "euro", "kalman" };
+// Longest gap between samples still filtered, a longer one restarts
+static const double FILTER_MAX_DT = 0.5;
+
+void filter_init(filter_t* filter, int type) {
+	memset(filter, 0, sizeof(*filter));
+	filter->type = type;
+	// Tuned on the synthetic 50 Hz trajectories of bench/filter_bench.c
+	filter->min_cutoff = 0.5;
+	filter->beta = 1.0;
+	filter->d_cutoff = 1.0;
+	filter->process = 100.0;
+	filter->measurement = 0.5;
+}
+
+void filter_reset(filter_t* filter) {
+	filter->primed = 0;
+}
+
+// Smoothing factor of a first order low pass
+static double one_euro_alpha(double cutoff, double dt) {
+	const double tau = 1.0 / (2.0 * M_PI * cutoff);
+	return 1.0 / (1.0 + tau / dt);
+}
+
+static double one_euro(const filter_t* filter, filter_axis_t* axis, double x, double dt) {
+	const double dx = (x - axis->x) / dt;
+	axis->dx += one_euro_alpha(filter->d_cutoff, dt) * (dx - axis->dx);
+	const double cutoff = filter->min_cutoff + filter->beta * fabs(axis->dx);
+	axis->x += one_euro_alpha(cutoff, dt) * (x - axis->x);
+	return axis->x + axis->dx * filter->predict_s;
+}
+
+static double kalman(const filter_t* filter, filter_axis_t* axis, double z, double dt) {
+	// Predict with a white acceleration of variance process^2
+	const double q = filter->process * filter->process;
+	const double dt2 = dt * dt;
+	axis->p += axis->v * dt;
+	const double p00 = axis->p00 + dt * (2.0 * axis->p01 + dt * axis->p11) + q * dt2 * dt2 / 4.0;
+	const double p01 = axis->p01 + dt * axis->p11 + q * dt2 * dt / 2.0;
+	const double p11 = axis->p11 + q * dt2;
+	// Update with the measured angle
+	const double s = p00 + filter->measurement * filter->measurement;
+	const double k0 = p00 / s, k1 = p01 / s;
+	const double innovation = z - axis->p;
+	axis->p += k0 * innovation;
+	axis->v += k1 * innovation;
+	axis->p00 = (1.0 - k0) * p00;
+	axis->p01 = (1.0 - k0) * p01;
+	axis->p11 = p11 - k1 * p01;
+	return axis->p + axis->v * filter->predict_s;
+}
+
+static void filter_prime(filter_t* filter, double yaw, double pitch) {
+	const double values[2] = { yaw, pitch };
+	int i = 0;
+	for (i = 0; i < 2; ++i) {
+		filter_axis_t* axis = &filter->axes[i];
+		axis->x = axis->p = values[i];
+		axis->dx = axis->v = 0.0;
+		axis->p00 = filter->measurement * filter->measurement;
+		axis->p01 = 0.0;
+		// Unknown speed, up to 100 deg/s
+		axis->p11 = 100.0 * 100.0;
+	}
+	filter->primed = 1;
+}
+
+void filter_update(filter_t* filter, uint64_t time_ns, double yaw, double pitch, double* out_yaw, double* out_pitch) {
+	const double dt = (time_ns - filter->last_ns) / 1e9;
+	if (filter->type == FILTER_NONE) {
+		*out_yaw = yaw;
+		*out_pitch = pitch;
+		return;
+	}
+	if (!filter->primed || time_ns <= filter->last_ns || dt > FILTER_MAX_DT) {
+		filter_prime(filter, yaw, pitch);
+		filter->last_ns = time_ns;
+		*out_yaw = yaw;
+		*out_pitch = pitch;
+		return;
+	}
+	filter->last_ns = time_ns;
+	if (filter->type == FILTER_ONE_EURO) {
+		*out_yaw = one_euro(filter, &filter->axes[0], yaw, dt);
+		*out_pitch = one_euro(filter, &filter->axes[1], pitch, dt);
+	}
+	else {
+		*out_yaw = kalman(filter, &filter->axes[0], yaw, dt);
+		*out_pitch = kalman(filter, &filter->axes[1], pitch, dt);
+	}
+}
+
+int filter_type(const char* name) {
+	int i = 0;
+	for (i = 0; i < 3; ++i) {
+		if (strcmp(name, FILTER_NAMES[i]) == 0) {
+			return i;
+		}
+	}
+	return -1;
+}
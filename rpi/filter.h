@@ -0,0 +1,51 @@
+#ifndef FILTER_H
+#define FILTER_H
+
+#include <stdint.h>
+
+#define FILTER_NONE 0
+#define FILTER_ONE_EURO 1
+#define FILTER_KALMAN 2
+
+// State of one angle
+typedef struct filter_axis {
+	// One-Euro : filtered angle and speed in deg/s
+	double x;
+	double dx;
+	// Kalman : angle, speed and their covariance
+	double p;
+	double v;
+	double p00, p01, p11;
+} filter_axis_t;
+
+// Smoothing of the yaw and pitch of a gun, and prediction along the
+// estimated speed. No allocation, a few dozen flops per sample.
+typedef struct filter {
+	int type;
+	// One-Euro : cutoff at rest in Hz, its increase per deg/s, speed cutoff in Hz
+	double min_cutoff;
+	double beta;
+	double d_cutoff;
+	// Kalman, constant speed : acceleration noise in deg/s^2, measurement noise in deg
+	double process;
+	double measurement;
+	// Output ahead of the last sample by this much
+	double predict_s;
+	uint64_t last_ns;
+	int primed;
+	filter_axis_t axes[2];
+} filter_t;
+
+// Default parameters of the type, no prediction
+void filter_init(filter_t* filter, int type);
+
+// Forget the past samples, e.g. after a calibration
+void filter_reset(filter_t* filter);
+
+// Filter the sample taken at time_ns, out_yaw and out_pitch may be yaw and pitch
+void filter_update(filter_t* filter, uint64_t time_ns, double yaw, double pitch, double* out_yaw, double* out_pitch);
+
+// "none", "euro" or "kalman", -1 when unknown
+int filter_type(const char* name);
+
+#endif
@@ -0,0 +1,76 @@
+#include <string.h>
+#include "framer.h"
+
+void framer_init(framer_t* framer) {
+	memset(framer, 0, sizeof(*framer));
+}
+
+static int is_start(uint8_t c) {
+	return c == FRAME_SOF || (c >= 'A' && c <= 'E');
+}
+
+static int is_ascii_payload(uint8_t c) {
+	return (c >= '0' && c <= '9') || c == ' ' || c == '.' || c == '-' || c == '+' || c == ';';
+}
+
+static size_t framer_push(framer_t* framer, uint8_t c, framer_cb_t cb, void* user_data);
+
+// Drop the first byte of a bad frame and scan the rest again
+static size_t framer_resync(framer_t* framer, framer_cb_t cb, void* user_data) {
+	uint8_t pending[FRAMER_SIZE];
+	size_t length = framer->length - 1;
+	memcpy(pending, framer->buffer + 1, length);
+	framer->length = 0;
+	++framer->errors;
+	return framer_feed(framer, pending, length, cb, user_data);
+}
+
+static size_t framer_complete(framer_t* framer, const message_t* msg, framer_cb_t cb, void* user_data) {
+	framer->length = 0;
+	++framer->frames;
+	cb(msg, user_data);
+	return 1;
+}
+
+static size_t framer_push(framer_t* framer, uint8_t c, framer_cb_t cb, void* user_data) {
+	if (framer->length == 0) {
+		if (!is_start(c)) {
+			++framer->skipped;
+			return 0;
+		}
+	}
+	else if (framer->buffer[0] != FRAME_SOF && !is_ascii_payload(c)) {
+		// Broken ASCII frame, the current byte may start the next one
+		size_t count = framer_resync(framer, cb, user_data);
+		return count + framer_push(framer, c, cb, user_data);
+	}
+	framer->buffer[framer->length++] = c;
+
+	message_t msg;
+	if (framer->buffer[0] == FRAME_SOF) {
+		if (framer->length < FRAME_SIZE) {
+			return 0;
+		}
+		if (frame_decode(framer->buffer, &msg)) {
+			return framer_complete(framer, &msg, cb, user_data);
+		}
+	}
+	else if (c == ';') {
+		if (ascii_decode((const char*)framer->buffer, framer->length, &msg)) {
+			return framer_complete(framer, &msg, cb, user_data);
+		}
+	}
+	else if (framer->length < FRAMER_SIZE) {
+		return 0;
+	}
+	return framer_resync(framer, cb, user_data);
+}
+
+size_t framer_feed(framer_t* framer, const uint8_t* data, size_t data_length, framer_cb_t cb, void* user_data) {
+	size_t count = 0;
+	size_t i = 0;
+	for (i = 0; i < data_length; ++i) {
+		count += framer_push(framer, data[i], cb, user_data);
+	}
+	return count;
+}
@@ -0,0 +1,29 @@
+#ifndef FRAMER_H
+#define FRAMER_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include "protocol.h"
+
+// Longest ASCII frame accepted, "E -179.99 -179.99 -179.99;" is 27 bytes
+#define FRAMER_SIZE 32U
+
+typedef void (*framer_cb_t)(const message_t* msg, void* user_data);
+
+// Incremental framer for the notification stream. Any number of ASCII or
+// binary frames per notification, frames split across notifications, and
+// resynchronization on the next start byte after garbage.
+typedef struct framer {
+	uint8_t buffer[FRAMER_SIZE];
+	size_t length;
+	unsigned long frames;
+	unsigned long errors;
+	unsigned long skipped;
+} framer_t;
+
+void framer_init(framer_t* framer);
+
+// Calls cb for each complete frame, returns the number of frames decoded
+size_t framer_feed(framer_t* framer, const uint8_t* data, size_t data_length, framer_cb_t cb, void* user_data);
+
+#endif
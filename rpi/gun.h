@@ -0,0 +1,86 @@
+#ifndef GUN_H
+#define GUN_H
+
+#include <stdint.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include "calib.h"
+#include "filter.h"
+#include "framer.h"
+#include "health.h"
+#include "queue.h"
+#include "report.h"
+#include "session.h"
+#include "shot.h"
+#include "stats.h"
+#include "telemetry.h"
+#include "trace.h"
+#include "transport.h"
+#include "upsample.h"
+
+#define GUN_MAX 4
+
+// Everything the daemon knows about one gun. The transport callbacks and
+// the router only touch the gun they are given.
+typedef struct gun {
+	int index;
+	// Empty until a scan found the gun
+	char address[TRANSPORT_ADDRESS];
+	transport_t transport;
+	int connected;
+	// A worker thread is opening the link, see gun_connect()
+	int connecting;
+	// Next connection attempt, the delay doubles after each failure
+	unsigned int retry_source;
+	int retry_ms;
+	uint64_t connected_ns;
+	uint64_t lost_ns;
+	// Frame rate, jitter and loss, a silent link is dropped
+	health_t health;
+
+	framer_t framer;
+	// Receipt time of the notification being framed
+	uint64_t received_ns;
+	queue_t queue;
+	trace_t capture;
+	stats_t stats;
+
+	// Virtual mouse, or the write end of the headless sink
+	int fd;
+	int sink[2];
+	pthread_t thread_sink;
+	unsigned long sink_bytes;
+	report_t report;
+
+	int protocol;
+	// INIT/STAB/CALIBRATION/GAME flow and its timer
+	session_t session;
+	// Dequeue time of the frame being routed
+	uint64_t dequeued_ns;
+	// Trigger release, 0 when none
+	uint64_t release_ns;
+	unsigned int wakeup_source;
+	uint64_t wakeup_ns;
+
+	int calib_point;
+	double yaw[CALIB_POINTS], pitch[CALIB_POINTS], roll[CALIB_POINTS];
+	calib_t calib;
+	// Smoothing and prediction of the aim in game
+	filter_t filter;
+	unsigned long filter_samples;
+	// Recent aim frames, to shoot where the gun pointed at the trigger edge
+	shot_t shot;
+	// Cursor at the output rate, and the receipt of the newest aim frame
+	// until an output showed it
+	upsample_t upsample;
+	uint64_t upsample_received_ns;
+	// Published into the shared memory segment by the router
+	telemetry_state_t telemetry;
+	// calib holds a fit for this screen, kept across reconnections
+	int calibrated;
+	// Aim frames left to check against a stored calibration
+	int check_frames;
+	int check_plausible;
+} gun_t;
+
+#endif
@@ -0,0 +1,152 @@
+#include <stdlib.h>
+#include "health.h"
+
+static const char* HEALTH_NAMES[] = { "idle", "ok", "degraded", "silent" };
+
+// Longest expected silence between two frames, a shot pause and a period
+static uint64_t health_gap_ns(const health_t* health) {
+	return (HEALTH_SHOT_PAUSE_MS + 2 * atomic_load(&health->period_ms)) * 1000000ULL;
+}
+
+void health_init(health_t* health, uint64_t now_ns) {
+	atomic_init(&health->last_seen_ns, now_ns);
+	atomic_init(&health->state, HEALTH_IDLE);
+	atomic_init(&health->period_ms, HEALTH_ASCII_PERIOD_MS);
+	health->binary = 0;
+	health->shot_time = 0;
+	health->streaming = 0;
+	health->previous_ns = 0;
+	health->previous_timed_ns = 0;
+	health->previous_time = 0;
+	health->previous_seq = 0;
+	health->previous_interval_ns = 0;
+	histogram_reset(&health->interval);
+	atomic_init(&health->jitter_ns, 0);
+	atomic_init(&health->frames, 0);
+	atomic_init(&health->gaps, 0);
+	atomic_init(&health->lost, 0);
+	health->window_ns = now_ns;
+	health->window_frames = 0;
+	health->window_lost = 0;
+	health->window_gaps = 0;
+	health->dump_ns = now_ns;
+	health->dump_frames = 0;
+}
+
+void health_start(health_t* health, int protocol) {
+	health->binary = protocol >= PROTOCOL_BINARY;
+	health->shot_time = protocol >= PROTOCOL_SHOT_TIME;
+	health->streaming = 0;
+	atomic_store(&health->period_ms, health->binary ? HEALTH_BINARY_PERIOD_MS : HEALTH_ASCII_PERIOD_MS);
+}
+
+void health_frame(health_t* health, const message_t* msg, uint64_t received_ns) {
+	atomic_store_explicit(&health->last_seen_ns, received_ns, memory_order_relaxed);
+	if (msg->type == 'A') {
+		health_start(health, msg->seq);
+		return;
+	}
+	// Intervals only make sense once the firmware sends alive frames
+	if (!health->streaming) {
+		if (msg->type == 'D' || msg->type == 'E') {
+			health->streaming = 1;
+			health->previous_ns = received_ns;
+			health->previous_timed_ns = 0;
+			health->previous_seq = msg->seq;
+			health->previous_interval_ns = 0;
+			health->window_ns = received_ns;
+		}
+		return;
+	}
+
+	const int64_t interval = received_ns > health->previous_ns ? (int64_t)(received_ns - health->previous_ns) : 0;
+	int64_t deviation = 0;
+	histogram_record(&health->interval, interval);
+	atomic_fetch_add_explicit(&health->frames, 1, memory_order_relaxed);
+	if ((uint64_t)interval > health_gap_ns(health)) {
+		atomic_fetch_add_explicit(&health->gaps, 1, memory_order_relaxed);
+	}
+	if (health->binary) {
+		// Sequence wraps at 256, a backward step is a duplicate, not a loss
+		const uint8_t step = (uint8_t)(msg->seq - health->previous_seq);
+		if (step > 1 && step < 128) {
+			atomic_fetch_add_explicit(&health->lost, step - 1, memory_order_relaxed);
+		}
+		// The time of a shot is its trigger edge, not usable for the jitter
+		if (!health->shot_time || msg->type != 'D') {
+			if (health->previous_timed_ns != 0) {
+				deviation = (int64_t)(received_ns - health->previous_timed_ns) - (int64_t)(uint16_t)(msg->time - health->previous_time) * 1000000;
+			}
+			health->previous_timed_ns = received_ns;
+			health->previous_time = msg->time;
+		}
+	}
+	else if (health->previous_interval_ns != 0 && (uint64_t)interval <= health_gap_ns(health)) {
+		deviation = interval - health->previous_interval_ns;
+	}
+	const uint64_t jitter = atomic_load_explicit(&health->jitter_ns, memory_order_relaxed);
+	atomic_store_explicit(&health->jitter_ns, jitter + ((int64_t)llabs(deviation) - (int64_t)jitter) / 16, memory_order_relaxed);
+
+	health->previous_ns = received_ns;
+	health->previous_seq = msg->seq;
+	health->previous_interval_ns = interval;
+}
+
+int health_check(health_t* health, uint64_t now_ns) {
+	const uint64_t last_seen = atomic_load_explicit(&health->last_seen_ns, memory_order_relaxed);
+	const uint64_t silence = now_ns > last_seen ? now_ns - last_seen : 0;
+	int state = atomic_load(&health->state);
+	if (silence > (health->streaming ? HEALTH_STREAM_TIMEOUT_MS : HEALTH_IDLE_TIMEOUT_MS) * 1000000ULL) {
+		state = HEALTH_SILENT;
+	}
+	else if (!health->streaming) {
+		state = HEALTH_IDLE;
+	}
+	else if (silence > health_gap_ns(health)) {
+		state = HEALTH_DEGRADED;
+	}
+	else if (now_ns - health->window_ns >= HEALTH_WINDOW_MS * 1000000ULL) {
+		const unsigned long frames = atomic_load(&health->frames);
+		const unsigned long lost = atomic_load(&health->lost);
+		const unsigned long gaps = atomic_load(&health->gaps);
+		const double expected = (now_ns - health->window_ns) / 1e6 / atomic_load(&health->period_ms);
+		const unsigned long window_frames = frames - health->window_frames;
+		const unsigned long window_lost = lost - health->window_lost;
+		const int low_rate = window_frames < expected * HEALTH_MIN_RATE;
+		const int lossy = window_lost > (window_frames + window_lost) * HEALTH_MAX_LOSS;
+		state = low_rate || lossy || gaps != health->window_gaps ? HEALTH_DEGRADED : HEALTH_OK;
+		health->window_ns = now_ns;
+		health->window_frames = frames;
+		health->window_lost = lost;
+		health->window_gaps = gaps;
+	}
+	else if (state != HEALTH_DEGRADED) {
+		// Frames flow again, the window decides on the degradation
+		state = HEALTH_OK;
+	}
+	atomic_store(&health->state, state);
+	return state;
+}
+
+const char* health_name(int state) {
+	return HEALTH_NAMES[state];
+}
+
+void health_dump(health_t* health, FILE* file) {
+	const uint64_t now = stats_now_ns();
+	const double elapsed = (now - health->dump_ns) / 1e9;
+	const unsigned long frames = atomic_load(&health->frames);
+	const unsigned long lost = atomic_load(&health->lost);
+	const int period = atomic_load(&health->period_ms);
+	fprintf(file, "link %s rate_hz %.1f expected_hz %.1f jitter_ms %.2f gaps %lu lost %lu loss_pct %.2f\n",
+		health_name(atomic_load(&health->state)),
+		elapsed > 0 ? (frames - health->dump_frames) / elapsed : 0.0, 1000.0 / period,
+		atomic_load(&health->jitter_ns) / 1e6, atomic_load(&health->gaps), lost,
+		frames + lost > 0 ? 100.0 * lost / (frames + lost) : 0.0);
+	fprintf(file, "interval p50_ms %.1f p99_ms %.1f max_ms %.1f\n",
+		histogram_percentile(&health->interval, 50.0) / 1e6,
+		histogram_percentile(&health->interval, 99.0) / 1e6,
+		atomic_load(&health->interval.max) / 1e6);
+	health->dump_ns = now;
+	health->dump_frames = frames;
+}
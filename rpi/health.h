@@ -0,0 +1,82 @@
+#ifndef HEALTH_H
+#define HEALTH_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdatomic.h>
+#include "protocol.h"
+#include "stats.h"
+
+// Alive frame period of the firmware, ALIVE_DELAY and BINARY_ALIVE_DELAY
+#define HEALTH_ASCII_PERIOD_MS 50
+#define HEALTH_BINARY_PERIOD_MS 20
+// After a shot the firmware holds the alive frames for 2 * ALIVE_DELAY
+#define HEALTH_SHOT_PAUSE_MS (2 * HEALTH_ASCII_PERIOD_MS)
+// Silence dropping the link, before and once the aim frames flow
+#define HEALTH_IDLE_TIMEOUT_MS 15000
+#define HEALTH_STREAM_TIMEOUT_MS 2000
+// Checks over this window, degraded below half the expected rate or above
+// 5% sequence loss
+#define HEALTH_WINDOW_MS 1000
+#define HEALTH_MIN_RATE 0.5
+#define HEALTH_MAX_LOSS 0.05
+
+enum {
+	HEALTH_IDLE,      // connected, no aim frame yet
+	HEALTH_OK,
+	HEALTH_DEGRADED,  // low rate, loss or a gap
+	HEALTH_SILENT     // nothing for the timeout, drop the link
+};
+
+// Link quality of one gun. health_frame() runs for every frame in the
+// notification callback, health_check() in the GLib loop and health_dump()
+// in the statistics thread.
+typedef struct health {
+	// The watchdog only needs this store per frame
+	atomic_ullong last_seen_ns;
+	atomic_int state;
+	atomic_int period_ms;
+	int binary;
+	// 'D' frames carry the trigger time instead of their send time
+	int shot_time;
+	int streaming;
+	// Previous frame, for the intervals, jitter and sequence
+	uint64_t previous_ns;
+	// Previous frame stamped with its send time
+	uint64_t previous_timed_ns;
+	uint16_t previous_time;
+	uint8_t previous_seq;
+	int64_t previous_interval_ns;
+	// Inter-arrival times in ns
+	histogram_t interval;
+	// RFC 3550 smoothed jitter in ns, on the MCU time stamps in binary and
+	// on the interval variation in ASCII
+	atomic_ullong jitter_ns;
+	atomic_ulong frames;
+	atomic_ulong gaps;
+	atomic_ulong lost;
+	// Snapshots for health_check()
+	uint64_t window_ns;
+	unsigned long window_frames;
+	unsigned long window_lost;
+	unsigned long window_gaps;
+	// Snapshots for health_dump()
+	uint64_t dump_ns;
+	unsigned long dump_frames;
+} health_t;
+
+void health_init(health_t* health, uint64_t now_ns);
+
+// Expected rate from the protocol version announced by the 'A' frame
+void health_start(health_t* health, int protocol);
+
+void health_frame(health_t* health, const message_t* msg, uint64_t received_ns);
+
+// Returns the new state, called periodically
+int health_check(health_t* health, uint64_t now_ns);
+
+const char* health_name(int state);
+
+void health_dump(health_t* health, FILE* file);
+
+#endif
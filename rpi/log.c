@@ -0,0 +1,153 @@
+#include <pthread.h>
+#include <signal.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include "log.h"
+
+typedef struct log_record {
+	uint64_t time_ns;
+	int level;
+	char text[LOG_TEXT];
+} log_record_t;
+
+// Bounded multi-producer ring : a slot is free for the position p when its
+// sequence is p, and holds a record for the writer when it is p + 1
+typedef struct log_slot {
+	atomic_size_t sequence;
+	log_record_t record;
+} log_slot_t;
+
+static const char LOG_NAMES[] = "DIWE";
+
+static log_slot_t m_slots[LOG_SLOTS];
+static atomic_size_t m_head;
+static size_t m_tail = 0;
+static atomic_ulong m_dropped;
+static atomic_int m_running;
+static FILE* m_file = NULL;
+static pthread_t m_thread;
+static uint64_t m_start_ns = 0;
+// One batch of formatted lines per file write
+static char m_batch[64 * 1024];
+
+static uint64_t log_now_ns(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000U + ts.tv_nsec;
+}
+
+// Write out every ready record, returns how many
+static size_t log_drain(void) {
+	static unsigned long reported = 0;
+	size_t length = 0, count = 0;
+	for (;;) {
+		log_slot_t* slot = &m_slots[m_tail & (LOG_SLOTS - 1)];
+		if (atomic_load_explicit(&slot->sequence, memory_order_acquire) != m_tail + 1) {
+			break;
+		}
+		const log_record_t* record = &slot->record;
+		const uint64_t time_ns = record->time_ns - m_start_ns;
+		if (length + LOG_TEXT + 32 > sizeof(m_batch)) {
+			fwrite(m_batch, 1, length, m_file);
+			length = 0;
+		}
+		const size_t text_length = strlen(record->text);
+		// A truncated message keeps its line
+		length += snprintf(m_batch + length, sizeof(m_batch) - length, "%llu.%06llu %c %s%s",
+			(unsigned long long)(time_ns / 1000000000U), (unsigned long long)(time_ns % 1000000000U / 1000),
+			LOG_NAMES[record->level], record->text, text_length > 0 && record->text[text_length - 1] == '\n' ? "" : "\n");
+		atomic_store_explicit(&slot->sequence, m_tail + LOG_SLOTS, memory_order_release);
+		++m_tail;
+		++count;
+	}
+	const unsigned long dropped = atomic_load(&m_dropped);
+	if (dropped != reported) {
+		length += snprintf(m_batch + length, sizeof(m_batch) - length, "%lu log messages dropped\n", dropped - reported);
+		reported = dropped;
+	}
+	if (length > 0) {
+		fwrite(m_batch, 1, length, m_file);
+		fflush(m_file);
+	}
+	return count;
+}
+
+static void* log_loop(void* arg) {
+	const struct timespec period = { 0, LOG_FLUSH_MS * 1000000L };
+	while (atomic_load(&m_running)) {
+		// Several batches in a row when the ring is filling up
+		if (log_drain() == 0) {
+			nanosleep(&period, NULL);
+		}
+	}
+	log_drain();
+	return NULL;
+}
+
+void log_open(const char* path) {
+	size_t i = 0;
+	m_file = path != NULL ? fopen(path, "w") : NULL;
+	if (m_file == NULL) {
+		m_file = stderr;
+	}
+	for (i = 0; i < LOG_SLOTS; ++i) {
+		atomic_init(&m_slots[i].sequence, i);
+	}
+	atomic_init(&m_head, 0);
+	m_tail = 0;
+	atomic_init(&m_dropped, 0);
+	m_start_ns = log_now_ns();
+	atomic_init(&m_running, 1);
+	// The writer inherits a mask with every signal blocked, they are left
+	// to the threads of the program
+	sigset_t all, previous;
+	sigfillset(&all);
+	pthread_sigmask(SIG_BLOCK, &all, &previous);
+	pthread_create(&m_thread, NULL, log_loop, NULL);
+	pthread_sigmask(SIG_SETMASK, &previous, NULL);
+}
+
+void log_close(void) {
+	atomic_store(&m_running, 0);
+	pthread_join(m_thread, NULL);
+	if (m_file != stderr) {
+		fclose(m_file);
+	}
+	m_file = NULL;
+}
+
+void log_write(int level, const char* format, ...) {
+	size_t position = atomic_load_explicit(&m_head, memory_order_relaxed);
+	log_slot_t* slot = NULL;
+	va_list args;
+	for (;;) {
+		slot = &m_slots[position & (LOG_SLOTS - 1)];
+		const size_t sequence = atomic_load_explicit(&slot->sequence, memory_order_acquire);
+		if (sequence == position) {
+			if (atomic_compare_exchange_weak_explicit(&m_head, &position, position + 1,
+				memory_order_relaxed, memory_order_relaxed)) {
+				break;
+			}
+		}
+		else if (sequence < position) {
+			// Full, the writer is behind : never block the caller
+			atomic_fetch_add_explicit(&m_dropped, 1, memory_order_relaxed);
+			return;
+		}
+		else {
+			position = atomic_load_explicit(&m_head, memory_order_relaxed);
+		}
+	}
+	slot->record.time_ns = log_now_ns();
+	slot->record.level = level;
+	va_start(args, format);
+	vsnprintf(slot->record.text, sizeof(slot->record.text), format, args);
+	va_end(args);
+	atomic_store_explicit(&slot->sequence, position + 1, memory_order_release);
+}
+
+unsigned long log_dropped(void) {
+	return atomic_load(&m_dropped);
+}
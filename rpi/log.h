@@ -0,0 +1,37 @@
+#ifndef LOG_H
+#define LOG_H
+
+#include <stdint.h>
+#include <stdatomic.h>
+
+#define LOG_DEBUG 0
+#define LOG_INFO 1
+#define LOG_WARN 2
+#define LOG_ERROR 3
+
+// Messages below this level are compiled out, -DLOG_LEVEL=0 for the debug ones
+#ifndef LOG_LEVEL
+#define LOG_LEVEL LOG_INFO
+#endif
+
+// Record text, longer messages are truncated
+#define LOG_TEXT 116
+// Records waiting for the writer thread, 1024 * 128 bytes
+#define LOG_SLOTS 1024
+// Writer period, one write and one flush per batch
+#define LOG_FLUSH_MS 50
+
+#define LOG(level, ...) do { if ((level) >= LOG_LEVEL) log_write((level), __VA_ARGS__); } while (0)
+
+// Any thread may log. The caller stamps the time and level and formats the
+// message into a ring slot, so the time is the one of the event and not of
+// the write. The writer thread only formats the records into lines and does
+// the file I/O. When the file stalls and the ring is full, new messages are
+// dropped and counted.
+void log_open(const char* path);
+void log_close(void);
+void log_write(int level, const char* format, ...) __attribute__((format(printf, 2, 3)));
+
+unsigned long log_dropped(void);
+
+#endif
@@ -0,0 +1,117 @@
+#include <string.h>
+#include "protocol.h"
+
+// CRC-8, polynomial 0x07, same bitwise loop as the firmware
+uint8_t frame_checksum(const uint8_t* data, size_t data_length) {
+	uint8_t crc = 0;
+	size_t i = 0;
+	for (i = 0; i < data_length; ++i) {
+		crc ^= data[i];
+		int bit = 0;
+		for (bit = 0; bit < 8; ++bit) {
+			crc = (crc & 0x80) ? (uint8_t)((crc << 1) ^ 0x07) : (uint8_t)(crc << 1);
+		}
+	}
+	return crc;
+}
+
+static void put16(uint8_t* dest, uint16_t value) {
+	dest[0] = value & 0xFF;
+	dest[1] = value >> 8;
+}
+
+static uint16_t get16(const uint8_t* src) {
+	return (uint16_t)(src[0] | (src[1] << 8));
+}
+
+void frame_encode(const message_t* msg, uint8_t frame[FRAME_SIZE]) {
+	frame[0] = FRAME_SOF;
+	frame[1] = (uint8_t)msg->type;
+	frame[2] = msg->seq;
+	put16(frame + 3, msg->time);
+	put16(frame + 5, (uint16_t)msg->yaw);
+	put16(frame + 7, (uint16_t)msg->pitch);
+	put16(frame + 9, (uint16_t)msg->roll);
+	frame[11] = frame_checksum(frame + 1, FRAME_SIZE - 2);
+}
+
+int frame_decode(const uint8_t frame[FRAME_SIZE], message_t* msg) {
+	if (frame[0] != FRAME_SOF || frame_checksum(frame + 1, FRAME_SIZE - 2) != frame[11]) {
+		return 0;
+	}
+	msg->type = (char)frame[1];
+	msg->seq = frame[2];
+	msg->time = get16(frame + 3);
+	msg->yaw = (int16_t)get16(frame + 5);
+	msg->pitch = (int16_t)get16(frame + 7);
+	msg->roll = (int16_t)get16(frame + 9);
+	return 1;
+}
+
+// Parse "[-+]ddd[.ddd]" into hundredths, rounded on the third decimal.
+// A missing number leaves 0 like the previous sscanf path did.
+static const char* parse_centi(const char* p, const char* end, int16_t* value) {
+	while (p < end && *p == ' ') {
+		++p;
+	}
+	int negative = 0;
+	if (p < end && (*p == '-' || *p == '+')) {
+		negative = (*p == '-');
+		++p;
+	}
+	int32_t integer = 0;
+	int32_t fraction = 0;
+	int decimals = 0;
+	while (p < end && *p >= '0' && *p <= '9') {
+		if (integer < 1000000) {
+			integer = integer * 10 + (*p - '0');
+		}
+		++p;
+	}
+	if (p < end && *p == '.') {
+		++p;
+		while (p < end && *p >= '0' && *p <= '9') {
+			if (decimals < 3) {
+				fraction = fraction * 10 + (*p - '0');
+				++decimals;
+			}
+			++p;
+		}
+	}
+	while (decimals < 3) {
+		fraction *= 10;
+		++decimals;
+	}
+	int32_t centi = integer * 100 + (fraction + 5) / 10;
+	if (centi > INT16_MAX) {
+		centi = INT16_MAX;
+	}
+	*value = (int16_t)(negative ? -centi : centi);
+	return p;
+}
+
+int ascii_decode(const char* cmd, size_t length, message_t* msg) {
+	if (length == 0 || cmd[0] < 'A' || cmd[0] > 'E') {
+		return 0;
+	}
+	const char* end = cmd + length;
+	memset(msg, 0, sizeof(*msg));
+	msg->type = cmd[0];
+	if (msg->type == 'A') {
+		const char* p = cmd + 1;
+		int version = 0;
+		while (p < end && *p >= '0' && *p <= '9') {
+			if (version < 100) {
+				version = version * 10 + (*p - '0');
+			}
+			++p;
+		}
+		msg->seq = (uint8_t)(version ? version : PROTOCOL_ASCII);
+	}
+	else {
+		const char* p = parse_centi(cmd + 1, end, &msg->yaw);
+		p = parse_centi(p, end, &msg->pitch);
+		parse_centi(p, end, &msg->roll);
+	}
+	return 1;
+}
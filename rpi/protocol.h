@@ -0,0 +1,45 @@
+#ifndef PROTOCOL_H
+#define PROTOCOL_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Protocol versions announced by the firmware in its "A<version>;" frame.
+// Old firmware sends "A;" and only speaks ASCII.
+#define PROTOCOL_ASCII 1
+#define PROTOCOL_BINARY 2
+// Binary, the time of a 'D' frame is the trigger edge instead of its send time
+#define PROTOCOL_SHOT_TIME 3
+// Sent to the firmware to switch it to binary frames
+#define PROTOCOL_BINARY_ACK 'P'
+
+// Binary frame layout (little endian) :
+// [0] FRAME_SOF [1] type [2] sequence [3-4] MCU time in ms
+// [5-6] yaw [7-8] pitch [9-10] roll in centidegrees [11] CRC-8 of bytes 1 to 10
+#define FRAME_SOF 0xA5
+#define FRAME_SIZE 12U
+
+typedef struct message {
+	char type;
+	// Sequence number, or protocol version for 'A' frames
+	uint8_t seq;
+	uint16_t time;
+	int16_t yaw;
+	int16_t pitch;
+	int16_t roll;
+	// Host monotonic times in ns, set by the daemon
+	uint64_t received_ns;
+	uint64_t queued_ns;
+} message_t;
+
+uint8_t frame_checksum(const uint8_t* data, size_t data_length);
+
+void frame_encode(const message_t* msg, uint8_t frame[FRAME_SIZE]);
+
+// Returns 0 when the start byte or the checksum is wrong
+int frame_decode(const uint8_t frame[FRAME_SIZE], message_t* msg);
+
+// Decode a "<type> <yaw> <pitch> <roll>;" frame, returns 0 on unknown type
+int ascii_decode(const char* cmd, size_t length, message_t* msg);
+
+#endif
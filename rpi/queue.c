@@ -0,0 +1,77 @@
+#include <string.h>
+#include "queue.h"
+
+// aim_middle holds the index of the shared buffer, this flag tells
+// if it contains a sample the consumer has not seen yet
+#define AIM_FRESH 4U
+#define AIM_INDEX 3U
+
+void queue_init(queue_t* queue) {
+	memset(queue->ring, 0, sizeof(queue->ring));
+	memset(queue->aim, 0, sizeof(queue->aim));
+	atomic_init(&queue->head, 0);
+	atomic_init(&queue->tail, 0);
+	queue->aim_back = 0;
+	atomic_init(&queue->aim_middle, 1);
+	queue->aim_front = 2;
+	atomic_init(&queue->dropped, 0);
+	atomic_init(&queue->coalesced, 0);
+}
+
+int queue_push(queue_t* queue, const message_t* msg) {
+	if (msg->type == 'E') {
+		// Latest wins : publish the back buffer and take back the previous middle one
+		queue->aim[queue->aim_back] = *msg;
+		unsigned int previous = atomic_exchange_explicit(&queue->aim_middle, queue->aim_back | AIM_FRESH, memory_order_acq_rel);
+		queue->aim_back = previous & AIM_INDEX;
+		if (previous & AIM_FRESH) {
+			atomic_fetch_add_explicit(&queue->coalesced, 1, memory_order_relaxed);
+		}
+		return 1;
+	}
+
+	unsigned int head = atomic_load_explicit(&queue->head, memory_order_relaxed);
+	unsigned int tail = atomic_load_explicit(&queue->tail, memory_order_acquire);
+	if (head - tail >= QUEUE_CAPACITY) {
+		atomic_fetch_add_explicit(&queue->dropped, 1, memory_order_relaxed);
+		return 0;
+	}
+	queue->ring[head & (QUEUE_CAPACITY - 1)] = *msg;
+	atomic_store_explicit(&queue->head, head + 1, memory_order_release);
+	return 1;
+}
+
+int queue_pop(queue_t* queue, message_t* msg) {
+	unsigned int tail = atomic_load_explicit(&queue->tail, memory_order_relaxed);
+	unsigned int head = atomic_load_explicit(&queue->head, memory_order_acquire);
+	if (tail != head) {
+		*msg = queue->ring[tail & (QUEUE_CAPACITY - 1)];
+		atomic_store_explicit(&queue->tail, tail + 1, memory_order_release);
+		return 1;
+	}
+
+	if (atomic_load_explicit(&queue->aim_middle, memory_order_relaxed) & AIM_FRESH) {
+		unsigned int previous = atomic_exchange_explicit(&queue->aim_middle, queue->aim_front, memory_order_acq_rel);
+		queue->aim_front = previous & AIM_INDEX;
+		*msg = queue->aim[queue->aim_front];
+		return 1;
+	}
+	return 0;
+}
+
+unsigned int queue_depth(queue_t* queue) {
+	return atomic_load_explicit(&queue->head, memory_order_acquire) - atomic_load_explicit(&queue->tail, memory_order_acquire);
+}
+
+int queue_idle(queue_t* queue) {
+	return atomic_load_explicit(&queue->tail, memory_order_acquire) == atomic_load_explicit(&queue->head, memory_order_acquire) &&
+		!(atomic_load_explicit(&queue->aim_middle, memory_order_acquire) & AIM_FRESH);
+}
+
+unsigned long queue_dropped(queue_t* queue) {
+	return atomic_load_explicit(&queue->dropped, memory_order_relaxed);
+}
+
+unsigned long queue_coalesced(queue_t* queue) {
+	return atomic_load_explicit(&queue->coalesced, memory_order_relaxed);
+}
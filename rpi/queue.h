@@ -0,0 +1,43 @@
+#ifndef QUEUE_H
+#define QUEUE_H
+
+#include <stdatomic.h>
+#include "protocol.h"
+
+// Number of trigger/control frames that can wait for the router (power of two)
+#define QUEUE_CAPACITY 64U
+
+// Single producer (notification callback) / single consumer (router) queue.
+// Trigger and control frames (A-D) go through a lossless ring, aim frames (E)
+// through a triple buffered mailbox that only keeps the newest sample.
+typedef struct queue {
+	message_t ring[QUEUE_CAPACITY];
+	atomic_uint head;
+	atomic_uint tail;
+	message_t aim[3];
+	atomic_uint aim_middle;
+	unsigned int aim_back;
+	unsigned int aim_front;
+	atomic_ulong dropped;
+	atomic_ulong coalesced;
+} queue_t;
+
+void queue_init(queue_t* queue);
+
+// Producer side, returns 0 when a control frame had to be dropped
+int queue_push(queue_t* queue, const message_t* msg);
+
+// Consumer side, control frames first then the latest aim sample.
+// Returns 0 when there is nothing to process.
+int queue_pop(queue_t* queue, message_t* msg);
+
+// Control frames waiting for the consumer
+unsigned int queue_depth(queue_t* queue);
+
+// Nothing left for the consumer
+int queue_idle(queue_t* queue);
+
+unsigned long queue_dropped(queue_t* queue);
+unsigned long queue_coalesced(queue_t* queue);
+
+#endif
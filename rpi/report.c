@@ -0,0 +1,89 @@
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+#include "report.h"
+
+void report_init(report_t* report, int fd) {
+	memset(report->events, 0, sizeof(report->events));
+	report->fd = fd;
+	report->length = 0;
+	report->x = -1;
+	report->y = -1;
+	report->button = -1;
+	report->button_lost = 0;
+	atomic_init(&report->writes, 0);
+	atomic_init(&report->short_writes, 0);
+	atomic_init(&report->again, 0);
+	atomic_init(&report->errors, 0);
+	atomic_init(&report->skipped, 0);
+}
+
+static void report_event(report_t* report, int type, int code, int value) {
+	if (report->length < REPORT_EVENTS) {
+		struct input_event* ie = &report->events[report->length++];
+		/* timestamp values are ignored */
+		ie->type = type;
+		ie->code = code;
+		ie->value = value;
+	}
+}
+
+void report_axis(report_t* report, int code, int value) {
+	int* last = (code == ABS_X) ? &report->x : &report->y;
+	if (*last == value) {
+		atomic_fetch_add_explicit(&report->skipped, 1, memory_order_relaxed);
+		return;
+	}
+	*last = value;
+	report_event(report, EV_ABS, code, value);
+}
+
+void report_button(report_t* report, int value) {
+	report->button = value;
+	report->button_lost = 0;
+	report_event(report, EV_KEY, BTN_LEFT, value);
+}
+
+int report_submit(report_t* report) {
+	if (report->button_lost) {
+		// A dropped release would leave the button held in the game
+		report_button(report, report->button);
+	}
+	if (report->length == 0) {
+		return 1;
+	}
+	report_event(report, EV_SYN, SYN_REPORT, 0);
+
+	const char* data = (const char*)report->events;
+	size_t remaining = report->length * sizeof(struct input_event);
+	report->length = 0;
+	atomic_fetch_add_explicit(&report->writes, 1, memory_order_relaxed);
+	while (remaining > 0) {
+		ssize_t written = write(report->fd, data, remaining);
+		if (written > 0) {
+			if ((size_t)written < remaining) {
+				// uinput consumes whole events, send the rest of the report
+				atomic_fetch_add_explicit(&report->short_writes, 1, memory_order_relaxed);
+			}
+			data += written;
+			remaining -= written;
+		}
+		else if (written < 0 && errno == EINTR) {
+			continue;
+		}
+		else {
+			if (written < 0 && errno == EAGAIN) {
+				atomic_fetch_add_explicit(&report->again, 1, memory_order_relaxed);
+			}
+			else {
+				atomic_fetch_add_explicit(&report->errors, 1, memory_order_relaxed);
+			}
+			// The device state is unknown now, resend everything next time
+			report->x = -1;
+			report->y = -1;
+			report->button_lost = report->button >= 0;
+			return 0;
+		}
+	}
+	return 1;
+}
@@ -0,0 +1,39 @@
+#ifndef REPORT_H
+#define REPORT_H
+
+#include <stdatomic.h>
+#include <linux/input.h>
+
+// Enough for BTN_LEFT, ABS_X, ABS_Y and SYN_REPORT
+#define REPORT_EVENTS 8
+
+// Collects the events of one report and writes them with a single write().
+// Axes that did not change since the last report are skipped.
+typedef struct report {
+	int fd;
+	struct input_event events[REPORT_EVENTS];
+	int length;
+	// Last values written, -1 when unknown
+	int x;
+	int y;
+	// Last button state asked for, resent with the next report when the
+	// one carrying it could not be written
+	int button;
+	int button_lost;
+	atomic_ulong writes;
+	atomic_ulong short_writes;
+	atomic_ulong again;
+	atomic_ulong errors;
+	atomic_ulong skipped;
+} report_t;
+
+void report_init(report_t* report, int fd);
+void report_axis(report_t* report, int code, int value);
+void report_button(report_t* report, int value);
+
+// Append SYN_REPORT and write the report, nothing is written when no event
+// is pending. Returns 0 when the report could not be written entirely, the
+// button is then sent again by the next call.
+int report_submit(report_t* report);
+
+#endif
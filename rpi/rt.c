@@ -0,0 +1,133 @@
+#define _GNU_SOURCE
+#include <errno.h>
+#include <malloc.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <time.h>
+#include "rt.h"
+
+void rt_init(rt_t* rt) {
+	rt->priority = 0;
+	rt->cpus = 0;
+	histogram_reset(&rt->wakeup);
+}
+
+int rt_parse(rt_t* rt, const char* spec) {
+	char* end = NULL;
+	const long priority = strtol(spec, &end, 10);
+	const int max = sched_get_priority_max(SCHED_FIFO);
+	if (end == spec || priority < 0) {
+		return 0;
+	}
+	rt->priority = priority > max ? max : (int)priority;
+	rt->cpus = 0;
+	if (*end == ':') {
+		do {
+			const char* cpu = end + 1;
+			const long index = strtol(cpu, &end, 10);
+			if (end == cpu || index < 0 || index >= (long)(8 * sizeof(rt->cpus))) {
+				return 0;
+			}
+			rt->cpus |= 1UL << index;
+		} while (*end == ',');
+	}
+	return *end == '\0';
+}
+
+int rt_lock(void) {
+	// A freed block stays mapped instead of faulting again on the next malloc
+	mallopt(M_TRIM_THRESHOLD, -1);
+	mallopt(M_MMAP_MAX, 0);
+	if (mlockall(MCL_CURRENT | MCL_FUTURE) != 0) {
+		return errno;
+	}
+	return 0;
+}
+
+static void rt_prefault(void) {
+	volatile char stack[RT_STACK_PREFAULT];
+	size_t i = 0;
+	for (i = 0; i < sizeof(stack); i += 4096) {
+		stack[i] = 0;
+	}
+}
+
+int rt_thread(const rt_t* rt) {
+	int applied = 0, error = 0;
+	if (rt->cpus != 0) {
+		cpu_set_t set;
+		unsigned int cpu = 0;
+		CPU_ZERO(&set);
+		for (cpu = 0; cpu < 8 * sizeof(rt->cpus); ++cpu) {
+			if (rt->cpus & (1UL << cpu)) {
+				CPU_SET(cpu, &set);
+			}
+		}
+		error = pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+		if (error == 0) {
+			applied |= RT_CPUS;
+		}
+	}
+	if (rt->priority > 0) {
+		struct sched_param param;
+		memset(&param, 0, sizeof(param));
+		param.sched_priority = rt->priority;
+		// EPERM without root, CAP_SYS_NICE or an RLIMIT_RTPRIO
+		const int fifo_error = pthread_setschedparam(pthread_self(), SCHED_FIFO, &param);
+		if (fifo_error == 0) {
+			applied |= RT_FIFO;
+		}
+		else {
+			error = fifo_error;
+		}
+	}
+	rt_prefault();
+	errno = error;
+	return applied;
+}
+
+void rt_normal(void) {
+	struct sched_param param;
+	cpu_set_t set;
+	int cpu = 0;
+	memset(&param, 0, sizeof(param));
+	pthread_setschedparam(pthread_self(), SCHED_OTHER, &param);
+	CPU_ZERO(&set);
+	for (cpu = 0; cpu < CPU_SETSIZE; ++cpu) {
+		CPU_SET(cpu, &set);
+	}
+	pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+}
+
+void rt_wakeup(rt_t* rt, uint64_t deadline_ns, uint64_t now_ns) {
+	// Woken by a frame before the deadline
+	if (deadline_ns != 0 && now_ns >= deadline_ns) {
+		histogram_record(&rt->wakeup, now_ns - deadline_ns);
+	}
+}
+
+void rt_dump(rt_t* rt, FILE* file) {
+	fprintf(file, "rt priority %d cpus 0x%lx wakeup count %llu p50_us %.1f p99_us %.1f p999_us %.1f max_us %.1f\n",
+		rt->priority, rt->cpus,
+		(unsigned long long)atomic_load_explicit(&rt->wakeup.count, memory_order_relaxed),
+		histogram_percentile(&rt->wakeup, 50.0) / 1e3,
+		histogram_percentile(&rt->wakeup, 99.0) / 1e3,
+		histogram_percentile(&rt->wakeup, 99.9) / 1e3,
+		atomic_load_explicit(&rt->wakeup.max, memory_order_relaxed) / 1e3);
+}
+
+void rt_probe(histogram_t* histogram, uint64_t period_ns, unsigned long count) {
+	uint64_t deadline = stats_now_ns();
+	unsigned long i = 0;
+	for (i = 0; i < count; ++i) {
+		deadline += period_ns;
+		const struct timespec ts = { deadline / 1000000000U, deadline % 1000000000U };
+		while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) == EINTR) {
+		}
+		const uint64_t now = stats_now_ns();
+		histogram_record(histogram, now > deadline ? now - deadline : 0);
+	}
+}
@@ -0,0 +1,54 @@
+#ifndef RT_H
+#define RT_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include "stats.h"
+
+// Stack touched by each real time thread so that it never faults
+#define RT_STACK_PREFAULT (64 * 1024)
+
+// Parts of the profile that applied to a thread
+#define RT_FIFO 1
+#define RT_CPUS 2
+
+// Real time profile of the input path : the thread receiving the
+// notifications and the router one. The IHM, statistics, scanner and log
+// threads keep the normal scheduler and every CPU.
+typedef struct rt {
+	// SCHED_FIFO priority, 0 keeps the normal scheduler
+	int priority;
+	// CPU mask of the real time threads, 0 for every CPU
+	unsigned long cpus;
+	// Lateness of the router deadlines in ns, recorded by one thread
+	histogram_t wakeup;
+} rt_t;
+
+void rt_init(rt_t* rt);
+
+// "<priority>[:<cpu>,<cpu>...]", priority 0 only pins, returns 0 when malformed
+int rt_parse(rt_t* rt, const char* spec);
+
+// Lock the present and future pages of the process in memory, and keep
+// the freed heap. Returns 0 or the errno of mlockall().
+int rt_lock(void);
+
+// Give the profile to the calling thread and prefault its stack. Returns
+// the RT_FIFO and RT_CPUS parts that applied, errno tells why one did not.
+int rt_thread(const rt_t* rt);
+
+// Back to the normal scheduler on every CPU, for a thread started by a
+// real time one
+void rt_normal(void);
+
+// The caller woke up at now_ns for deadline_ns, 0 when it had none
+void rt_wakeup(rt_t* rt, uint64_t deadline_ns, uint64_t now_ns);
+
+// One line with the profile and the wakeup lateness percentiles
+void rt_dump(rt_t* rt, FILE* file);
+
+// Sleep count periods to absolute deadlines from the calling thread,
+// recording how late each wakeup is
+void rt_probe(histogram_t* histogram, uint64_t period_ns, unsigned long count);
+
+#endif
@@ -0,0 +1,135 @@
+#include <stddef.h>
+#include "session.h"
+
+#define SESSION_ANY -1
+
+typedef struct transition {
+	int state;
+	int event;
+	int action;
+	int next;
+} transition_t;
+
+// First match wins. A HELLO restarts the flow from any state, the resume
+// then skips the calibration.
+static const transition_t TRANSITIONS[] = {
+	{ SESSION_ANY,          EVENT_HELLO,      ACTION_HELLO,  INIT_SEQUENCE },
+	{ INIT_SEQUENCE,        EVENT_RESUME,     ACTION_RESUME, GAME_SEQUENCE },
+	{ INIT_SEQUENCE,        EVENT_TIMER,      ACTION_NONE,   STAB_SEQUENCE },
+	{ STAB_SEQUENCE,        EVENT_STABLE,     ACTION_NONE,   CALIBRATION_SEQUENCE },
+	{ CALIBRATION_SEQUENCE, EVENT_POINT,      ACTION_POINT,  CALIBRATION_SEQUENCE },
+	{ CALIBRATION_SEQUENCE, EVENT_CALIBRATED, ACTION_NONE,   GAME_SEQUENCE },
+	{ GAME_SEQUENCE,        EVENT_SHOT,       ACTION_SHOT,   GAME_SEQUENCE },
+	{ GAME_SEQUENCE,        EVENT_AIM,        ACTION_AIM,    GAME_SEQUENCE },
+	{ GAME_SEQUENCE,        EVENT_REJECTED,   ACTION_NONE,   INIT_SEQUENCE },
+};
+
+// Run when the state changes, not on a transition to the same state
+static const int STATE_ENTRY[SESSION_STATES] = {
+	ACTION_NONE, ACTION_ENTER_INIT, ACTION_ENTER_STAB, ACTION_ENTER_CALIBRATION, ACTION_ENTER_GAME
+};
+
+static const char* STATE_NAMES[SESSION_STATES] = { "idle", "init", "stab", "calibration", "game" };
+static const char* EVENT_NAMES[EVENT_COUNT] = {
+	"hello", "stable", "point", "shot", "aim", "timer", "resume", "calibrated", "rejected"
+};
+
+void session_init(session_t* session, const session_action_t* actions, void* user_data) {
+	session->state = SESSION_IDLE;
+	session->timer_ns = 0;
+	session->actions = actions;
+	session->user_data = user_data;
+	session->posted_count = 0;
+	session->last_seq = -1;
+	session->handled = 0;
+	session->ignored = 0;
+	session->duplicates = 0;
+}
+
+static void session_action(session_t* session, int action, const message_t* msg) {
+	if (action != ACTION_NONE && session->actions[action] != NULL) {
+		session->actions[action](session, msg);
+	}
+}
+
+static int session_run(session_t* session, int event, const message_t* msg) {
+	const transition_t* transition = NULL;
+	size_t i = 0;
+	for (i = 0; i < sizeof(TRANSITIONS) / sizeof(TRANSITIONS[0]); ++i) {
+		if (TRANSITIONS[i].event == event && (TRANSITIONS[i].state == session->state || TRANSITIONS[i].state == SESSION_ANY)) {
+			transition = &TRANSITIONS[i];
+			break;
+		}
+	}
+	if (transition == NULL) {
+		++session->ignored;
+		return 0;
+	}
+	++session->handled;
+	session_action(session, transition->action, msg);
+	if (transition->next != session->state) {
+		session->state = transition->next;
+		session->timer_ns = 0;
+		session_action(session, STATE_ENTRY[transition->next], NULL);
+	}
+	return 1;
+}
+
+int session_event(session_t* session, int event, const message_t* msg) {
+	const int handled = session_run(session, event, msg);
+	unsigned int i = 0;
+	// The posted events may post more, up to SESSION_POSTED in all
+	for (i = 0; i < session->posted_count; ++i) {
+		session_run(session, session->posted[i], NULL);
+	}
+	session->posted_count = 0;
+	return handled;
+}
+
+int session_frame(session_t* session, const message_t* msg, int sequenced) {
+	static const int FRAME_EVENTS[] = { EVENT_HELLO, EVENT_STABLE, EVENT_POINT, EVENT_SHOT, EVENT_AIM };
+	if (msg->type < 'A' || msg->type > 'E') {
+		++session->ignored;
+		return 0;
+	}
+	// The sequence of an 'A' frame is the protocol version
+	if (msg->type == 'A') {
+		session->last_seq = -1;
+	}
+	else if (sequenced) {
+		if (msg->seq == session->last_seq) {
+			++session->duplicates;
+			return 0;
+		}
+		session->last_seq = msg->seq;
+	}
+	return session_event(session, FRAME_EVENTS[msg->type - 'A'], msg);
+}
+
+void session_post(session_t* session, int event) {
+	if (session->posted_count < SESSION_POSTED) {
+		session->posted[session->posted_count++] = event;
+	}
+	else {
+		++session->ignored;
+	}
+}
+
+void session_timer(session_t* session, uint64_t deadline_ns) {
+	session->timer_ns = deadline_ns;
+}
+
+void session_poll(session_t* session, uint64_t now_ns) {
+	if (session->timer_ns != 0 && now_ns >= session->timer_ns) {
+		session->timer_ns = 0;
+		session_event(session, EVENT_TIMER, NULL);
+	}
+}
+
+const char* session_state_name(int state) {
+	return state >= 0 && state < SESSION_STATES ? STATE_NAMES[state] : "?";
+}
+
+const char* session_event_name(int event) {
+	return event >= 0 && event < EVENT_COUNT ? EVENT_NAMES[event] : "?";
+}
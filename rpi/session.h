@@ -0,0 +1,94 @@
+#ifndef SESSION_H
+#define SESSION_H
+
+#include <stdint.h>
+#include "protocol.h"
+
+// States, the same values as the phases of the firmware
+#define SESSION_IDLE 0
+#define INIT_SEQUENCE 1
+#define STAB_SEQUENCE 2
+#define CALIBRATION_SEQUENCE 3
+#define GAME_SEQUENCE 4
+#define SESSION_STATES 5
+
+enum {
+	EVENT_HELLO,       // 'A', the firmware (re)starts
+	EVENT_STABLE,      // 'B'
+	EVENT_POINT,       // 'C'
+	EVENT_SHOT,        // 'D'
+	EVENT_AIM,         // 'E'
+	EVENT_TIMER,       // the deadline of the state expired
+	EVENT_RESUME,      // a calibration for this gun and screen is known
+	EVENT_CALIBRATED,  // the last calibration point was fitted
+	EVENT_REJECTED,    // the calibration does not match the aim frames
+	EVENT_COUNT
+};
+
+// Work of the daemon on a transition, or on entering a state
+enum {
+	ACTION_NONE,
+	ACTION_HELLO,
+	ACTION_RESUME,
+	ACTION_POINT,
+	ACTION_SHOT,
+	ACTION_AIM,
+	ACTION_ENTER_INIT,
+	ACTION_ENTER_STAB,
+	ACTION_ENTER_CALIBRATION,
+	ACTION_ENTER_GAME,
+	ACTION_COUNT
+};
+
+#define SESSION_POSTED 4
+
+struct session;
+// msg is NULL for the events posted by actions and the timer
+typedef void (*session_action_t)(struct session* session, const message_t* msg);
+
+// INIT/STAB/CALIBRATION/GAME flow of one gun as a transition table in
+// session.c. Events come from the frames, the timer and the actions, which
+// may post the outcome of their work. Actions must not block, the state
+// deadline replaces any sleep. An event without a transition in the current
+// state is counted and dropped, so duplicates and frames from a previous
+// phase do no harm. Router thread only.
+typedef struct session {
+	int state;
+	// Deadline of the current state on the monotonic clock, 0 when none
+	uint64_t timer_ns;
+	const session_action_t* actions;
+	void* user_data;
+	int posted[SESSION_POSTED];
+	unsigned int posted_count;
+	// Sequence number of the previous binary frame, -1 when none
+	int last_seq;
+	unsigned long handled;
+	unsigned long ignored;
+	unsigned long duplicates;
+} session_t;
+
+// actions has ACTION_COUNT entries, NULL ones do nothing
+void session_init(session_t* session, const session_action_t* actions, void* user_data);
+
+// Run the event through the table, then the events posted meanwhile.
+// Returns 0 when the current state ignores it.
+int session_event(session_t* session, int event, const message_t* msg);
+
+// Run the event of a frame. When sequenced, the binary wire format, a
+// frame with the sequence number of the previous one is a duplicate and
+// dropped. Returns 0 when dropped or ignored.
+int session_frame(session_t* session, const message_t* msg, int sequenced);
+
+// From an action, handled once the current transition is over
+void session_post(session_t* session, int event);
+
+// From an action, the timer is cleared when the state changes
+void session_timer(session_t* session, uint64_t deadline_ns);
+
+// Fire the timer when it is due
+void session_poll(session_t* session, uint64_t now_ns);
+
+const char* session_state_name(int state);
+const char* session_event_name(int event);
+
+#endif
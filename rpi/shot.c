@@ -0,0 +1,98 @@
+#include <string.h>
+#include "shot.h"
+
+void shot_init(shot_t* shot) {
+	memset(shot, 0, sizeof(*shot));
+}
+
+// MCU time of a frame, the 16 bit ms counter wraps every 65 s
+static int64_t shot_unwrap(const shot_t* shot, uint16_t time) {
+	return shot->last_ms + (int16_t)(time - (uint16_t)shot->last_ms);
+}
+
+void shot_aim(shot_t* shot, const message_t* msg) {
+	shot->last_ms = shot->count == 0 ? msg->time : shot_unwrap(shot, msg->time);
+	shot_sample_t* sample = &shot->samples[shot->count++ % SHOT_SAMPLES];
+	sample->mcu_ms = shot->last_ms;
+	sample->received_ns = msg->received_ns;
+	sample->yaw = msg->yaw / 100.0;
+	sample->pitch = msg->pitch / 100.0;
+	sample->roll = msg->roll / 100.0;
+}
+
+// Host time of MCU time 0, from the least delayed frame
+static int64_t shot_offset_ns(const shot_t* shot, unsigned int n) {
+	int64_t offset_ns = INT64_MAX;
+	unsigned int i = 0;
+	for (i = 0; i < n; ++i) {
+		const int64_t offset = (int64_t)shot->samples[i].received_ns - shot->samples[i].mcu_ms * 1000000;
+		if (offset < offset_ns) {
+			offset_ns = offset;
+		}
+	}
+	return offset_ns;
+}
+
+uint64_t shot_host_ns(const shot_t* shot, uint16_t time) {
+	const unsigned int n = shot->count < SHOT_SAMPLES ? shot->count : SHOT_SAMPLES;
+	if (n == 0) {
+		return 0;
+	}
+	return (uint64_t)(shot_unwrap(shot, time) * 1000000 + shot_offset_ns(shot, n));
+}
+
+static double shot_lerp(double from, double to, double weight) {
+	return from + (to - from) * weight;
+}
+
+int shot_reconcile(shot_t* shot, const message_t* msg, double* yaw, double* pitch, double* roll, uint64_t* delay_ns) {
+	const unsigned int n = shot->count < SHOT_SAMPLES ? shot->count : SHOT_SAMPLES;
+	unsigned int i = 0;
+	*yaw = msg->yaw / 100.0;
+	*pitch = msg->pitch / 100.0;
+	*roll = msg->roll / 100.0;
+	*delay_ns = 0;
+	if (n == 0) {
+		return 0;
+	}
+	const shot_sample_t* newest = &shot->samples[(shot->count - 1) % SHOT_SAMPLES];
+	const shot_sample_t* oldest = &shot->samples[(shot->count - n) % SHOT_SAMPLES];
+	const int64_t trigger_ms = shot_unwrap(shot, msg->time);
+	if (trigger_ms < oldest->mcu_ms - SHOT_MAX_AGE_MS) {
+		return 0;
+	}
+
+	const int64_t offset_ns = shot_offset_ns(shot, n);
+	const int64_t delay = (int64_t)msg->received_ns - (trigger_ms * 1000000 + offset_ns);
+	*delay_ns = delay > 0 ? (uint64_t)delay : 0;
+
+	// The shot frame left after the trigger edge and the last aim frame
+	double after_ms = ((int64_t)msg->received_ns - offset_ns) / 1e6;
+	if (after_ms < trigger_ms) {
+		after_ms = trigger_ms;
+	}
+	if (after_ms < newest->mcu_ms) {
+		after_ms = newest->mcu_ms;
+	}
+	double after_yaw = *yaw, after_pitch = *pitch, after_roll = *roll;
+	for (i = 0; i < n; ++i) {
+		const shot_sample_t* before = &shot->samples[(shot->count - 1 - i) % SHOT_SAMPLES];
+		if (before->mcu_ms <= trigger_ms) {
+			const double span = after_ms - before->mcu_ms;
+			const double weight = span > 0.0 ? (trigger_ms - before->mcu_ms) / span : 1.0;
+			*yaw = shot_lerp(before->yaw, after_yaw, weight);
+			*pitch = shot_lerp(before->pitch, after_pitch, weight);
+			*roll = shot_lerp(before->roll, after_roll, weight);
+			return 1;
+		}
+		after_ms = before->mcu_ms;
+		after_yaw = before->yaw;
+		after_pitch = before->pitch;
+		after_roll = before->roll;
+	}
+	// Just before the oldest frame
+	*yaw = after_yaw;
+	*pitch = after_pitch;
+	*roll = after_roll;
+	return 1;
+}
@@ -0,0 +1,46 @@
+#ifndef SHOT_H
+#define SHOT_H
+
+#include <stdint.h>
+#include "protocol.h"
+
+// Aim frames kept, 640 ms at the binary rate
+#define SHOT_SAMPLES 32
+// A trigger edge older than the oldest sample by more than this is not
+// reconciled
+#define SHOT_MAX_AGE_MS 100
+
+typedef struct shot_sample {
+	// MCU time unwrapped past 65 s, host receipt time
+	int64_t mcu_ms;
+	uint64_t received_ns;
+	double yaw, pitch, roll;
+} shot_sample_t;
+
+// Recent aim frames of a gun, to find its pose when the trigger was pulled.
+// The MCU to host clock offset is the smallest receipt delay over the ring,
+// which follows the drift of the MCU resonator. Router thread only.
+typedef struct shot {
+	shot_sample_t samples[SHOT_SAMPLES];
+	unsigned int count;
+	int64_t last_ms;
+} shot_t;
+
+void shot_init(shot_t* shot);
+
+// Record an aim frame stamped with its send time
+void shot_aim(shot_t* shot, const message_t* msg);
+
+// Host time of an MCU time, without the jitter of the receipt times.
+// 0 before the first aim frame.
+uint64_t shot_host_ns(const shot_t* shot, uint16_t time);
+
+// Pose at the trigger edge of a 'D' frame stamped with it, interpolated
+// between the aim frames around it. The pose of the 'D' frame itself counts
+// as taken at its receipt time less the clock offset. delay_ns is the time
+// from the trigger edge to the receipt of the frame beyond the latency of the
+// fastest aim frame. Returns 0 with the pose of the frame when there is no
+// aim frame to compare with.
+int shot_reconcile(shot_t* shot, const message_t* msg, double* yaw, double* pitch, double* roll, uint64_t* delay_ns);
+
+#endif
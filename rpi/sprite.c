@@ -0,0 +1,96 @@
+#include <math.h>
+#include "sprite.h"
+
+void sprite_fill_circle(SDL_Renderer* renderer, int cx, int cy, int radius, int lc, int border, Uint8 r, Uint8 g, Uint8 b, Uint8 a) {
+    double dyo = 1;
+	for (dyo = 1; dyo <= radius; dyo += 1.0)
+	{
+		double dxo = floor(sqrt((2.0 * radius * dyo) - (dyo * dyo)));
+		SDL_SetRenderDrawColor(renderer, r, g, b, a);
+		if (dyo > border)
+		{
+			SDL_RenderDrawLine(renderer, cx - dxo, cy + dyo - radius, cx - dxo + border, cy + dyo - radius);
+			SDL_RenderDrawLine(renderer, cx + dxo - border, cy + dyo - radius, cx + dxo, cy + dyo - radius);
+			SDL_RenderDrawLine(renderer, cx - dxo, cy - dyo + radius, cx - dxo + border, cy - dyo + radius);
+			SDL_RenderDrawLine(renderer, cx + dxo - border, cy - dyo + radius, cx + dxo, cy - dyo + radius);
+		}
+		else
+		{
+			SDL_RenderDrawLine(renderer, cx - dxo, cy + dyo - radius, cx + dxo, cy + dyo - radius);
+			SDL_RenderDrawLine(renderer, cx - dxo, cy - dyo + radius, cx + dxo, cy - dyo + radius);
+		}
+	}
+	double dc = 0;
+	for (dc = 0; dc < border/2; dc += 1.0)
+	{
+		SDL_RenderDrawLine(renderer, cx - dc, cy - lc, cx - dc, cy + lc);
+		SDL_RenderDrawLine(renderer, cx + dc, cy - lc, cx + dc, cy + lc);
+		SDL_RenderDrawLine(renderer, cx - lc, cy - dc, cx + lc, cy - dc);
+		SDL_RenderDrawLine(renderer, cx - lc, cy + dc, cx + lc, cy + dc);
+	}
+}
+
+SDL_Surface* sprite_target_surface(int radius, int lc, int border, Uint8 r, Uint8 g, Uint8 b, Uint8 a) {
+	const int size = 2 * radius + 1;
+	// Draw on a transparent surface with the software renderer so that the
+	// display renderer does not need render target support
+	SDL_Surface* surface = SDL_CreateRGBSurfaceWithFormat(0, size, size, 32, SDL_PIXELFORMAT_RGBA8888);
+	if (surface == NULL) {
+		return NULL;
+	}
+	SDL_Renderer* software = SDL_CreateSoftwareRenderer(surface);
+	if (software == NULL) {
+		SDL_FreeSurface(surface);
+		return NULL;
+	}
+	SDL_SetRenderDrawColor(software, 0, 0, 0, 0);
+	SDL_RenderClear(software);
+	sprite_fill_circle(software, radius, radius, radius, lc, border, r, g, b, a);
+	SDL_RenderPresent(software);
+	SDL_DestroyRenderer(software);
+	return surface;
+}
+
+SDL_Texture* sprite_upload(SDL_Renderer* renderer, SDL_Surface* surface) {
+	SDL_Texture* texture = surface != NULL ? SDL_CreateTextureFromSurface(renderer, surface) : NULL;
+	if (texture != NULL) {
+		SDL_SetTextureBlendMode(texture, SDL_BLENDMODE_BLEND);
+	}
+	return texture;
+}
+
+SDL_Texture* sprite_target(SDL_Renderer* renderer, int radius, int lc, int border, Uint8 r, Uint8 g, Uint8 b, Uint8 a) {
+	SDL_Surface* surface = sprite_target_surface(radius, lc, border, r, g, b, a);
+	SDL_Texture* texture = sprite_upload(renderer, surface);
+	SDL_FreeSurface(surface);
+	return texture;
+}
+
+void sprite_target_rects(int width, int height, int radius, SDL_Rect rects[SPRITE_TARGETS]) {
+	const int left = SPRITE_TARGET_MARGIN;
+	const int right = width - SPRITE_TARGET_MARGIN;
+	const int top = SPRITE_TARGET_MARGIN;
+	const int bottom = height - SPRITE_TARGET_MARGIN;
+	const int centers[SPRITE_TARGETS][2] = {
+		{left, top}, {left, height/2}, {left, bottom},
+		{width/2, bottom}, {width/2, height/2}, {width/2, top},
+		{right, top}, {right, height/2}, {right, bottom}
+	};
+	int i = 0;
+	for (i = 0; i < SPRITE_TARGETS; ++i) {
+		rects[i].x = centers[i][0] - radius;
+		rects[i].y = centers[i][1] - radius;
+		rects[i].w = 2 * radius + 1;
+		rects[i].h = 2 * radius + 1;
+	}
+}
+
+void sprite_sheet_rects(SDL_Rect* rects, int count, int first, int columns, int size) {
+	int i = 0;
+	for (i = 0; i < count; ++i) {
+		rects[i].x = ((first + i) % columns) * size;
+		rects[i].y = ((first + i) / columns) * size;
+		rects[i].w = size;
+		rects[i].h = size;
+	}
+}
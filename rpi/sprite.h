@@ -0,0 +1,35 @@
+#ifndef SPRITE_H
+#define SPRITE_H
+
+#include <SDL2/SDL.h>
+
+// Calibration target : circle of radius px with a crosshair of half length lc
+#define SPRITE_TARGET_RADIUS 25
+#define SPRITE_TARGET_CROSS 10
+#define SPRITE_TARGET_BORDER 2
+// Distance of the border targets to the screen edges
+#define SPRITE_TARGET_MARGIN 30
+#define SPRITE_TARGETS 9
+
+// Draw the target directly with lines, one sqrt and up to six lines per row
+void sprite_fill_circle(SDL_Renderer* renderer, int cx, int cy, int radius, int lc, int border, Uint8 r, Uint8 g, Uint8 b, Uint8 a);
+
+// Rasterize the target once into a transparent surface of (2 * radius + 1) px,
+// no display needed. Returns NULL on failure.
+SDL_Surface* sprite_target_surface(int radius, int lc, int border, Uint8 r, Uint8 g, Uint8 b, Uint8 a);
+
+// Texture of a surface drawn with alpha blending, NULL on failure
+SDL_Texture* sprite_upload(SDL_Renderer* renderer, SDL_Surface* surface);
+
+// Both of the above, the surface is freed
+SDL_Texture* sprite_target(SDL_Renderer* renderer, int radius, int lc, int border, Uint8 r, Uint8 g, Uint8 b, Uint8 a);
+
+// Destination of the nine calibration targets, in calibration order :
+// left column top to bottom, middle column bottom to top, right column top to bottom
+void sprite_target_rects(int width, int height, int radius, SDL_Rect rects[SPRITE_TARGETS]);
+
+// Source rectangles of count square frames of a sprite sheet, starting at
+// frame first and laid out in rows of columns frames
+void sprite_sheet_rects(SDL_Rect* rects, int count, int first, int columns, int size);
+
+#endif
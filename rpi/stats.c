@@ -0,0 +1,148 @@
+#include <string.h>
+#include <time.h>
+#include "stats.h"
+
+static const char* STAGE_NAMES[STAGE_COUNT] = {
+	"frame", "enqueue", "queue", "mapping", "emit", "total"
+};
+
+uint64_t stats_now_ns(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000U + ts.tv_nsec;
+}
+
+static unsigned int histogram_index(uint64_t value) {
+	if (value < (1U << HISTOGRAM_SUB_BITS)) {
+		return (unsigned int)value;
+	}
+	unsigned int msb = 63 - __builtin_clzll(value);
+	unsigned int shift = msb - HISTOGRAM_SUB_BITS;
+	return ((shift + 1) << HISTOGRAM_SUB_BITS) | ((value >> shift) & ((1U << HISTOGRAM_SUB_BITS) - 1));
+}
+
+// Upper bound of the values counted in a bucket
+static uint64_t histogram_value(unsigned int index) {
+	if (index < (1U << HISTOGRAM_SUB_BITS)) {
+		return index;
+	}
+	unsigned int shift = (index >> HISTOGRAM_SUB_BITS) - 1;
+	uint64_t base = (1ULL << HISTOGRAM_SUB_BITS) | (index & ((1U << HISTOGRAM_SUB_BITS) - 1));
+	return ((base + 1) << shift) - 1;
+}
+
+void histogram_record(histogram_t* histogram, uint64_t value) {
+	// Single writer, plain load/store pairs are enough
+	atomic_uint* bucket = &histogram->counts[histogram_index(value)];
+	atomic_store_explicit(bucket, atomic_load_explicit(bucket, memory_order_relaxed) + 1, memory_order_relaxed);
+	atomic_store_explicit(&histogram->count, atomic_load_explicit(&histogram->count, memory_order_relaxed) + 1, memory_order_relaxed);
+	if (value > atomic_load_explicit(&histogram->max, memory_order_relaxed)) {
+		atomic_store_explicit(&histogram->max, value, memory_order_relaxed);
+	}
+}
+
+uint64_t histogram_percentile(histogram_t* histogram, double percentile) {
+	uint64_t count = atomic_load_explicit(&histogram->count, memory_order_relaxed);
+	uint64_t rank = (uint64_t)(count * percentile / 100.0 + 0.5);
+	uint64_t seen = 0;
+	unsigned int i = 0;
+	if (count == 0) {
+		return 0;
+	}
+	if (rank == 0) {
+		rank = 1;
+	}
+	for (i = 0; i < HISTOGRAM_BUCKETS; ++i) {
+		seen += atomic_load_explicit(&histogram->counts[i], memory_order_relaxed);
+		if (seen >= rank) {
+			uint64_t value = histogram_value(i);
+			uint64_t max = atomic_load_explicit(&histogram->max, memory_order_relaxed);
+			return value < max ? value : max;
+		}
+	}
+	return atomic_load_explicit(&histogram->max, memory_order_relaxed);
+}
+
+void histogram_reset(histogram_t* histogram) {
+	unsigned int i = 0;
+	for (i = 0; i < HISTOGRAM_BUCKETS; ++i) {
+		atomic_init(&histogram->counts[i], 0);
+	}
+	atomic_init(&histogram->count, 0);
+	atomic_init(&histogram->max, 0);
+}
+
+void stats_init(stats_t* stats) {
+	int i = 0;
+	for (i = 0; i < STAGE_COUNT; ++i) {
+		histogram_reset(&stats->stages[i]);
+	}
+	histogram_reset(&stats->depth);
+	histogram_reset(&stats->shot_shift);
+	histogram_reset(&stats->shot_delay);
+	for (i = 0; i < 5; ++i) {
+		atomic_init(&stats->frames[i], 0);
+		stats->last_frames[i] = 0;
+	}
+	atomic_init(&stats->reports, 0);
+	stats->last_reports = 0;
+	stats->last_dump_ns = stats_now_ns();
+}
+
+void stats_stage(stats_t* stats, int stage, uint64_t start_ns, uint64_t end_ns) {
+	histogram_record(&stats->stages[stage], end_ns > start_ns ? end_ns - start_ns : 0);
+}
+
+void stats_frame(stats_t* stats, char type) {
+	if (type >= 'A' && type <= 'E') {
+		atomic_fetch_add_explicit(&stats->frames[type - 'A'], 1, memory_order_relaxed);
+	}
+}
+
+void stats_report(stats_t* stats) {
+	atomic_fetch_add_explicit(&stats->reports, 1, memory_order_relaxed);
+}
+
+void stats_dump(stats_t* stats, FILE* file, unsigned long dropped, unsigned long coalesced) {
+	const uint64_t now = stats_now_ns();
+	const double elapsed = (now - stats->last_dump_ns) / 1e9;
+	int i = 0;
+
+	fprintf(file, "# interval %.3f s\n", elapsed);
+	fprintf(file, "%-8s %10s %10s %10s %10s %10s\n", "stage", "count", "p50_us", "p99_us", "p999_us", "max_us");
+	for (i = 0; i < STAGE_COUNT; ++i) {
+		histogram_t* histogram = &stats->stages[i];
+		fprintf(file, "%-8s %10llu %10.1f %10.1f %10.1f %10.1f\n", STAGE_NAMES[i],
+			(unsigned long long)atomic_load_explicit(&histogram->count, memory_order_relaxed),
+			histogram_percentile(histogram, 50.0) / 1e3,
+			histogram_percentile(histogram, 99.0) / 1e3,
+			histogram_percentile(histogram, 99.9) / 1e3,
+			atomic_load_explicit(&histogram->max, memory_order_relaxed) / 1e3);
+	}
+
+	fprintf(file, "%-8s %10s %10s\n", "frames", "count", "rate_hz");
+	for (i = 0; i < 5; ++i) {
+		unsigned long frames = atomic_load_explicit(&stats->frames[i], memory_order_relaxed);
+		fprintf(file, "%-8c %10lu %10.1f\n", 'A' + i, frames, elapsed > 0 ? (frames - stats->last_frames[i]) / elapsed : 0.0);
+		stats->last_frames[i] = frames;
+	}
+	unsigned long reports = atomic_load_explicit(&stats->reports, memory_order_relaxed);
+	fprintf(file, "%-8s %10lu %10.1f\n", "reports", reports, elapsed > 0 ? (reports - stats->last_reports) / elapsed : 0.0);
+	stats->last_reports = reports;
+
+	fprintf(file, "queue depth p50 %llu p99 %llu max %llu dropped %lu coalesced %lu\n",
+		(unsigned long long)histogram_percentile(&stats->depth, 50.0),
+		(unsigned long long)histogram_percentile(&stats->depth, 99.0),
+		(unsigned long long)atomic_load_explicit(&stats->depth.max, memory_order_relaxed),
+		dropped, coalesced);
+	if (atomic_load_explicit(&stats->shot_shift.count, memory_order_relaxed) > 0) {
+		fprintf(file, "shot count %llu shift_px p50 %llu p99 %llu max %llu delay_ms p50 %.1f p99 %.1f\n",
+			(unsigned long long)atomic_load_explicit(&stats->shot_shift.count, memory_order_relaxed),
+			(unsigned long long)histogram_percentile(&stats->shot_shift, 50.0),
+			(unsigned long long)histogram_percentile(&stats->shot_shift, 99.0),
+			(unsigned long long)atomic_load_explicit(&stats->shot_shift.max, memory_order_relaxed),
+			histogram_percentile(&stats->shot_delay, 50.0) / 1e6,
+			histogram_percentile(&stats->shot_delay, 99.0) / 1e6);
+	}
+	stats->last_dump_ns = now;
+}
@@ -0,0 +1,64 @@
+#ifndef STATS_H
+#define STATS_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stdatomic.h>
+
+// Log-linear histogram : exact below 2^HISTOGRAM_SUB_BITS, then each power
+// of two is split in 2^HISTOGRAM_SUB_BITS linear buckets (6% resolution).
+#define HISTOGRAM_SUB_BITS 4
+#define HISTOGRAM_BUCKETS ((64 - HISTOGRAM_SUB_BITS + 1) << HISTOGRAM_SUB_BITS)
+
+// Only one thread records into a given histogram, any thread may read it
+typedef struct histogram {
+	atomic_uint counts[HISTOGRAM_BUCKETS];
+	atomic_ullong count;
+	atomic_ullong max;
+} histogram_t;
+
+void histogram_record(histogram_t* histogram, uint64_t value);
+uint64_t histogram_percentile(histogram_t* histogram, double percentile);
+void histogram_reset(histogram_t* histogram);
+
+// Notification to uinput pipeline stages, in ns
+enum {
+	STAGE_FRAME,    // notification receipt to frame completion
+	STAGE_ENQUEUE,  // frame completion to enqueue
+	STAGE_QUEUE,    // enqueue to dequeue in the router
+	STAGE_MAPPING,  // dequeue to angle_to_screen done
+	STAGE_EMIT,     // angle_to_screen to the last emit() write
+	STAGE_TOTAL,    // notification receipt to the last emit() write
+	STAGE_COUNT
+};
+
+typedef struct stats {
+	histogram_t stages[STAGE_COUNT];
+	// Control frames waiting in the queue when a frame is pushed
+	histogram_t depth;
+	// Shots stamped with their trigger edge : px between the reconciled and
+	// the naive hit point, ns from the edge to the receipt of the frame
+	// beyond the fastest aim frame
+	histogram_t shot_shift;
+	histogram_t shot_delay;
+	// Frames received per type 'A' to 'E'
+	atomic_ulong frames[5];
+	atomic_ulong reports;
+	// Snapshot of the previous dump to compute rates
+	unsigned long last_frames[5];
+	unsigned long last_reports;
+	uint64_t last_dump_ns;
+} stats_t;
+
+uint64_t stats_now_ns(void);
+
+void stats_init(stats_t* stats);
+void stats_stage(stats_t* stats, int stage, uint64_t start_ns, uint64_t end_ns);
+void stats_frame(stats_t* stats, char type);
+void stats_report(stats_t* stats);
+
+// Text dump of percentiles per stage, frame rates since the previous dump
+// queue depths and shot reconciliation
+void stats_dump(stats_t* stats, FILE* file, unsigned long dropped, unsigned long coalesced);
+
+#endif
@@ -0,0 +1,102 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include "telemetry.h"
+
+int telemetry_open(telemetry_t* telemetry, const char* name, int guns) {
+	telemetry->segment = NULL;
+	snprintf(telemetry->name, sizeof(telemetry->name), "%s", name);
+	const int fd = shm_open(name, O_CREAT | O_RDWR, 0644);
+	if (fd < 0) {
+		return errno;
+	}
+	if (ftruncate(fd, sizeof(telemetry_segment_t)) != 0) {
+		const int error = errno;
+		close(fd);
+		return error;
+	}
+	void* segment = mmap(NULL, sizeof(telemetry_segment_t), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	close(fd);
+	if (segment == MAP_FAILED) {
+		return errno;
+	}
+	// A segment left by a previous run starts over
+	telemetry->segment = segment;
+	memset(segment, 0, sizeof(telemetry_segment_t));
+	telemetry->segment->version = TELEMETRY_VERSION;
+	telemetry->segment->slot_size = sizeof(telemetry_slot_t);
+	telemetry->segment->guns = guns < TELEMETRY_GUNS ? guns : TELEMETRY_GUNS;
+	// Readers check the magic last
+	atomic_thread_fence(memory_order_release);
+	telemetry->segment->magic = TELEMETRY_MAGIC;
+	return 0;
+}
+
+void telemetry_publish(telemetry_t* telemetry, int gun, const telemetry_state_t* state) {
+	if (telemetry->segment == NULL || gun < 0 || gun >= TELEMETRY_GUNS) {
+		return;
+	}
+	telemetry_slot_t* slot = &telemetry->segment->slots[gun];
+	const unsigned int seq = atomic_load_explicit(&slot->seq, memory_order_relaxed);
+	atomic_store_explicit(&slot->seq, seq + 1, memory_order_relaxed);
+	atomic_thread_fence(memory_order_release);
+	slot->state = *state;
+	atomic_store_explicit(&slot->seq, seq + 2, memory_order_release);
+}
+
+void telemetry_close(telemetry_t* telemetry) {
+	if (telemetry->segment != NULL) {
+		munmap(telemetry->segment, sizeof(telemetry_segment_t));
+		shm_unlink(telemetry->name);
+		telemetry->segment = NULL;
+	}
+}
+
+const telemetry_segment_t* telemetry_attach(const char* name) {
+	const int fd = shm_open(name, O_RDONLY, 0);
+	if (fd < 0) {
+		return NULL;
+	}
+	void* mapped = mmap(NULL, sizeof(telemetry_segment_t), PROT_READ, MAP_SHARED, fd, 0);
+	close(fd);
+	if (mapped == MAP_FAILED) {
+		return NULL;
+	}
+	const telemetry_segment_t* segment = mapped;
+	if (segment->magic != TELEMETRY_MAGIC || segment->version != TELEMETRY_VERSION
+		|| segment->slot_size != sizeof(telemetry_slot_t)) {
+		munmap(mapped, sizeof(telemetry_segment_t));
+		return NULL;
+	}
+	atomic_thread_fence(memory_order_acquire);
+	return segment;
+}
+
+unsigned int telemetry_read(const telemetry_segment_t* segment, int gun, telemetry_state_t* state) {
+	int i = 0;
+	if (gun < 0 || gun >= TELEMETRY_GUNS) {
+		return 0;
+	}
+	const telemetry_slot_t* slot = &segment->slots[gun];
+	for (i = 0; i < TELEMETRY_RETRIES; ++i) {
+		const unsigned int before = atomic_load_explicit(&slot->seq, memory_order_acquire);
+		if (before & 1) {
+			continue;
+		}
+		*state = slot->state;
+		atomic_thread_fence(memory_order_acquire);
+		if (atomic_load_explicit(&slot->seq, memory_order_relaxed) == before) {
+			return before / 2;
+		}
+	}
+	return 0;
+}
+
+void telemetry_detach(const telemetry_segment_t* segment) {
+	if (segment != NULL) {
+		munmap((void*)segment, sizeof(telemetry_segment_t));
+	}
+}
@@ -0,0 +1,67 @@
+#ifndef TELEMETRY_H
+#define TELEMETRY_H
+
+#include <stdint.h>
+#include <stdatomic.h>
+
+// Shared memory segment, /dev/shm/blue-telemetry
+#define TELEMETRY_NAME "/blue-telemetry"
+#define TELEMETRY_MAGIC 0x45554c42U
+#define TELEMETRY_VERSION 1
+#define TELEMETRY_GUNS 4
+// Reads retried while the writer is in the middle of an update
+#define TELEMETRY_RETRIES 64
+
+// Latest state of one gun, updated by the router for each aim frame,
+// cursor output and trigger change. time_ns stops when the gun is silent..
+typedef struct telemetry_state {
+	// CLOCK_MONOTONIC receipt of the last aim or shot frame
+	uint64_t time_ns;
+	// Raw pose of that frame in degrees
+	float yaw, pitch, roll;
+	// Cursor in absolute axis units, 0 to 65535 across the screen
+	int32_t x, y;
+	uint8_t trigger;
+	// HEALTH_IDLE, OK, DEGRADED or SILENT of health.h
+	uint8_t health;
+	// Session state of session.h, GAME_SEQUENCE once calibrated
+	uint8_t session;
+	uint8_t reserved;
+} telemetry_state_t;
+
+// Seqlock : odd while the writer updates the state. One cache line per gun.
+typedef struct telemetry_slot {
+	atomic_uint seq;
+	uint32_t reserved;
+	telemetry_state_t state;
+} __attribute__((aligned(64))) telemetry_slot_t;
+
+typedef struct telemetry_segment {
+	uint32_t magic;
+	uint32_t version;
+	uint32_t slot_size;
+	uint32_t guns;
+	telemetry_slot_t slots[TELEMETRY_GUNS];
+} telemetry_segment_t;
+
+// Writer side, one thread per slot
+typedef struct telemetry {
+	char name[64];
+	telemetry_segment_t* segment;
+} telemetry_t;
+
+// Creates and maps the segment, returns 0 or the errno of the failure
+int telemetry_open(telemetry_t* telemetry, const char* name, int guns);
+void telemetry_publish(telemetry_t* telemetry, int gun, const telemetry_state_t* state);
+// Unmaps and removes the segment, the mapped readers keep the last states
+void telemetry_close(telemetry_t* telemetry);
+
+// Reader side, no syscall per read. Maps the segment read only, NULL when
+// missing or of another version.
+const telemetry_segment_t* telemetry_attach(const char* name);
+// Copies the state of a gun, returns its number of updates, 0 when never
+// written or when the writer stays in the middle of an update
+unsigned int telemetry_read(const telemetry_segment_t* segment, int gun, telemetry_state_t* state);
+void telemetry_detach(const telemetry_segment_t* segment);
+
+#endif
@@ -0,0 +1,283 @@
+// Stand-in for the Nano + JDY-16 gun, speaks the firmware protocol over a
+// UNIX socket or a pty so the daemon can be run and load tested locally.
+#define _GNU_SOURCE
+#include <errno.h>
+#include <fcntl.h>
+#include <math.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <termios.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include "protocol.h"
+
+const int INIT_SEQUENCE = 1;
+const int STAB_SEQUENCE = 2;
+const int CALIBRATION_SEQUENCE = 3;
+const int GAME_SEQUENCE = 4;
+const int CALIBRATION_DELAY = 300;
+
+// Calibration targets in the order the daemon shows them
+static const double CALIBRATION_POSE[9][2] = {
+	{-20, 10}, {-20, 0}, {-20, -10}, {0, -10}, {0, 0}, {0, 10}, {20, 10}, {20, 0}, {20, -10}
+};
+
+static volatile sig_atomic_t m_exit = 0;
+static int m_ascii_only = 0;
+static int m_binary = 0;
+static int m_rate = 50;
+static int m_fire_ms = 500;
+static int m_kill_s = 0;
+static int m_stab_ms = 500;
+static int m_loss_pct = 0;
+// Trigger edge to shot frame, the firmware reads the IMU and waits for the
+// serial line in between
+static int m_shot_delay_ms = 10;
+static uint8_t m_seq = 0;
+static unsigned long m_frames = 0;
+static unsigned long m_bytes = 0;
+
+static void signal_handler(int signum) {
+	m_exit = 1;
+}
+
+static long now_ms(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * 1000L + ts.tv_nsec / 1000000L;
+}
+
+static int send_frame(int fd, char type, long time, double yaw, double pitch, double roll) {
+	char text[64];
+	uint8_t frame[FRAME_SIZE];
+	const void* data = text;
+	size_t length = 0;
+	if (m_binary && type != 'A') {
+		message_t msg;
+		msg.type = type;
+		msg.seq = m_seq++;
+		// Lost over the air, the sequence number still moves on
+		if (type == 'E' && m_loss_pct > 0 && rand() % 100 < m_loss_pct) {
+			return 1;
+		}
+		msg.time = (uint16_t)time;
+		msg.yaw = (int16_t)lround(yaw * 100.0);
+		msg.pitch = (int16_t)lround(pitch * 100.0);
+		msg.roll = (int16_t)lround(roll * 100.0);
+		frame_encode(&msg, frame);
+		data = frame;
+		length = FRAME_SIZE;
+	}
+	else if (type == 'A') {
+		length = snprintf(text, sizeof(text), m_ascii_only ? "A;" : "A%d;", PROTOCOL_SHOT_TIME);
+	}
+	else if (type == 'B') {
+		length = snprintf(text, sizeof(text), "B;");
+	}
+	else {
+		length = snprintf(text, sizeof(text), "%c %.2f %.2f %.2f;", type, yaw, pitch, roll);
+	}
+	if (write(fd, data, length) != (ssize_t)length) {
+		return 0;
+	}
+	++m_frames;
+	m_bytes += length;
+	return 1;
+}
+
+// Play one connection, returns when the peer leaves or the kill delay expires
+static void serve(int fd) {
+	const long start = now_ms();
+	const long aim_period = m_rate > 0 ? 1000 / m_rate : 0;
+	long next_aim = 0, next_fire = 0, next_calib = 0, stab_time = 0;
+	// Trigger edge of the shot waiting to be sent, -1 when none
+	long trigger = -1;
+	int phase = INIT_SEQUENCE;
+	int point = 0;
+
+	m_binary = 0;
+	m_seq = 0;
+	m_frames = 0;
+	m_bytes = 0;
+	send_frame(fd, 'A', 0, 0, 0, 0);
+
+	while (!m_exit) {
+		long now = now_ms();
+		if (m_kill_s > 0 && now - start >= m_kill_s * 1000L) {
+			printf("Forced disconnection\n");
+			break;
+		}
+
+		long deadline = now + 100;
+		if (phase == STAB_SEQUENCE && stab_time < deadline) deadline = stab_time;
+		if (phase == CALIBRATION_SEQUENCE && next_calib < deadline) deadline = next_calib;
+		if (phase == GAME_SEQUENCE && aim_period > 0 && next_aim < deadline) deadline = next_aim;
+		if (phase == GAME_SEQUENCE && m_fire_ms > 0 && next_fire < deadline) deadline = next_fire;
+		if (trigger >= 0 && trigger + m_shot_delay_ms < deadline) deadline = trigger + m_shot_delay_ms;
+
+		struct pollfd pfd = { fd, POLLIN, 0 };
+		int timeout = deadline > now ? (int)(deadline - now) : 0;
+		if (poll(&pfd, 1, timeout) < 0 && errno != EINTR) {
+			break;
+		}
+		if (pfd.revents & (POLLHUP | POLLERR)) {
+			break;
+		}
+		if (pfd.revents & POLLIN) {
+			char receive[16];
+			ssize_t length = read(fd, receive, sizeof(receive));
+			if (length <= 0) {
+				break;
+			}
+			ssize_t i = 0;
+			for (i = 0; i < length; ++i) {
+				if (receive[i] == PROTOCOL_BINARY_ACK && !m_ascii_only) {
+					m_binary = 1;
+				}
+				else if (receive[i] == 'Z') {
+					phase = STAB_SEQUENCE;
+					stab_time = now_ms() + m_stab_ms;
+				}
+				else if (receive[i] == 'Y') {
+					phase = CALIBRATION_SEQUENCE;
+					point = 0;
+					next_calib = now_ms() + CALIBRATION_DELAY;
+				}
+				else if (receive[i] == 'X') {
+					phase = GAME_SEQUENCE;
+					next_aim = next_fire = now_ms();
+				}
+			}
+		}
+
+		now = now_ms();
+		const double t = (now - start) / 1000.0;
+		const double yaw = 18.0 * sin(t * 1.7);
+		const double pitch = 9.0 * cos(t * 1.1);
+		int ok = 1;
+		if (phase == STAB_SEQUENCE && now >= stab_time) {
+			ok = send_frame(fd, 'B', now, 0, 0, 0);
+			stab_time = now + 5000;
+		}
+		else if (phase == CALIBRATION_SEQUENCE && now >= next_calib && point < 9) {
+			ok = send_frame(fd, 'C', now, CALIBRATION_POSE[point][0], CALIBRATION_POSE[point][1], 0.5);
+			++point;
+			next_calib = now + CALIBRATION_DELAY;
+		}
+		else if (phase == GAME_SEQUENCE) {
+			if (m_fire_ms > 0 && now >= next_fire && trigger < 0) {
+				trigger = next_fire;
+				next_fire += m_fire_ms;
+			}
+			// The shot carries the aim at send time and the trigger edge
+			if (trigger >= 0 && now >= trigger + m_shot_delay_ms) {
+				ok = send_frame(fd, 'D', m_binary ? trigger : now, yaw, pitch, 0.5);
+				trigger = -1;
+			}
+			if (ok && aim_period > 0 && now >= next_aim) {
+				ok = send_frame(fd, 'E', now, yaw, pitch, 0.5);
+				next_aim += aim_period;
+				if (next_aim < now) {
+					next_aim = now;
+				}
+			}
+		}
+		if (!ok) {
+			break;
+		}
+	}
+	const double elapsed = (now_ms() - start) / 1000.0;
+	printf("Sent %lu frames, %lu bytes in %.1f s (%.0f frames/s, %s)\n",
+		m_frames, m_bytes, elapsed, elapsed > 0 ? m_frames / elapsed : 0.0, m_binary ? "binary" : "ascii");
+}
+
+static void usage(const char* name) {
+	fprintf(stderr, "Usage : %s [-u socket | -t] [-a] [-r rate] [-f fire_ms] [-k seconds] [-b stab_ms] [-l percent] [-d delay_ms]\n", name);
+	fprintf(stderr, "  -u  listen on a UNIX socket (default /tmp/zapper.sock), connect with blue -a unix:<socket>\n");
+	fprintf(stderr, "  -t  create a pty instead, connect with blue -a <printed path>\n");
+	fprintf(stderr, "  -a  behave like the ASCII only firmware\n");
+	fprintf(stderr, "  -r  aim frames per second in game (default 50)\n");
+	fprintf(stderr, "  -f  shot period in ms, 0 for none (default 500)\n");
+	fprintf(stderr, "  -k  drop the link after this many seconds to test reconnection\n");
+	fprintf(stderr, "  -b  stabilization delay before the B frame in ms (default 500)\n");
+	fprintf(stderr, "  -l  binary aim frames lost, in percent, to test the link health\n");
+	fprintf(stderr, "  -d  delay from the trigger edge to the shot frame in ms (default 10)\n");
+}
+
+int main(int argc, char** argv) {
+	const char* path = "/tmp/zapper.sock";
+	int use_pty = 0;
+	int opt = 0;
+	while ((opt = getopt(argc, argv, "u:tar:f:k:b:l:d:")) != -1) {
+		if (opt == 'u') path = optarg;
+		else if (opt == 't') use_pty = 1;
+		else if (opt == 'a') m_ascii_only = 1;
+		else if (opt == 'r') m_rate = atoi(optarg);
+		else if (opt == 'f') m_fire_ms = atoi(optarg);
+		else if (opt == 'k') m_kill_s = atoi(optarg);
+		else if (opt == 'b') m_stab_ms = atoi(optarg);
+		else if (opt == 'l') m_loss_pct = atoi(optarg);
+		else if (opt == 'd') m_shot_delay_ms = atoi(optarg);
+		else {
+			usage(argv[0]);
+			return 1;
+		}
+	}
+	signal(SIGINT, signal_handler);
+	signal(SIGPIPE, SIG_IGN);
+
+	if (use_pty) {
+		int fd = posix_openpt(O_RDWR | O_NOCTTY);
+		struct termios tio;
+		if (fd == -1 || grantpt(fd) != 0 || unlockpt(fd) != 0) {
+			perror("pty");
+			return 1;
+		}
+		tcgetattr(fd, &tio);
+		cfmakeraw(&tio);
+		tcsetattr(fd, TCSANOW, &tio);
+		printf("Gun on %s\n", ptsname(fd));
+		fflush(stdout);
+		// Wait for the daemon to open the other side
+		while (!m_exit) {
+			struct pollfd pfd = { fd, POLLIN, 0 };
+			if (poll(&pfd, 1, 100) > 0 && !(pfd.revents & POLLHUP)) {
+				break;
+			}
+		}
+		serve(fd);
+		close(fd);
+		return 0;
+	}
+
+	struct sockaddr_un addr;
+	int server = socket(AF_UNIX, SOCK_STREAM, 0);
+	memset(&addr, 0, sizeof(addr));
+	addr.sun_family = AF_UNIX;
+	strncpy(addr.sun_path, path, sizeof(addr.sun_path) - 1);
+	unlink(path);
+	if (server == -1 || bind(server, (struct sockaddr*)&addr, sizeof(addr)) != 0 || listen(server, 1) != 0) {
+		perror("socket");
+		return 1;
+	}
+	printf("Gun on unix:%s\n", path);
+	fflush(stdout);
+	while (!m_exit) {
+		int fd = accept(server, NULL, NULL);
+		if (fd == -1) {
+			continue;
+		}
+		printf("Connected\n");
+		serve(fd);
+		close(fd);
+		fflush(stdout);
+	}
+	close(server);
+	unlink(path);
+	return 0;
+}
@@ -0,0 +1,59 @@
+// Reader of the shared memory telemetry of the daemon, as an overlay or an
+// emulator plugin would use it : attach once, then telemetry_read() costs
+// no syscall.
+//   ./telemetry_dump [-T name] [-r rate]
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include "telemetry.h"
+
+static const char* HEALTH_NAMES[] = { "idle", "ok", "degraded", "silent" };
+
+static uint64_t now_ns(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000U + ts.tv_nsec;
+}
+
+int main(int argc, char** argv) {
+	const char* name = TELEMETRY_NAME;
+	int rate = 10;
+	int opt = 0;
+	while ((opt = getopt(argc, argv, "T:r:")) != -1) {
+		if (opt == 'T') {
+			name = optarg;
+		}
+		else if (opt == 'r') {
+			rate = atoi(optarg) > 0 ? atoi(optarg) : 1;
+		}
+		else {
+			fprintf(stderr, "Usage : %s [-T name] [-r rate]\n", argv[0]);
+			return 1;
+		}
+	}
+	const telemetry_segment_t* segment = NULL;
+	while ((segment = telemetry_attach(name)) == NULL) {
+		// The daemon creates the segment once it knows its guns
+		usleep(500000);
+	}
+	printf("%u guns in %s\n", segment->guns, name);
+	while (1) {
+		unsigned int gun = 0;
+		for (gun = 0; gun < segment->guns; ++gun) {
+			telemetry_state_t state;
+			const unsigned int updates = telemetry_read(segment, gun, &state);
+			if (updates == 0) {
+				continue;
+			}
+			printf("gun %u updates %u age_ms %.1f yaw %.2f pitch %.2f roll %.2f x %d y %d trigger %d health %s session %d\n",
+				gun, updates, (now_ns() - state.time_ns) / 1e6, state.yaw, state.pitch, state.roll, state.x, state.y,
+				state.trigger, state.health < 4 ? HEALTH_NAMES[state.health] : "?", state.session);
+		}
+		fflush(stdout);
+		usleep(1000000 / rate);
+	}
+	telemetry_detach(segment);
+	return 0;
+}
@@ -0,0 +1,90 @@
+#include <string.h>
+#include <time.h>
+#include "trace.h"
+
+static const char TRACE_MAGIC[4] = {'B', 'L', 'T', 'R'};
+
+uint64_t trace_now_us(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000U + ts.tv_nsec / 1000;
+}
+
+int trace_open_write(trace_t* trace, const char* path) {
+	memset(trace, 0, sizeof(*trace));
+	trace->file = fopen(path, "wb");
+	if (trace->file == NULL) {
+		return 0;
+	}
+	fwrite(TRACE_MAGIC, 1, sizeof(TRACE_MAGIC), trace->file);
+	fputc(TRACE_VERSION, trace->file);
+	return 1;
+}
+
+void trace_write(trace_t* trace, uint64_t time_us, const uint8_t* data, size_t data_length) {
+	uint8_t header[11];
+	size_t length = 0;
+	uint64_t delta = trace->records ? time_us - trace->last_us : 0;
+	if (data_length > TRACE_MAX_RECORD) {
+		data_length = TRACE_MAX_RECORD;
+	}
+	do {
+		header[length] = delta & 0x7F;
+		delta >>= 7;
+		if (delta) {
+			header[length] |= 0x80;
+		}
+		++length;
+	} while (delta);
+	header[length++] = (uint8_t)data_length;
+	fwrite(header, 1, length, trace->file);
+	fwrite(data, 1, data_length, trace->file);
+	trace->last_us = time_us;
+	++trace->records;
+}
+
+int trace_open_read(trace_t* trace, const char* path) {
+	char magic[sizeof(TRACE_MAGIC)];
+	memset(trace, 0, sizeof(*trace));
+	trace->file = fopen(path, "rb");
+	if (trace->file == NULL) {
+		return 0;
+	}
+	if (fread(magic, 1, sizeof(magic), trace->file) != sizeof(magic) ||
+		memcmp(magic, TRACE_MAGIC, sizeof(magic)) != 0 ||
+		fgetc(trace->file) != TRACE_VERSION) {
+		trace_close(trace);
+		return 0;
+	}
+	return 1;
+}
+
+int trace_read(trace_t* trace, uint64_t* time_us, uint8_t data[TRACE_MAX_RECORD]) {
+	uint64_t delta = 0;
+	int shift = 0;
+	int c = 0;
+	do {
+		c = fgetc(trace->file);
+		if (c == EOF || shift > 63) {
+			return -1;
+		}
+		delta |= (uint64_t)(c & 0x7F) << shift;
+		shift += 7;
+	} while (c & 0x80);
+
+	int length = fgetc(trace->file);
+	if (length == EOF || fread(data, 1, length, trace->file) != (size_t)length) {
+		return -1;
+	}
+	trace->last_us += delta;
+	*time_us = trace->last_us;
+	++trace->records;
+	return length;
+}
+
+void trace_close(trace_t* trace) {
+	if (trace->file) {
+		fclose(trace->file);
+		trace->file = NULL;
+	}
+}
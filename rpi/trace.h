@@ -0,0 +1,31 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <stdio.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Trace file : "BLTR", version byte, then one record per notification
+// made of the time since the previous record in us (LEB128), the length
+// byte and the raw notification bytes.
+#define TRACE_VERSION 1
+#define TRACE_MAX_RECORD 255U
+
+typedef struct trace {
+	FILE* file;
+	uint64_t last_us;
+	unsigned long records;
+} trace_t;
+
+uint64_t trace_now_us(void);
+
+int trace_open_write(trace_t* trace, const char* path);
+void trace_write(trace_t* trace, uint64_t time_us, const uint8_t* data, size_t data_length);
+
+int trace_open_read(trace_t* trace, const char* path);
+// Returns the record length, or -1 at the end of the trace
+int trace_read(trace_t* trace, uint64_t* time_us, uint8_t data[TRACE_MAX_RECORD]);
+
+void trace_close(trace_t* trace);
+
+#endif
@@ -0,0 +1,61 @@
+#include <stdio.h>
+#include <string.h>
+#include "transport.h"
+
+static const transport_ops_t* transport_ops(const char* address) {
+	if (strncmp(address, "unix:", 5) == 0 || strncmp(address, "/dev/", 5) == 0) {
+		return &transport_stream;
+	}
+	return &transport_gattlib;
+}
+
+void transport_init(transport_t* transport, const char* address,
+	transport_notification_cb_t notification_cb, transport_disconnect_cb_t disconnect_cb, void* user_data) {
+	memset(transport, 0, sizeof(*transport));
+	transport->ops = transport_ops(address);
+	transport->notification_cb = notification_cb;
+	transport->disconnect_cb = disconnect_cb;
+	transport->user_data = user_data;
+	transport->fd = -1;
+}
+
+int transport_scan(const char* filter, char addresses[][TRANSPORT_ADDRESS], int max, int timeout_s) {
+	return transport_ops(filter)->scan(filter, addresses, max, timeout_s);
+}
+
+int transport_open(const transport_t* transport, const char* address, transport_link_t* link) {
+	memset(link, 0, sizeof(*link));
+	link->fd = -1;
+	// A cached characteristic handle only holds for the same gun
+	if (strncmp(transport->address, address, sizeof(transport->address)) == 0) {
+		link->char_handle = transport->char_handle;
+	}
+	return transport->ops->open(transport, address, link);
+}
+
+int transport_start(transport_t* transport, const char* address, const transport_link_t* link) {
+	snprintf(transport->address, sizeof(transport->address), "%s", address);
+	transport->char_handle = link->char_handle;
+	return transport->ops->start(transport, link);
+}
+
+void transport_close(const transport_t* transport, const transport_link_t* link) {
+	transport->ops->close(link);
+}
+
+int transport_write(transport_t* transport, const void* data, size_t data_length) {
+	if (!transport_connected(transport)) {
+		return 0;
+	}
+	return transport->ops->write(transport, data, data_length);
+}
+
+void transport_disconnect(transport_t* transport) {
+	if (transport_connected(transport)) {
+		transport->ops->disconnect(transport);
+	}
+}
+
+int transport_connected(const transport_t* transport) {
+	return transport->ops != NULL && (transport->handle != NULL || transport->fd != -1);
+}
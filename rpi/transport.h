@@ -0,0 +1,75 @@
+#ifndef TRANSPORT_H
+#define TRANSPORT_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+typedef void (*transport_notification_cb_t)(const uint8_t* data, size_t data_length, void* user_data);
+typedef void (*transport_disconnect_cb_t)(void* user_data);
+
+typedef struct transport transport_t;
+
+// Room for a MAC address or a simulated gun path
+#define TRANSPORT_ADDRESS 108
+
+// Link opened by a worker thread, not yet attached to the GLib loop
+typedef struct transport_link {
+	void* handle;
+	int fd;
+	uint16_t char_handle;
+} transport_link_t;
+
+typedef struct transport_ops {
+	const char* name;
+	// Open the link, may block for the BlueZ connect timeout so it runs in
+	// a worker thread. The transport is only read. Returns 0 on failure.
+	int (*open)(const transport_t* transport, const char* address, transport_link_t* link);
+	// From the GLib loop : attach the opened link and start notifications,
+	// the link is closed on failure. Returns 0 on failure.
+	int (*start)(transport_t* transport, const transport_link_t* link);
+	// Close a link that was opened but never started
+	void (*close)(const transport_link_t* link);
+	int (*write)(transport_t* transport, const void* data, size_t data_length);
+	void (*disconnect)(transport_t* transport);
+	// Find up to max guns for the filter within timeout_s seconds, returns
+	// how many addresses were written
+	int (*scan)(const char* filter, char addresses[][TRANSPORT_ADDRESS], int max, int timeout_s);
+} transport_ops_t;
+
+// Link to a gun. Notifications and link loss are delivered from the
+// GLib main loop through the callbacks.
+struct transport {
+	const transport_ops_t* ops;
+	transport_notification_cb_t notification_cb;
+	transport_disconnect_cb_t disconnect_cb;
+	void* user_data;
+	void* handle;
+	int fd;
+	unsigned int watch;
+	// Value handle of the gun characteristic, resolved once per address
+	uint16_t char_handle;
+	char address[TRANSPORT_ADDRESS];
+};
+
+extern const transport_ops_t transport_gattlib;
+extern const transport_ops_t transport_stream;
+
+// Pick the backend from the address :
+// "unix:<path>" or a "/dev/..." pty for a simulated gun, a MAC address otherwise
+void transport_init(transport_t* transport, const char* address,
+	transport_notification_cb_t notification_cb, transport_disconnect_cb_t disconnect_cb, void* user_data);
+
+// Guns advertising the gun service, or for "unix:<prefix>" simulated guns
+// listening on a socket whose path starts with prefix
+int transport_scan(const char* filter, char addresses[][TRANSPORT_ADDRESS], int max, int timeout_s);
+
+// Connection in two steps, transport_open() from any thread and
+// transport_start() or transport_close() with its link from the GLib loop
+int transport_open(const transport_t* transport, const char* address, transport_link_t* link);
+int transport_start(transport_t* transport, const char* address, const transport_link_t* link);
+void transport_close(const transport_t* transport, const transport_link_t* link);
+int transport_write(transport_t* transport, const void* data, size_t data_length);
+void transport_disconnect(transport_t* transport);
+int transport_connected(const transport_t* transport);
+
+#endif
@@ -0,0 +1,140 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "gattlib.h"
+#include "transport.h"
+
+// JDY-16 service and its read/write/notify characteristic
+#define GUN_SERVICE 0xFFE0
+#define GUN_CHARACTERISTIC 0xFFE1
+
+typedef struct scan {
+	char (*addresses)[TRANSPORT_ADDRESS];
+	int max;
+	int count;
+} scan_t;
+
+static void gattlib_notification(uint16_t handle, const uint8_t* data, size_t data_length, void* user_data) {
+	transport_t* transport = user_data;
+	transport->notification_cb(data, data_length, transport->user_data);
+}
+
+static void gattlib_link_lost(void* user_data) {
+	transport_t* transport = user_data;
+	if (transport->disconnect_cb) {
+		transport->disconnect_cb(transport->user_data);
+	}
+}
+
+// Value handle of the gun characteristic, 0 when not found
+static uint16_t gattlib_find_handle(gatt_connection_t* connection) {
+	const uuid_t ble_input_uuid = CREATE_UUID16(GUN_CHARACTERISTIC);
+	gattlib_characteristic_t* characteristics = NULL;
+	int count = 0, i = 0;
+	uint16_t handle = 0;
+	if (gattlib_discover_char(connection, &characteristics, &count) != GATTLIB_SUCCESS) {
+		return 0;
+	}
+	for (i = 0; i < count && handle == 0; ++i) {
+		if (gattlib_uuid_cmp(&characteristics[i].uuid, &ble_input_uuid) == 0) {
+			handle = characteristics[i].value_handle;
+		}
+	}
+	free(characteristics);
+	return handle;
+}
+
+static int gattlib_transport_open(const transport_t* transport, const char* address, transport_link_t* link) {
+	const uuid_t ble_input_uuid = CREATE_UUID16(GUN_CHARACTERISTIC);
+	const uint16_t enable_notification = 0x0001;
+
+	gatt_connection_t* connection = gattlib_connect(NULL, address, GATTLIB_CONNECTION_OPTIONS_LEGACY_DEFAULT);
+	if (connection == NULL) {
+		return 0;
+	}
+	// Resolved on the first connection to this gun only
+	if (link->char_handle == 0) {
+		link->char_handle = gattlib_find_handle(connection);
+	}
+	// Enable Status Notification
+	if (gattlib_write_char_by_uuid(connection, &ble_input_uuid, &enable_notification, sizeof(enable_notification)) != GATTLIB_SUCCESS) {
+		gattlib_disconnect(connection);
+		return 0;
+	}
+	link->handle = connection;
+	return 1;
+}
+
+// The signal handlers are connected from the GLib loop thread, so the
+// notifications are delivered there
+static int gattlib_transport_start(transport_t* transport, const transport_link_t* link) {
+	const uuid_t ble_input_uuid = CREATE_UUID16(GUN_CHARACTERISTIC);
+	gatt_connection_t* connection = link->handle;
+	gattlib_register_notification(connection, gattlib_notification, transport);
+	if (gattlib_notification_start(connection, &ble_input_uuid) != GATTLIB_SUCCESS) {
+		gattlib_disconnect(connection);
+		return 0;
+	}
+	// Link loss is reported by BlueZ, no need to wait for silence
+	gattlib_register_on_disconnect(connection, gattlib_link_lost, transport);
+	transport->handle = connection;
+	return 1;
+}
+
+static void gattlib_transport_close(const transport_link_t* link) {
+	gattlib_disconnect(link->handle);
+}
+
+static int gattlib_transport_write(transport_t* transport, const void* data, size_t data_length) {
+	const uuid_t write_uuid = CREATE_UUID16(GUN_CHARACTERISTIC);
+	if (transport->char_handle != 0) {
+		return gattlib_write_char_by_handle(transport->handle, transport->char_handle, data, data_length) == GATTLIB_SUCCESS;
+	}
+	return gattlib_write_char_by_uuid(transport->handle, &write_uuid, data, data_length) == GATTLIB_SUCCESS;
+}
+
+static void gattlib_transport_disconnect(transport_t* transport) {
+	const uuid_t ble_input_uuid = CREATE_UUID16(GUN_CHARACTERISTIC);
+	gattlib_notification_stop(transport->handle, &ble_input_uuid);
+	gattlib_disconnect(transport->handle);
+	transport->handle = NULL;
+}
+
+static void gattlib_discovered(void* adapter, const char* addr, const char* name, void* user_data) {
+	scan_t* scan = user_data;
+	int i = 0;
+	for (i = 0; i < scan->count; ++i) {
+		if (strcmp(scan->addresses[i], addr) == 0) {
+			return;
+		}
+	}
+	if (scan->count < scan->max) {
+		snprintf(scan->addresses[scan->count++], TRANSPORT_ADDRESS, "%s", addr);
+	}
+}
+
+// Blocks for timeout_s seconds
+static int gattlib_transport_scan(const char* filter, char addresses[][TRANSPORT_ADDRESS], int max, int timeout_s) {
+	uuid_t service = CREATE_UUID16(GUN_SERVICE);
+	uuid_t* services[] = { &service, NULL };
+	scan_t scan = { addresses, max, 0 };
+	void* adapter = NULL;
+	if (gattlib_adapter_open(NULL, &adapter) != GATTLIB_SUCCESS) {
+		return 0;
+	}
+	gattlib_adapter_scan_enable_with_filter(adapter, services, 0, GATTLIB_DISCOVER_FILTER_USE_UUID,
+		gattlib_discovered, timeout_s, &scan);
+	gattlib_adapter_scan_disable(adapter);
+	gattlib_adapter_close(adapter);
+	return scan.count;
+}
+
+const transport_ops_t transport_gattlib = {
+	"gattlib",
+	gattlib_transport_open,
+	gattlib_transport_start,
+	gattlib_transport_close,
+	gattlib_transport_write,
+	gattlib_transport_disconnect,
+	gattlib_transport_scan
+};
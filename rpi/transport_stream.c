@@ -0,0 +1,152 @@
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <termios.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <glib.h>
+#include <glib-unix.h>
+#include "transport.h"
+
+// Same payload size as a JDY-16 notification
+#define STREAM_CHUNK 20U
+
+static gboolean stream_readable(gint fd, GIOCondition condition, gpointer user_data) {
+	transport_t* transport = user_data;
+	uint8_t data[STREAM_CHUNK];
+	ssize_t length = read(fd, data, sizeof(data));
+	if (length > 0) {
+		transport->notification_cb(data, length, transport->user_data);
+		return G_SOURCE_CONTINUE;
+	}
+	if (length < 0 && (errno == EAGAIN || errno == EINTR)) {
+		return G_SOURCE_CONTINUE;
+	}
+	// Peer closed the link
+	transport->watch = 0;
+	if (transport->disconnect_cb) {
+		transport->disconnect_cb(transport->user_data);
+	}
+	return G_SOURCE_REMOVE;
+}
+
+static int stream_open(const char* address) {
+	if (strncmp(address, "unix:", 5) == 0) {
+		struct sockaddr_un addr;
+		int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+		if (fd == -1) {
+			return -1;
+		}
+		memset(&addr, 0, sizeof(addr));
+		addr.sun_family = AF_UNIX;
+		strncpy(addr.sun_path, address + 5, sizeof(addr.sun_path) - 1);
+		if (connect(fd, (struct sockaddr*)&addr, sizeof(addr)) != 0) {
+			close(fd);
+			return -1;
+		}
+		return fd;
+	}
+
+	int fd = open(address, O_RDWR | O_NOCTTY);
+	if (fd != -1) {
+		struct termios tio;
+		if (tcgetattr(fd, &tio) == 0) {
+			cfmakeraw(&tio);
+			tcsetattr(fd, TCSANOW, &tio);
+		}
+	}
+	return fd;
+}
+
+static int stream_open_link(const transport_t* transport, const char* address, transport_link_t* link) {
+	int fd = stream_open(address);
+	if (fd == -1) {
+		return 0;
+	}
+	fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+	link->fd = fd;
+	return 1;
+}
+
+static int stream_start(transport_t* transport, const transport_link_t* link) {
+	transport->fd = link->fd;
+	transport->watch = g_unix_fd_add(link->fd, G_IO_IN | G_IO_HUP | G_IO_ERR, stream_readable, transport);
+	return 1;
+}
+
+static void stream_close(const transport_link_t* link) {
+	close(link->fd);
+}
+
+static int stream_write(transport_t* transport, const void* data, size_t data_length) {
+	// The peer may be gone before its EOF is read, EPIPE and no SIGPIPE
+	if (strncmp(transport->address, "unix:", 5) == 0) {
+		return send(transport->fd, data, data_length, MSG_NOSIGNAL) == (ssize_t)data_length;
+	}
+	return write(transport->fd, data, data_length) == (ssize_t)data_length;
+}
+
+static void stream_disconnect(transport_t* transport) {
+	if (transport->watch) {
+		g_source_remove(transport->watch);
+		transport->watch = 0;
+	}
+	close(transport->fd);
+	transport->fd = -1;
+}
+
+// Simulated guns : sockets whose path starts with the filter path
+static int stream_scan(const char* filter, char addresses[][TRANSPORT_ADDRESS], int max, int timeout_s) {
+	char directory[TRANSPORT_ADDRESS];
+	const char* prefix = NULL;
+	struct dirent* entry = NULL;
+	int count = 0;
+	if (strncmp(filter, "unix:", 5) != 0) {
+		return 0;
+	}
+	snprintf(directory, sizeof(directory), "%s", filter + 5);
+	char* slash = strrchr(directory, '/');
+	if (slash == NULL) {
+		return 0;
+	}
+	*slash = '\0';
+	prefix = filter + 5 + (slash - directory) + 1;
+	DIR* dir = opendir(directory[0] ? directory : "/");
+	if (dir == NULL) {
+		return 0;
+	}
+	while (count < max && (entry = readdir(dir)) != NULL) {
+		struct stat st;
+		char path[PATH_MAX];
+		if (strncmp(entry->d_name, prefix, strlen(prefix)) != 0) {
+			continue;
+		}
+		const int length = snprintf(path, sizeof(path), "%s/%s", directory, entry->d_name);
+		// Too long for an address once prefixed with "unix:"
+		if (length < 0 || length + 5 >= TRANSPORT_ADDRESS) {
+			continue;
+		}
+		if (stat(path, &st) == 0 && S_ISSOCK(st.st_mode)) {
+			memcpy(addresses[count], "unix:", 5);
+			memcpy(addresses[count] + 5, path, length + 1);
+			++count;
+		}
+	}
+	closedir(dir);
+	return count;
+}
+
+const transport_ops_t transport_stream = {
+	"stream",
+	stream_open_link,
+	stream_start,
+	stream_close,
+	stream_write,
+	stream_disconnect,
+	stream_scan
+};
@@ -0,0 +1,95 @@
+#include <string.h>
+#include "upsample.h"
+
+void upsample_init(upsample_t* upsample, double rate_hz, double delay_ms) {
+	memset(upsample, 0, sizeof(*upsample));
+	upsample->period_ns = rate_hz > 0.0 ? (uint64_t)(1e9 / rate_hz) : 0;
+	upsample->delay_ns = delay_ms > 0.0 ? (uint64_t)(delay_ms * 1e6) : 0;
+	upsample->stale_ns = UPSAMPLE_STALE_MS * 1000000ULL;
+}
+
+void upsample_sample(upsample_t* upsample, uint64_t time_ns, double x, double y) {
+	if (upsample->period_ns == 0) {
+		return;
+	}
+	if (upsample->count > 0) {
+		const upsample_sample_t* newest = &upsample->samples[(upsample->count - 1) % UPSAMPLE_SAMPLES];
+		// Out of order time stamps would divide by zero or go backward
+		if (time_ns <= newest->time_ns) {
+			return;
+		}
+	}
+	else {
+		upsample->next_ns = time_ns;
+	}
+	upsample_sample_t* sample = &upsample->samples[upsample->count++ % UPSAMPLE_SAMPLES];
+	sample->time_ns = time_ns;
+	sample->x = x;
+	sample->y = y;
+}
+
+uint64_t upsample_deadline(const upsample_t* upsample) {
+	if (upsample->period_ns == 0 || upsample->count == 0) {
+		return 0;
+	}
+	// The cursor stops one output after the end of the extrapolation
+	const upsample_sample_t* newest = &upsample->samples[(upsample->count - 1) % UPSAMPLE_SAMPLES];
+	if (upsample->next_ns > newest->time_ns + upsample->delay_ns + upsample->stale_ns + upsample->period_ns) {
+		return 0;
+	}
+	return upsample->next_ns;
+}
+
+int upsample_due(upsample_t* upsample, uint64_t now_ns) {
+	const uint64_t deadline = upsample_deadline(upsample);
+	if (deadline == 0 || now_ns < deadline) {
+		return 0;
+	}
+	upsample->next_ns += upsample->period_ns;
+	// Also after a stop, the outputs restart with the next position
+	if (upsample->next_ns <= now_ns) {
+		upsample->next_ns = now_ns + upsample->period_ns;
+	}
+	return 1;
+}
+
+int upsample_position(const upsample_t* upsample, uint64_t now_ns, double* x, double* y) {
+	const unsigned int n = upsample->count < UPSAMPLE_SAMPLES ? upsample->count : UPSAMPLE_SAMPLES;
+	unsigned int i = 0;
+	if (n == 0) {
+		return 0;
+	}
+	const upsample_sample_t* newest = &upsample->samples[(upsample->count - 1) % UPSAMPLE_SAMPLES];
+	const uint64_t target = now_ns > upsample->delay_ns ? now_ns - upsample->delay_ns : 0;
+	if (target >= newest->time_ns || n == 1) {
+		// Ahead of the newest position along the last move
+		uint64_t ahead = target > newest->time_ns ? target - newest->time_ns : 0;
+		*x = newest->x;
+		*y = newest->y;
+		if (n > 1) {
+			const upsample_sample_t* previous = &upsample->samples[(upsample->count - 2) % UPSAMPLE_SAMPLES];
+			const double span = (double)(newest->time_ns - previous->time_ns);
+			if (ahead > upsample->stale_ns) {
+				ahead = upsample->stale_ns;
+			}
+			*x += (newest->x - previous->x) * ahead / span;
+			*y += (newest->y - previous->y) * ahead / span;
+		}
+		return 1;
+	}
+	for (i = 1; i < n; ++i) {
+		const upsample_sample_t* after = &upsample->samples[(upsample->count - i) % UPSAMPLE_SAMPLES];
+		const upsample_sample_t* before = &upsample->samples[(upsample->count - i - 1) % UPSAMPLE_SAMPLES];
+		if (target >= before->time_ns) {
+			const double weight = (double)(target - before->time_ns) / (after->time_ns - before->time_ns);
+			*x = before->x + (after->x - before->x) * weight;
+			*y = before->y + (after->y - before->y) * weight;
+			return 1;
+		}
+	}
+	// Older than every position
+	const upsample_sample_t* oldest = &upsample->samples[(upsample->count - n) % UPSAMPLE_SAMPLES];
+	*x = oldest->x;
+	*y = oldest->y;
+	return 1;
+}
@@ -0,0 +1,47 @@
+#ifndef UPSAMPLE_H
+#define UPSAMPLE_H
+
+#include <stdint.h>
+
+// Positions kept, enough for a delay of two aim periods
+#define UPSAMPLE_SAMPLES 4
+// Longest extrapolation past the newest position, the cursor then waits
+#define UPSAMPLE_STALE_MS 60
+
+typedef struct upsample_sample {
+	uint64_t time_ns;
+	double x, y;
+} upsample_sample_t;
+
+// Cursor positions at a fixed output rate from the screen positions of the
+// aim frames. The output at time t shows the aim at t - delay, interpolated
+// between the two positions around it, or extrapolated along the last two
+// for at most UPSAMPLE_STALE_MS. A delay of one aim period always
+// interpolates, 0 adds no latency but overshoots at the end of a move.
+typedef struct upsample {
+	uint64_t period_ns;
+	uint64_t delay_ns;
+	uint64_t stale_ns;
+	// Next output, phase locked to the first position
+	uint64_t next_ns;
+	upsample_sample_t samples[UPSAMPLE_SAMPLES];
+	unsigned int count;
+} upsample_t;
+
+// A rate of 0 turns the output off, forgets the positions
+void upsample_init(upsample_t* upsample, double rate_hz, double delay_ms);
+
+// Screen position of an aim frame taken at time_ns, in time order
+void upsample_sample(upsample_t* upsample, uint64_t time_ns, double x, double y);
+
+// Next output time, 0 when off, without position or once the cursor stopped
+uint64_t upsample_deadline(const upsample_t* upsample);
+
+// Returns 1 and moves to the next output when one is due at now_ns. A
+// late output is not repeated, the next one is a period from now.
+int upsample_due(upsample_t* upsample, uint64_t now_ns);
+
+// Position to show at now_ns, 0 without position
+int upsample_position(const upsample_t* upsample, uint64_t now_ns, double* x, double* y);
+
+#endif